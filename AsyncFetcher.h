@@ -0,0 +1,285 @@
+//
+// Awaitable HTTP fetches driven by curl multi socket callbacks
+//
+
+#ifndef HLS_FETCH_AND_SORT_ASYNCFETCHER_H
+#define HLS_FETCH_AND_SORT_ASYNCFETCHER_H
+
+#include <curl/curl.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "CurlGlobal.h"
+#include "HLSFetcherPool.h"
+#include "TransferMetrics.h"
+
+/**
+ * @brief Event loop thread turning HTTP fetches into awaitables.
+ *
+ * co_await fetch(url) hands the request to the loop and suspends the coroutine; the loop
+ * runs all transfers on one curl multi handle, driven by its socket and timer callbacks
+ * (curl_multi_socket_action), so it only touches the sockets that are ready, and resumes
+ * each coroutine on the loop thread with the FetchResult when its transfer is done. A
+ * suspended fetch therefore costs a coroutine frame and an easy handle, never a thread.
+ *
+ * Resumed coroutines run on the loop thread and delay every other transfer while they do,
+ * so CPU work belongs behind a co_await schedule(pool). Failures are reported through
+ * FetchResult, never thrown. fetch() may be called from any thread; transfers still running
+ * when the fetcher is destroyed complete with CURLE_ABORTED_BY_CALLBACK.
+ */
+class AsyncFetcher {
+public:
+    struct Options {
+        long max_host_connections = 0;      // connections per host, 0 = unlimited
+        long timeout_seconds      = 10;
+        bool http2                = true;   // negotiate HTTP/2 and multiplex requests
+    };
+
+    // A fetch waiting for or in the loop; lives in the awaiting coroutine's frame
+    struct Request {
+        std::string             url;
+        FetchResult             result;
+        std::coroutine_handle<> awaiting;
+    };
+
+    AsyncFetcher() : AsyncFetcher(Options()) {}
+
+    explicit AsyncFetcher(Options options) : options_(options) {
+        CurlGlobal::ensureInitialized();
+        multi_ = curl_multi_init();
+        if (!multi_) throw std::runtime_error("Failed to initialize CURL multi handle");
+        if (::pipe2(wake_, O_CLOEXEC | O_NONBLOCK) != 0) {
+            curl_multi_cleanup(multi_);
+            throw std::runtime_error(std::string("Could not create wake-up pipe: ") + std::strerror(errno));
+        }
+
+        curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, SocketCallback);
+        curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+        curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, TimerCallback);
+        curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+        curl_multi_setopt(multi_, CURLMOPT_PIPELINING, options_.http2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+        curl_multi_setopt(multi_, CURLMOPT_MAX_HOST_CONNECTIONS, options_.max_host_connections);
+
+        loop_ = std::thread([this] { run(); });
+    }
+
+    ~AsyncFetcher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake();
+        loop_.join();
+
+        for (CURL* easy : idle_) curl_easy_cleanup(easy);
+        curl_multi_cleanup(multi_);
+        ::close(wake_[0]);
+        ::close(wake_[1]);
+    }
+
+    AsyncFetcher(const AsyncFetcher&) = delete;
+    AsyncFetcher& operator=(const AsyncFetcher&) = delete;
+
+    // Awaitable yielding the FetchResult of url.
+    auto fetch(std::string url) {
+        struct Awaiter {
+            AsyncFetcher* fetcher;
+            Request       request;
+
+            bool await_ready() const noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> handle) {
+                request.awaiting = handle;
+                fetcher->submit(&request);          // may resume handle before returning
+            }
+
+            FetchResult await_resume() { return std::move(request.result); }
+        };
+        return Awaiter{this, Request{std::move(url), FetchResult{}, {}}};
+    }
+
+private:
+    Options     options_;
+    CURLM*      multi_ = nullptr;
+    int         wake_[2] = {-1, -1};         // self-pipe interrupting poll() for new requests
+    std::thread loop_;
+
+    std::mutex            mutex_;            // guards submitted_ and stopping_
+    std::vector<Request*> submitted_;
+    bool                  stopping_ = false;
+
+    // Loop thread only
+    std::unordered_map<curl_socket_t, short>             sockets_;    // socket -> poll events
+    std::optional<std::chrono::steady_clock::time_point> deadline_;   // curl's timer
+    std::vector<CURL*>                                   active_;
+    std::vector<CURL*>                                   idle_;       // reset and reused
+
+    static constexpr int kMaxPollMs = 1000;
+
+    static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+        size_t totalSize = size * nmemb;
+        static_cast<std::string*>(userp)->append(static_cast<const char*>(contents), totalSize);
+        return totalSize;
+    }
+
+    // Tracks which sockets curl wants watched, and for what.
+    static int SocketCallback(CURL*, curl_socket_t socket, int what, void* userp, void*) {
+        auto* self = static_cast<AsyncFetcher*>(userp);
+        if (what == CURL_POLL_REMOVE) {
+            self->sockets_.erase(socket);
+        } else {
+            short events = 0;
+            if (what == CURL_POLL_IN || what == CURL_POLL_INOUT)  events |= POLLIN;
+            if (what == CURL_POLL_OUT || what == CURL_POLL_INOUT) events |= POLLOUT;
+            self->sockets_[socket] = events;
+        }
+        return 0;
+    }
+
+    // Arms (or with -1 disarms) the single timer curl asks for.
+    static int TimerCallback(CURLM*, long timeout_ms, void* userp) {
+        auto* self = static_cast<AsyncFetcher*>(userp);
+        if (timeout_ms < 0) self->deadline_.reset();
+        else                self->deadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        return 0;
+    }
+
+    void submit(Request* request) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!stopping_) {
+                submitted_.push_back(request);
+                request = nullptr;
+            }
+        }
+        if (request) {
+            request->result.url       = request->url;
+            request->result.curl_code = CURLE_ABORTED_BY_CALLBACK;
+            request->awaiting.resume();
+            return;
+        }
+        wake();
+    }
+
+    void wake() {
+        char byte = 0;
+        while (::write(wake_[1], &byte, 1) < 0 && errno == EINTR) {}
+    }
+
+    void run() {
+        std::vector<pollfd> fds;
+        while (true) {
+            std::vector<Request*> requests;
+            bool stopping;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                requests.swap(submitted_);
+                stopping = stopping_;
+            }
+            for (Request* request : requests) start(request);
+            if (stopping) break;
+
+            fds.assign(1, pollfd{wake_[0], POLLIN, 0});
+            for (const auto& [socket, events] : sockets_) fds.push_back(pollfd{socket, events, 0});
+
+            int timeout = kMaxPollMs;
+            if (deadline_) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(*deadline_ - std::chrono::steady_clock::now());
+                timeout = static_cast<int>(std::clamp<long long>(left.count(), 0, kMaxPollMs));
+            }
+            if (::poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR) break;
+
+            if (fds[0].revents) {
+                char buffer[64];
+                while (::read(wake_[0], buffer, sizeof(buffer)) > 0) {}
+            }
+
+            int running = 0;
+            for (size_t i = 1; i < fds.size(); ++i) {
+                if (!fds[i].revents) continue;
+                int flags = 0;
+                if (fds[i].revents & POLLIN)              flags |= CURL_CSELECT_IN;
+                if (fds[i].revents & POLLOUT)             flags |= CURL_CSELECT_OUT;
+                if (fds[i].revents & (POLLERR | POLLHUP)) flags |= CURL_CSELECT_ERR;
+                curl_multi_socket_action(multi_, fds[i].fd, flags, &running);
+            }
+            if (deadline_ && std::chrono::steady_clock::now() >= *deadline_) {
+                deadline_.reset();
+                curl_multi_socket_action(multi_, CURL_SOCKET_TIMEOUT, 0, &running);
+            }
+
+            int queued = 0;
+            while (CURLMsg* msg = curl_multi_info_read(multi_, &queued)) {
+                if (msg->msg == CURLMSG_DONE) complete(msg->easy_handle, msg->data.result);
+            }
+        }
+
+        // Shutting down: whatever is still running is abandoned
+        while (!active_.empty()) complete(active_.back(), CURLE_ABORTED_BY_CALLBACK);
+    }
+
+    // Configures a (recycled) easy handle for request and adds it to the multi handle.
+    void start(Request* request) {
+        CURL* easy = nullptr;
+        if (idle_.empty()) {
+            easy = curl_easy_init();
+        } else {
+            easy = idle_.back();
+            idle_.pop_back();
+            curl_easy_reset(easy);
+        }
+        request->result.url = request->url;
+        if (!easy) {
+            request->result.curl_code = CURLE_FAILED_INIT;
+            request->awaiting.resume();
+            return;
+        }
+
+        curl_easy_setopt(easy, CURLOPT_URL, request->url.c_str());
+        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, WriteCallback);
+        curl_easy_setopt(easy, CURLOPT_WRITEDATA, &request->result.body);
+        curl_easy_setopt(easy, CURLOPT_PROTOCOLS_STR, "http,https");         // no file://, ftp://, ...
+        curl_easy_setopt(easy, CURLOPT_REDIR_PROTOCOLS_STR, "http,https");
+        curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(easy, CURLOPT_ACCEPT_ENCODING, "");      // any encoding curl decodes
+        curl_easy_setopt(easy, CURLOPT_TIMEOUT, options_.timeout_seconds);
+        if (options_.http2) {
+            curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+            curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+        }
+        curl_easy_setopt(easy, CURLOPT_PRIVATE, request);
+
+        active_.push_back(easy);
+        curl_multi_add_handle(multi_, easy);
+    }
+
+    // Detaches a finished transfer, recycles its handle and resumes the awaiting coroutine.
+    void complete(CURL* easy, CURLcode code) {
+        Request* request = nullptr;
+        curl_easy_getinfo(easy, CURLINFO_PRIVATE, &request);
+        active_.erase(std::find(active_.begin(), active_.end(), easy));
+        curl_multi_remove_handle(multi_, easy);
+
+        request->result.curl_code = code;
+        curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &request->result.http_code);
+        request->result.transfer = TransferMetrics::collect(easy);
+        idle_.push_back(easy);
+
+        request->awaiting.resume();
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_ASYNCFETCHER_H
@@ -0,0 +1,125 @@
+//
+// Counting semaphore for coroutines
+//
+
+#ifndef HLS_FETCH_AND_SORT_ASYNCSEMAPHORE_H
+#define HLS_FETCH_AND_SORT_ASYNCSEMAPHORE_H
+
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+/**
+ * @brief Bounds how many coroutines are inside a stage at once, without blocking threads.
+ *
+ * co_await acquire() completes immediately while permits are left; otherwise the coroutine
+ * is suspended and queued, and a later release hands its permit straight to the oldest
+ * waiter, which resumes on the releasing thread. Permits are RAII objects released when
+ * they go out of scope, so an exception never leaks one. Thread-safe.
+ *
+ * Example:
+ *
+ *     AsyncSemaphore fetches(32);
+ *     {
+ *         auto permit = co_await fetches.acquire();
+ *         result = co_await fetcher.fetch(url);
+ *     }                                   // the next queued job starts its transfer here
+ */
+class AsyncSemaphore {
+public:
+    // One acquired unit of the semaphore, released on destruction.
+    class Permit {
+    public:
+        Permit() = default;
+
+        explicit Permit(AsyncSemaphore* semaphore) : semaphore_(semaphore) {}
+
+        Permit(Permit&& other) noexcept : semaphore_(std::exchange(other.semaphore_, nullptr)) {}
+
+        Permit& operator=(Permit&& other) noexcept {
+            if (this != &other) {
+                release();
+                semaphore_ = std::exchange(other.semaphore_, nullptr);
+            }
+            return *this;
+        }
+
+        ~Permit() { release(); }
+
+        Permit(const Permit&) = delete;
+        Permit& operator=(const Permit&) = delete;
+
+        // Gives the permit back early.
+        void release() {
+            if (semaphore_) std::exchange(semaphore_, nullptr)->release();
+        }
+
+    private:
+        AsyncSemaphore* semaphore_ = nullptr;
+    };
+
+    explicit AsyncSemaphore(size_t permits) : available_(permits) {
+        if (permits == 0) throw std::invalid_argument("AsyncSemaphore requires at least one permit");
+    }
+
+    AsyncSemaphore(const AsyncSemaphore&) = delete;
+    AsyncSemaphore& operator=(const AsyncSemaphore&) = delete;
+
+    auto acquire() {
+        struct Awaiter {
+            AsyncSemaphore* semaphore;
+
+            // Takes a free permit without suspending if there is one.
+            bool await_ready() {
+                std::lock_guard<std::mutex> lock(semaphore->mutex_);
+                if (semaphore->available_ == 0) return false;
+                --semaphore->available_;
+                return true;
+            }
+
+            // Queues the coroutine, unless a permit was released since await_ready().
+            bool await_suspend(std::coroutine_handle<> handle) {
+                std::lock_guard<std::mutex> lock(semaphore->mutex_);
+                if (semaphore->available_ > 0) {
+                    --semaphore->available_;
+                    return false;
+                }
+                semaphore->waiters_.push_back(handle);
+                return true;
+            }
+
+            Permit await_resume() { return Permit(semaphore); }
+        };
+        return Awaiter{this};
+    }
+
+    // Permits not held by anyone.
+    size_t available() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return available_;
+    }
+
+private:
+    mutable std::mutex                  mutex_;
+    size_t                              available_;
+    std::deque<std::coroutine_handle<>> waiters_;
+
+    void release() {
+        std::coroutine_handle<> next;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (waiters_.empty()) {
+                ++available_;
+                return;
+            }
+            next = waiters_.front();
+            waiters_.pop_front();
+        }
+        next.resume();      // the permit passes to the waiter as is
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_ASYNCSEMAPHORE_H
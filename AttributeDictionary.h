@@ -0,0 +1,127 @@
+//
+// Interned values of low-cardinality attributes
+//
+
+#ifndef HLS_FETCH_AND_SORT_ATTRIBUTEDICTIONARY_H
+#define HLS_FETCH_AND_SORT_ATTRIBUTEDICTIONARY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory_resource>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Id of a value interned in a BasicAttributeDictionary.
+ *
+ * Once the dictionary is ordered, ids compare like the values they stand for, so sorting by
+ * an interned attribute compares integers.
+ */
+enum class AttributeId : uint32_t {};
+
+/**
+ * @brief Maps the distinct values of low-cardinality attributes (CODECS, VIDEO-RANGE,
+ * LANGUAGE, ...) to small integer ids.
+ *
+ * Elements store an AttributeId instead of a string per field. Ids are handed out in order
+ * of first appearance while parsing; order() then renumbers them in value order, returning
+ * the old-to-new table the owner applies to its stored ids.
+ *
+ * @tparam String  std::string to keep copies of the values, std::string_view to point into
+ *                 a buffer that outlives the dictionary (the view model's playlist).
+ */
+template<typename String>
+class BasicAttributeDictionary {
+public:
+    BasicAttributeDictionary() : BasicAttributeDictionary(std::pmr::get_default_resource()) {}
+
+    explicit BasicAttributeDictionary(std::pmr::memory_resource* resource) : values_(resource), index_(resource) {}
+
+    // The index holds views of the stored values, so it is rebuilt for the new storage.
+    BasicAttributeDictionary(const BasicAttributeDictionary& other)
+        : values_(other.values_), ordered_(other.ordered_) { rebuildIndex(); }
+
+    BasicAttributeDictionary(BasicAttributeDictionary&& other)
+        : values_(std::move(other.values_)), ordered_(other.ordered_) { rebuildIndex(); }
+
+    BasicAttributeDictionary& operator=(const BasicAttributeDictionary& other) {
+        if (this != &other) {
+            values_  = other.values_;
+            ordered_ = other.ordered_;
+            rebuildIndex();
+        }
+        return *this;
+    }
+
+    BasicAttributeDictionary& operator=(BasicAttributeDictionary&& other) {
+        if (this != &other) {
+            values_  = std::move(other.values_);
+            ordered_ = other.ordered_;
+            rebuildIndex();
+        }
+        return *this;
+    }
+
+    // Id of value, adding it if it is new.
+    AttributeId intern(std::string_view value) {
+        auto it = index_.find(value);
+        if (it != index_.end()) return it->second;
+
+        AttributeId id{static_cast<uint32_t>(values_.size())};
+        const String& stored = values_.emplace_back(value);
+        index_.emplace(std::string_view(stored), id);
+        ordered_ = false;
+        return id;
+    }
+
+    std::string_view value(AttributeId id) const {
+        return values_[static_cast<uint32_t>(id)];
+    }
+
+    size_t size() const { return values_.size(); }
+
+    // true if no value was added since the last order()
+    bool ordered() const { return ordered_; }
+
+    /**
+     * @brief Renumbers the ids so that they are ordered like their values.
+     * @return Table mapping every previous id (as index) to its new id.
+     */
+    std::pmr::vector<AttributeId> order() {
+        std::pmr::vector<uint32_t> by_value(values_.size(), values_.get_allocator());
+        std::iota(by_value.begin(), by_value.end(), 0u);
+        std::sort(by_value.begin(), by_value.end(), [this](uint32_t a, uint32_t b) {
+            return std::string_view(values_[a]) < std::string_view(values_[b]);
+        });
+
+        std::pmr::vector<AttributeId> remap(values_.size(), values_.get_allocator());
+        std::pmr::deque<String> sorted(values_.get_allocator());
+        for (uint32_t rank = 0; rank < by_value.size(); ++rank) {
+            remap[by_value[rank]] = AttributeId{rank};
+            sorted.push_back(std::move(values_[by_value[rank]]));
+        }
+        values_.swap(sorted);
+        rebuildIndex();
+        ordered_ = true;
+        return remap;
+    }
+
+private:
+    std::pmr::deque<String>                                 values_;    // by id; stable addresses
+    std::pmr::unordered_map<std::string_view, AttributeId>  index_;     // views of values_
+    bool                                                    ordered_ = true;
+
+    void rebuildIndex() {
+        index_.clear();
+        for (uint32_t id = 0; id < values_.size(); ++id) {
+            index_.emplace(std::string_view(values_[id]), AttributeId{id});
+        }
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_ATTRIBUTEDICTIONARY_H
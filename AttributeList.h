@@ -0,0 +1,157 @@
+//
+// Allocation-free lexer for HLS attribute lists (RFC 8216, section 4.2)
+//
+
+#ifndef HLS_FETCH_AND_SORT_ATTRIBUTELIST_H
+#define HLS_FETCH_AND_SORT_ATTRIBUTELIST_H
+
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief Tokenized attribute list of a single tag line.
+ *
+ * The line is lexed once into AttributeName/AttributeValue pairs, which are kept as
+ * std::string_views into the line, so the line must outlive the AttributeList. Lookups
+ * compare whole attribute names, i.e. "BANDWIDTH" never matches "AVERAGE-BANDWIDTH".
+ *
+ * Quoted-string values are returned without their surrounding quotes. All other value
+ * types (decimal-integer, hexadecimal-sequence, decimal-floating-point, decimal-resolution
+ * and enumerated-string) are returned verbatim and can be converted with the typed helpers.
+ *
+ * Example:
+ *
+ *     AttributeList attrs(R"(#EXT-X-STREAM-INF:BANDWIDTH=2483789,CODECS="mp4a.40.2,hvc1.2.4.L90.90")");
+ *     attrs.get("CODECS");                   // mp4a.40.2,hvc1.2.4.L90.90
+ *     attrs.getInt("BANDWIDTH");             // 2483789
+ */
+class AttributeList {
+public:
+    struct Attribute {
+        std::string_view name;
+        std::string_view value;
+        bool             quoted;
+    };
+
+    // Upper bound of attributes kept per line; further attributes are ignored.
+    static constexpr size_t kMaxAttributes = 32;
+
+    struct Resolution {
+        int width  = 0;
+        int height = 0;
+    };
+
+    /**
+     * @brief Lexes the attribute list of a tag line.
+     *
+     * Everything up to and including the first ':' is treated as the tag name and skipped.
+     * A line without ':' yields an empty list. Malformed input never throws: lexing stops at
+     * the first attribute that cannot be tokenized and keeps what was read so far.
+     */
+    explicit AttributeList(std::string_view line) {
+        size_t colon = line.find(':');
+        if (colon != std::string_view::npos) lex(line.substr(colon + 1));
+    }
+
+    size_t size() const { return count_; }
+    const Attribute* begin() const { return attributes_.data(); }
+    const Attribute* end() const { return attributes_.data() + count_; }
+
+    // Returns the attribute with the given name, or nullptr if absent.
+    const Attribute* find(std::string_view name) const {
+        for (size_t i = 0; i < count_; ++i) {
+            if (attributes_[i].name == name) return &attributes_[i];
+        }
+        return nullptr;
+    }
+
+    bool has(std::string_view name) const { return find(name) != nullptr; }
+
+    // Returns the (unquoted) value of the attribute, or an empty view if absent.
+    std::string_view get(std::string_view name) const {
+        const Attribute* attr = find(name);
+        return attr ? attr->value : std::string_view();
+    }
+
+    // decimal-integer value of the attribute, or fallback if absent or malformed.
+    int getInt(std::string_view name, int fallback = 0) const {
+        return decimalInteger(get(name), fallback);
+    }
+
+    // decimal-resolution value of the attribute, e.g. 1920x1080; zeros if absent or malformed.
+    Resolution getResolution(std::string_view name) const {
+        return decimalResolution(get(name));
+    }
+
+    /*  Typed conversions of raw attribute values */
+
+    // Parses the leading decimal digits of value, e.g. "16" of "16/JOC".
+    static int decimalInteger(std::string_view value, int fallback = 0) {
+        int result = 0;
+        auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+        return (ec == std::errc() && ptr != value.data()) ? result : fallback;
+    }
+
+    static double decimalFloat(std::string_view value, double fallback = 0.0) {
+        double result = 0.0;
+        auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+        return (ec == std::errc() && ptr != value.data()) ? result : fallback;
+    }
+
+    static Resolution decimalResolution(std::string_view value) {
+        Resolution res;
+        size_t x_pos = value.find('x');
+        if (x_pos == std::string_view::npos) return res;
+        res.width  = decimalInteger(value.substr(0, x_pos));
+        res.height = decimalInteger(value.substr(x_pos + 1));
+        return res;
+    }
+
+    // Parses a hexadecimal-sequence ("0x" or "0X" prefix); returns fallback if malformed or wider than 64 bits.
+    static uint64_t hexadecimal(std::string_view value, uint64_t fallback = 0) {
+        if (value.size() < 3 || value[0] != '0' || (value[1] != 'x' && value[1] != 'X')) return fallback;
+        uint64_t result = 0;
+        auto [ptr, ec] = std::from_chars(value.data() + 2, value.data() + value.size(), result, 16);
+        return (ec == std::errc() && ptr == value.data() + value.size()) ? result : fallback;
+    }
+
+private:
+    std::array<Attribute, kMaxAttributes> attributes_{};
+    size_t count_ = 0;
+
+    void lex(std::string_view list) {
+        size_t pos = 0;
+        while (pos < list.size() && count_ < kMaxAttributes) {
+            // AttributeName: [A-Z0-9-]+ followed by '='
+            size_t eq = list.find('=', pos);
+            if (eq == std::string_view::npos || eq == pos) return;
+            std::string_view name = list.substr(pos, eq - pos);
+            pos = eq + 1;
+
+            std::string_view value;
+            bool quoted = pos < list.size() && list[pos] == '"';
+            if (quoted) {
+                // quoted-string: no escapes, may contain commas
+                size_t close = list.find('"', pos + 1);
+                if (close == std::string_view::npos) return;
+                value = list.substr(pos + 1, close - pos - 1);
+                pos = close + 1;
+            } else {
+                size_t comma = list.find(',', pos);
+                if (comma == std::string_view::npos) comma = list.size();
+                value = list.substr(pos, comma - pos);
+                pos = comma;
+            }
+            attributes_[count_++] = Attribute{name, value, quoted};
+
+            if (pos < list.size()) {
+                if (list[pos] != ',') return;
+                ++pos;
+            }
+        }
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_ATTRIBUTELIST_H
@@ -0,0 +1,330 @@
+//
+// Batch re-sorting of many master playlists
+//
+
+#ifndef HLS_FETCH_AND_SORT_BATCHRUNNER_H
+#define HLS_FETCH_AND_SORT_BATCHRUNNER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "AsyncFetcher.h"
+#include "AsyncSemaphore.h"
+#include "HLSUrl.h"
+#include "HLSWriter.h"
+#include "M3U8Parser.h"
+#include "MappedFile.h"
+#include "PipelineMetrics.h"
+#include "PlaylistDiff.h"
+#include "PlaylistSnapshot.h"
+#include "SortSpec.h"
+#include "Task.h"
+#include "ThreadPool.h"
+
+// Outcome of a batch run
+struct BatchReport {
+    size_t   succeeded = 0;
+    size_t   failed    = 0;
+    uint64_t bytes_in  = 0;        // playlist bytes read or fetched
+    uint64_t bytes_out = 0;        // playlist bytes written
+    double   seconds   = 0.0;
+    std::vector<std::pair<std::string, std::string>> failures;     // input, error message
+    // Incremental runs only: inputs whose sorted output did not change, and the differences
+    // of the others to their previous output
+    size_t   unchanged = 0;
+    std::vector<std::pair<std::string, PlaylistDiff>> changes;
+
+    double filesPerSecond() const {
+        return seconds > 0 ? static_cast<double>(succeeded + failed) / seconds : 0.0;
+    }
+
+    double megabytesPerSecond() const {
+        return seconds > 0 ? static_cast<double>(bytes_in) / 1e6 / seconds : 0.0;
+    }
+};
+
+/**
+ * @brief Runs fetch/read -> parse -> sort -> write jobs for many playlists concurrently.
+ *
+ * Every input is a coroutine that moves through the stages instead of holding a thread:
+ * URLs are awaited on one AsyncFetcher event loop, parsing and sorting run on a CPU
+ * ThreadPool, and files are written on a small pool for blocking I/O, so the network, the
+ * cores and the disk stay busy at the same time. Local paths skip the fetch and are read
+ * through mmap and parsed in place by the view model. Semaphores bound the jobs holding a
+ * playlist in memory and the transfers in flight; all other jobs wait as suspended
+ * coroutine frames. A failing job is recorded in the report and never affects the others.
+ * Output files mirror the input's host and path below the output directory, e.g.
+ * https://cdn.example.com/a/master.m3u8 -> <out>/cdn.example.com/a/master.m3u8.
+ *
+ * Incremental runs compare the sorted playlist with its existing output byte for byte and
+ * rewrite only playlists that changed, so unchanged files (and copies) keep their modification
+ * times. Changed playlists are diffed against the previous version (PlaylistDiff), read from
+ * the output's snapshot where there is one, else parsed again from the output.
+ */
+class BatchRunner {
+public:
+    struct Options {
+        SortSpec              spec = SortSpec::parse(SortSpec::kDefault);
+        std::filesystem::path output_directory = "sorted";
+        size_t                threads = 0;             // parse/sort workers, 0 = one per core
+        size_t                io_threads = 2;          // file writers
+        size_t                max_fetches = 32;        // transfers in flight
+        size_t                max_active = 256;        // playlists fetched, parsed or written at once
+        HLSWriter::Options    writer;                  // e.g. pre-compressed .gz / .br copies
+        bool                  snapshot = false;        // also write a PlaylistSnapshot, <output>.snap
+        bool                  incremental = false;     // diff against existing outputs, rewrite only on change
+        PipelineMetrics*      metrics = nullptr;       // receives one record per input, if set
+    };
+
+    BatchRunner() : BatchRunner(Options()) {}
+
+    explicit BatchRunner(Options options) : options_(std::move(options)) {}
+
+    BatchReport run(const std::vector<std::string>& inputs) {
+        BatchReport report;
+        auto start = std::chrono::steady_clock::now();
+        {
+            Stages stages(options_);
+            TaskGroup jobs;
+            for (const auto& input : inputs) {
+                jobs.spawn(job(input, stages, report));
+            }
+            jobs.wait();
+        }
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return report;
+    }
+
+    /**
+     * @brief Reads a manifest list: one path or URL per line.
+     *
+     * Blank lines and lines starting with '#' are skipped.
+     * @throws std::runtime_error if the manifest cannot be read.
+     */
+    static std::vector<std::string> readManifest(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) throw std::runtime_error("Could not open manifest " + path);
+
+        std::vector<std::string> inputs;
+        std::string line;
+        while (std::getline(in, line)) {
+            std::string_view entry = M3U8Tokenizer::trimLine(line);
+            while (!entry.empty() && (entry.front() == ' ' || entry.front() == '\t')) entry.remove_prefix(1);
+            while (!entry.empty() && (entry.back() == ' ' || entry.back() == '\t')) entry.remove_suffix(1);
+            if (entry.empty() || entry.front() == '#') continue;
+            inputs.emplace_back(entry);
+        }
+        return inputs;
+    }
+
+    static bool isUrl(std::string_view input) {
+        return input.find("://") != std::string_view::npos;
+    }
+
+    // Where the sorted playlist of input is written.
+    std::filesystem::path outputPath(std::string_view input) const {
+        std::filesystem::path relative = HLSUrl::localPath(input);
+        if (relative.empty()) relative = "playlist";
+        return options_.output_directory / relative;
+    }
+
+private:
+    Options options_;
+
+    // Initial arena block of each job, enough for the parse and sort of a typical master
+    static constexpr size_t kArenaBytes = 256 * 1024;
+
+    // Executors and limits shared by the jobs of one run
+    struct Stages {
+        ThreadPool     cpu;
+        ThreadPool     io;
+        AsyncFetcher   fetcher;
+        AsyncSemaphore active;
+        AsyncSemaphore fetches;
+        std::mutex     mutex;              // guards the report and arena_blocks
+        std::vector<std::unique_ptr<std::byte[]>> arena_blocks;     // free first blocks
+
+        explicit Stages(const Options& options)
+            : cpu(options.threads ? ThreadPool(options.threads) : ThreadPool()),
+              io(options.io_threads ? options.io_threads : 1),
+              active(options.max_active),
+              fetches(options.max_fetches) {}
+
+        std::unique_ptr<std::byte[]> takeArenaBlock() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (arena_blocks.empty()) return std::unique_ptr<std::byte[]>(new std::byte[kArenaBytes]);
+            auto block = std::move(arena_blocks.back());
+            arena_blocks.pop_back();
+            return block;
+        }
+
+        void returnArenaBlock(std::unique_ptr<std::byte[]> block) {
+            std::lock_guard<std::mutex> lock(mutex);
+            arena_blocks.push_back(std::move(block));
+        }
+    };
+
+    // One input from start to finish; never throws, failures go to the report.
+    Task<> job(const std::string& input, Stages& stages, BatchReport& report) {
+        PipelineMetrics::Record record;
+        record.source = input;
+        try {
+            std::optional<PlaylistDiff> diff = co_await process(input, stages, record);
+            std::lock_guard<std::mutex> lock(stages.mutex);
+            ++report.succeeded;
+            report.bytes_in  += record.bytes_in;
+            report.bytes_out += record.bytes_out;
+            if (diff && diff->empty()) ++report.unchanged;
+            else if (diff)             report.changes.emplace_back(input, std::move(*diff));
+        } catch (const std::exception& e) {
+            record.ok    = false;
+            record.error = e.what();
+            std::lock_guard<std::mutex> lock(stages.mutex);
+            ++report.failed;
+            report.failures.emplace_back(input, e.what());
+        }
+        if (options_.metrics) options_.metrics->record(std::move(record));
+    }
+
+    /**
+     * @brief Runs the stages of one input, filling in the byte counts and stage timings of record.
+     * @return In incremental runs, the differences to the previous output, if there is one.
+     */
+    Task<std::optional<PlaylistDiff>> process(const std::string& input, Stages& stages, PipelineMetrics::Record& record) {
+        auto active = co_await stages.active.acquire();
+        std::string body;
+        if (isUrl(input)) {
+            auto permit = co_await stages.fetches.acquire();
+            FetchResult result = co_await stages.fetcher.fetch(input);
+            record.transfer = result.transfer;
+            if (!result.ok()) throw std::runtime_error("Fetch failed (" + result.error() + ")");
+            body = std::move(result.body);
+        }
+        co_await schedule(stages.cpu);
+
+        // The parse session allocates from a per-job arena, released in one step when the job
+        // ends, so workers do not contend on malloc. First blocks are recycled across jobs;
+        // larger playlists spill into blocks from the default resource.
+        std::unique_ptr<std::byte[]> arena_block = stages.takeArenaBlock();
+        std::optional<PlaylistDiff> diff;
+        {
+            std::pmr::monotonic_buffer_resource arena(arena_block.get(), kArenaBytes);
+            M3U8ViewParser parser(&arena);
+            parser.collectTimings(options_.metrics != nullptr);
+            PipelineMetrics::Stopwatch stopwatch;
+            if (isUrl(input)) {
+                record.bytes_in = body.size();
+                parser.parse(std::move(body));
+            } else {
+                auto file = std::make_shared<MappedFile>(input);
+                record.bytes_in = file->size();
+                parser.parse(file->view(), file);
+            }
+            record.parse_ns      = stopwatch.elapsedNanos();
+            record.parse_timings = parser.timings();
+            record.elements      = {parser.select<ParserType::STREAM>().elements().size(),
+                                    parser.select<ParserType::AUDIO>().elements().size(),
+                                    parser.select<ParserType::IFRAME>().elements().size()};
+
+            stopwatch.restart();
+            options_.spec.apply(parser);
+            record.sort_ns = stopwatch.elapsedNanos();
+
+            HLSWriter writer(outputPath(input).string(), options_.writer);
+            if (options_.incremental) diff = compareWithPrevious(writer.getFileName(), parser, arena);
+
+            if (!diff || !diff->empty() || !outputsExist(writer)) {
+                // Writing is blocking file I/O, so it moves to the I/O pool and frees the CPU worker
+                co_await schedule(stages.io);
+                std::filesystem::create_directories(std::filesystem::path(writer.getFileName()).parent_path());
+                stopwatch.restart();
+                writer.write(parser);
+                if (options_.snapshot) HLSWriter::writeFile(writer.getFileName() + ".snap", SnapshotBuilder(parser));
+                record.write_ns  = stopwatch.elapsedNanos();
+                record.bytes_out = parser.serializedSize();
+            }
+        }
+        stages.returnArenaBlock(std::move(arena_block));
+        co_return diff;
+    }
+
+    /**
+     * @brief Compares the sorted parser with the previous output at path.
+     *
+     * Identical bytes give an empty diff without further work. Otherwise the previous version
+     * is taken from the output's snapshot, if snapshots are on and it was written after the
+     * output and reproduces its size (i.e. both come from the same run), else from parsing
+     * the output again.
+     * @return std::nullopt if there is no readable previous output.
+     */
+    std::optional<PlaylistDiff> compareWithPrevious(const std::string& path, const M3U8ViewParser& parser,
+                                                    std::pmr::memory_resource& arena) const {
+        std::shared_ptr<MappedFile> file;
+        try {
+            file = std::make_shared<MappedFile>(path);
+        } catch (const std::runtime_error&) {
+            return std::nullopt;
+        }
+        if (serializesTo(parser, file->view())) return PlaylistDiff();
+
+        std::optional<PlaylistDiff> diff;
+        try {
+            std::error_code error;
+            const std::string snapshot_path = path + ".snap";
+            const auto snapshot_time = std::filesystem::last_write_time(snapshot_path, error);
+            if (options_.snapshot && !error && snapshot_time >= std::filesystem::last_write_time(path, error) && !error) {
+                try {
+                    PlaylistSnapshot previous = PlaylistSnapshot::open(snapshot_path);
+                    if (previous.serializedSize() == file->size()) diff = PlaylistDiff::compare(previous, parser);
+                } catch (const std::runtime_error&) {
+                    // Unreadable or invalid snapshot, fall back to the output
+                }
+            }
+            if (!diff) {
+                M3U8ViewParser previous(&arena);
+                previous.parse(file->view(), file);
+                diff = PlaylistDiff::compare(previous, parser);
+            }
+        } catch (const std::exception&) {
+            return std::nullopt;        // e.g. the output was edited into an invalid playlist
+        }
+        if (diff->empty()) diff->reordered = true;      // same elements and order, different bytes (e.g. line endings)
+        return diff;
+    }
+
+    // Whether parser serializes to exactly bytes.
+    static bool serializesTo(const M3U8ViewParser& parser, std::string_view bytes) {
+        bool same = true;
+        parser.serialize([&same, &bytes](std::string_view piece) {
+            if (!same) return;
+            same = bytes.starts_with(piece);
+            if (same) bytes.remove_prefix(piece.size());
+        });
+        return same && bytes.empty();
+    }
+
+    // Whether every file a write produces is there, i.e. skipping the write leaves nothing missing.
+    bool outputsExist(const HLSWriter& writer) const {
+        std::error_code error;
+        auto exists = [&error](const std::string& path) { return std::filesystem::exists(path, error); };
+        if (!exists(writer.getFileName())) return false;
+        if (options_.snapshot && !exists(writer.getFileName() + ".snap")) return false;
+        for (Encoding encoding : options_.writer.precompressed) {
+            if (!exists(writer.getFileName() + std::string(CompressionSink::extension(encoding)))) return false;
+        }
+        return true;
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_BATCHRUNNER_H
@@ -0,0 +1,39 @@
+//
+// Process-wide libcurl initialization
+//
+
+#ifndef HLS_FETCH_AND_SORT_CURLGLOBAL_H
+#define HLS_FETCH_AND_SORT_CURLGLOBAL_H
+
+#include <curl/curl.h>
+#include <stdexcept>
+
+/**
+ * @brief Initializes the global libcurl environment exactly once per process.
+ *
+ * curl_global_init() is expensive and not thread-safe, so it must not run per fetcher.
+ * Every component creating curl handles calls ensureInitialized() first; the function-local
+ * static makes the first call thread-safe, and curl_global_cleanup() runs at process exit.
+ */
+class CurlGlobal {
+public:
+    static void ensureInitialized() {
+        static CurlGlobal instance;
+    }
+
+    CurlGlobal(const CurlGlobal&) = delete;
+    CurlGlobal& operator=(const CurlGlobal&) = delete;
+
+private:
+    CurlGlobal() {
+        if (curl_global_init(CURL_GLOBAL_ALL) != CURLE_OK) {
+            throw std::runtime_error("Failed to initialize the global CURL environment");
+        }
+    }
+
+    ~CurlGlobal() {
+        curl_global_cleanup();
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_CURLGLOBAL_H
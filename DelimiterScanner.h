@@ -0,0 +1,255 @@
+//
+// Vectorized scanning for the structural characters of playlists
+//
+
+#ifndef HLS_FETCH_AND_SORT_DELIMITERSCANNER_H
+#define HLS_FETCH_AND_SORT_DELIMITERSCANNER_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define HLS_SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Positions of the structural characters in one block of up to 64 bytes.
+ *
+ * Bit i of a mask is set if byte i of the block is that character; bits past the end of a
+ * short block are clear.
+ */
+struct DelimiterMasks {
+    uint64_t newline = 0;   // '\n'
+    uint64_t hash    = 0;   // '#'
+    uint64_t comma   = 0;   // ','
+    uint64_t equals  = 0;   // '='
+    uint64_t quote   = 0;   // '"'
+
+    bool operator==(const DelimiterMasks&) const = default;
+};
+
+/**
+ * @brief Finds '\n', '#', ',', '=' and '"' 64 bytes at a time.
+ *
+ * One kernel per instruction set computes the DelimiterMasks of consecutive blocks: AVX-512BW
+ * (one 64-byte compare per character), AVX2 (two 32-byte compares), SSE4.2 (four 16-byte
+ * compares) and a portable scalar loop. The kernels are compiled with per-function target
+ * attributes, so the binary needs no -m flags; the best one the CPU supports is picked at
+ * run time. A call covers a window of up to kWindowBlocks blocks, which keeps the indirect
+ * call off the per-block path. Kernels never read past the end of the input.
+ */
+class DelimiterScanner {
+public:
+    static constexpr size_t kBlockSize    = 64;
+    static constexpr size_t kWindowBlocks = 4;
+
+    enum class Kernel { SCALAR, SSE42, AVX2, AVX512 };
+    static constexpr std::array<Kernel, 4> kKernels = {Kernel::SCALAR, Kernel::SSE42, Kernel::AVX2, Kernel::AVX512};
+
+    // Fills masks for the blocks of the first min(size, 256) bytes at data; returns their number.
+    using Function = size_t (*)(const char* data, size_t size, DelimiterMasks* masks);
+
+    // Masks of the first min(size, 64) bytes at data, computed by the active kernel.
+    static DelimiterMasks scan(const char* data, size_t size) {
+        return scan(data, size, activeKernel());
+    }
+
+    // Masks computed by a specific kernel, which must be supported().
+    static DelimiterMasks scan(const char* data, size_t size, Kernel kernel) {
+        return scan(data, size, function(kernel));
+    }
+
+    static bool supported(Kernel kernel) {
+#ifdef HLS_SCANNER_X86
+        switch (kernel) {
+            case Kernel::SCALAR: return true;
+            case Kernel::SSE42:  return __builtin_cpu_supports("sse4.2");
+            case Kernel::AVX2:   return __builtin_cpu_supports("avx2");
+            case Kernel::AVX512: return __builtin_cpu_supports("avx512bw");
+        }
+        return false;
+#else
+        return kernel == Kernel::SCALAR;
+#endif
+    }
+
+    // Fastest kernel of this CPU.
+    static Kernel best() {
+        for (auto it = kKernels.rbegin(); it != kKernels.rend(); ++it) {
+            if (supported(*it)) return *it;
+        }
+        return Kernel::SCALAR;
+    }
+
+    // Kernel scan(data, size) and M3U8Tokenizer use.
+    static Kernel active() { return kernelOf(activeKernel()); }
+
+    // Switches to kernel, e.g. to compare kernels end to end. Ignored if unsupported.
+    static void use(Kernel kernel) {
+        if (supported(kernel)) activeFunction().store(function(kernel), std::memory_order_relaxed);
+    }
+
+    // Window function of the active kernel, for callers scanning many blocks in a row.
+    static Function activeKernel() { return activeFunction().load(std::memory_order_relaxed); }
+
+    static Function function(Kernel kernel) {
+        switch (kernel) {
+#ifdef HLS_SCANNER_X86
+            case Kernel::SSE42:  return &windowSse42;
+            case Kernel::AVX2:   return &windowAvx2;
+            case Kernel::AVX512: return &windowAvx512;
+#endif
+            default:             return &windowScalar;
+        }
+    }
+
+    static constexpr std::string_view name(Kernel kernel) {
+        constexpr std::array<std::string_view, 4> names = {"scalar", "sse4.2", "avx2", "avx512bw"};
+        return names[static_cast<size_t>(kernel)];
+    }
+
+private:
+    static std::atomic<Function>& activeFunction() {
+        static std::atomic<Function> active{function(best())};
+        return active;
+    }
+
+    static Kernel kernelOf(Function f) {
+        for (Kernel kernel : kKernels) {
+            if (function(kernel) == f) return kernel;
+        }
+        return Kernel::SCALAR;
+    }
+
+    static DelimiterMasks scan(const char* data, size_t size, Function window) {
+        DelimiterMasks masks[kWindowBlocks];
+        return window(data, size < kBlockSize ? size : kBlockSize, masks) ? masks[0] : DelimiterMasks();
+    }
+
+    static DelimiterMasks blockScalar(const char* data, size_t size) {
+        DelimiterMasks masks;
+        size = size < kBlockSize ? size : kBlockSize;
+        for (size_t i = 0; i < size; ++i) {
+            const uint64_t bit = uint64_t(1) << i;
+            switch (data[i]) {
+                case '\n': masks.newline |= bit; break;
+                case '#':  masks.hash    |= bit; break;
+                case ',':  masks.comma   |= bit; break;
+                case '=':  masks.equals  |= bit; break;
+                case '"':  masks.quote   |= bit; break;
+                default:   break;
+            }
+        }
+        return masks;
+    }
+
+    static size_t windowScalar(const char* data, size_t size, DelimiterMasks* masks) {
+        size_t blocks = 0;
+        for (; blocks < kWindowBlocks && blocks * kBlockSize < size; ++blocks) {
+            masks[blocks] = blockScalar(data + blocks * kBlockSize, size - blocks * kBlockSize);
+        }
+        return blocks;
+    }
+
+#ifdef HLS_SCANNER_X86
+    // Full 64-byte block at data, or a copy of a short block padded with zero bytes
+    struct Block {
+        alignas(64) char padded[kBlockSize];
+        const char* data;
+
+        Block(const char* source, size_t size) : data(source) {
+            if (size < kBlockSize) {
+                std::memset(padded, 0, kBlockSize);
+                std::memcpy(padded, source, size);
+                data = padded;
+            }
+        }
+    };
+
+    __attribute__((target("sse4.2")))
+    static uint64_t matchSse42(__m128i bytes, char c, int lane) {
+        const int bits = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)));
+        return uint64_t(static_cast<uint16_t>(bits)) << (lane * 16);
+    }
+
+    __attribute__((target("sse4.2")))
+    static DelimiterMasks blockSse42(const char* data, size_t size) {
+        Block block(data, size);
+        DelimiterMasks masks;
+        for (int lane = 0; lane < 4; ++lane) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block.data + lane * 16));
+            masks.newline |= matchSse42(bytes, '\n', lane);
+            masks.hash    |= matchSse42(bytes, '#', lane);
+            masks.comma   |= matchSse42(bytes, ',', lane);
+            masks.equals  |= matchSse42(bytes, '=', lane);
+            masks.quote   |= matchSse42(bytes, '"', lane);
+        }
+        return masks;
+    }
+
+    __attribute__((target("sse4.2")))
+    static size_t windowSse42(const char* data, size_t size, DelimiterMasks* masks) {
+        size_t blocks = 0;
+        for (; blocks < kWindowBlocks && blocks * kBlockSize < size; ++blocks) {
+            masks[blocks] = blockSse42(data + blocks * kBlockSize, size - blocks * kBlockSize);
+        }
+        return blocks;
+    }
+
+    __attribute__((target("avx2")))
+    static uint64_t matchAvx2(__m256i low, __m256i high, char c) {
+        const __m256i needle = _mm256_set1_epi8(c);
+        const uint32_t lo = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, needle)));
+        const uint32_t hi = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, needle)));
+        return (uint64_t(hi) << 32) | lo;
+    }
+
+    __attribute__((target("avx2")))
+    static DelimiterMasks blockAvx2(const char* data, size_t size) {
+        Block block(data, size);
+        const __m256i low  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block.data));
+        const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block.data + 32));
+        return {matchAvx2(low, high, '\n'), matchAvx2(low, high, '#'), matchAvx2(low, high, ','),
+                matchAvx2(low, high, '='), matchAvx2(low, high, '"')};
+    }
+
+    __attribute__((target("avx2")))
+    static size_t windowAvx2(const char* data, size_t size, DelimiterMasks* masks) {
+        size_t blocks = 0;
+        for (; blocks < kWindowBlocks && blocks * kBlockSize < size; ++blocks) {
+            masks[blocks] = blockAvx2(data + blocks * kBlockSize, size - blocks * kBlockSize);
+        }
+        return blocks;
+    }
+
+    __attribute__((target("avx512f,avx512bw")))
+    static uint64_t matchAvx512(__m512i bytes, __mmask64 valid, char c) {
+        return static_cast<uint64_t>(_mm512_mask_cmpeq_epi8_mask(valid, bytes, _mm512_set1_epi8(c)));
+    }
+
+    __attribute__((target("avx512f,avx512bw")))
+    static DelimiterMasks blockAvx512(const char* data, size_t size) {
+        // A masked load reads no byte past size, so short blocks need no copy
+        const __mmask64 valid = size >= kBlockSize ? ~__mmask64(0) : (__mmask64(1) << size) - 1;
+        const __m512i bytes = _mm512_maskz_loadu_epi8(valid, data);
+        return {matchAvx512(bytes, valid, '\n'), matchAvx512(bytes, valid, '#'), matchAvx512(bytes, valid, ','),
+                matchAvx512(bytes, valid, '='), matchAvx512(bytes, valid, '"')};
+    }
+
+    __attribute__((target("avx512f,avx512bw")))
+    static size_t windowAvx512(const char* data, size_t size, DelimiterMasks* masks) {
+        size_t blocks = 0;
+        for (; blocks < kWindowBlocks && blocks * kBlockSize < size; ++blocks) {
+            masks[blocks] = blockAvx512(data + blocks * kBlockSize, size - blocks * kBlockSize);
+        }
+        return blocks;
+    }
+#endif
+};
+
+#endif //HLS_FETCH_AND_SORT_DELIMITERSCANNER_H
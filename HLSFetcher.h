@@ -5,7 +5,14 @@
 #define HLS_FETCH_AND_SORT_FETCH_H
 
 #include <curl/curl.h>
+#include <cctype>
+#include <exception>
+#include <iostream>
+#include <functional>
 #include <string>
+#include <string_view>
+#include "CurlGlobal.h"
+#include "TransferMetrics.h"
 
 // Callback function to handle data received from curl
 size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* userp) {
@@ -20,15 +27,147 @@ size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* use
 }
 
 class HLSFetcher {
+public:
+    // Receives the response body piece by piece, as it arrives from the network.
+    using ChunkHandler = std::function<void(std::string_view chunk)>;
+
+    // Caching related headers of a response
+    struct ResponseHeaders {
+        std::string etag;
+        std::string last_modified;
+        std::string cache_control;
+    };
+
 private:
     std::string url_;
     CURL* curl_;
     std::string response_data_;
 
+    long            status_code_ = 0;
+    TransferMetrics transfer_metrics_;      // of the last fetch
+    ResponseHeaders response_headers_;      // of the last 200 response
+    ResponseHeaders received_headers_;      // of the response in progress
+    std::string     if_none_match_;         // conditional request validators
+    std::string     if_modified_since_;
+
+    // Records the caching headers of the response; a new status line (e.g. after a
+    // redirect) starts over.
+    static size_t HeaderCallback(char* buffer, size_t size, size_t nitems, void* userp) {
+        auto* headers = static_cast<ResponseHeaders*>(userp);
+        size_t totalSize = size * nitems;
+        std::string_view line(buffer, totalSize);
+
+        if (line.compare(0, 5, "HTTP/") == 0) {
+            *headers = ResponseHeaders();
+            return totalSize;
+        }
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) return totalSize;
+
+        auto equalsIgnoreCase = [](std::string_view a, std::string_view b) {
+            if (a.size() != b.size()) return false;
+            for (size_t i = 0; i < a.size(); ++i) {
+                if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) return false;
+            }
+            return true;
+        };
+        std::string_view name  = line.substr(0, colon);
+        std::string_view value = line.substr(colon + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+        while (!value.empty() && (value.back() == '\r' || value.back() == '\n' || value.back() == ' ')) value.remove_suffix(1);
+
+        if (equalsIgnoreCase(name, "ETag"))               headers->etag = value;
+        else if (equalsIgnoreCase(name, "Last-Modified")) headers->last_modified = value;
+        else if (equalsIgnoreCase(name, "Cache-Control")) headers->cache_control = value;
+        return totalSize;
+    }
+
+    // Context of a streaming fetch, handed to StreamCallback
+    struct StreamState {
+        CURL*               curl;
+        const ChunkHandler* on_chunk;
+        std::exception_ptr  error;
+    };
+
+    // Forwards received data to the chunk handler. Exceptions must not unwind through
+    // libcurl, so they are stored and the transfer is aborted by reporting 0 bytes.
+    static size_t StreamCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+        auto* state = static_cast<StreamState*>(userp);
+        size_t totalSize = size * nmemb;
+
+        long http_code = 0;
+        curl_easy_getinfo(state->curl, CURLINFO_RESPONSE_CODE, &http_code);
+        if (http_code != 200) return totalSize;     // drop error pages
+
+        try {
+            (*state->on_chunk)(std::string_view(static_cast<const char*>(contents), totalSize));
+        } catch (...) {
+            state->error = std::current_exception();
+            return 0;
+        }
+        return totalSize;
+    }
+
+    // Performs the request with the write callback already configured.
+    bool perform() {
+        // Set URL
+        curl_easy_setopt(curl_, CURLOPT_URL, url_.c_str());
+
+        // Follow redirects, HTTP(S) only: URLs may come from clients of PlaylistServer
+        curl_easy_setopt(curl_, CURLOPT_PROTOCOLS_STR, "http,https");
+        curl_easy_setopt(curl_, CURLOPT_REDIR_PROTOCOLS_STR, "http,https");
+        curl_easy_setopt(curl_, CURLOPT_FOLLOWLOCATION, 1L);
+
+        // Set timeout (10 seconds)
+        curl_easy_setopt(curl_, CURLOPT_TIMEOUT, 10L);
+
+        // Offer every encoding curl can decode (gzip, deflate, br, zstd); the body is
+        // decompressed as it streams in, so the write callback always sees playlist text
+        curl_easy_setopt(curl_, CURLOPT_ACCEPT_ENCODING, "");
+
+        // Capture caching headers, send conditional request headers
+        received_headers_ = ResponseHeaders();
+        curl_easy_setopt(curl_, CURLOPT_HEADERFUNCTION, HeaderCallback);
+        curl_easy_setopt(curl_, CURLOPT_HEADERDATA, &received_headers_);
+
+        curl_slist* request_headers = nullptr;
+        if (!if_none_match_.empty()) {
+            request_headers = curl_slist_append(request_headers, ("If-None-Match: " + if_none_match_).c_str());
+        }
+        if (!if_modified_since_.empty()) {
+            request_headers = curl_slist_append(request_headers, ("If-Modified-Since: " + if_modified_since_).c_str());
+        }
+        curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, request_headers);
+
+        // Perform the request
+        CURLcode res = curl_easy_perform(curl_);
+
+        curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, nullptr);
+        curl_slist_free_all(request_headers);
+        transfer_metrics_ = TransferMetrics::collect(curl_);
+
+        status_code_ = 0;
+        if (res != CURLE_OK) {
+            std::cerr << "Failed to fetch playlist: "
+                      << curl_easy_strerror(res) << std::endl;
+            return false;
+        }
+
+        curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &status_code_);
+
+        if (status_code_ == 200) {
+            response_headers_ = std::move(received_headers_);
+        } else if (status_code_ == 304 && !received_headers_.cache_control.empty()) {
+            // A 304 may refresh the freshness lifetime, validators stay the same
+            response_headers_.cache_control = std::move(received_headers_.cache_control);
+        }
+        return status_code_ == 200;
+    }
+
 public:
     explicit HLSFetcher(const std::string& url) : url_(url) {
-        // Initialize global curl environment
-        curl_global_init(CURL_GLOBAL_ALL);
+        // Initialize global curl environment (once per process)
+        CurlGlobal::ensureInitialized();
 
         curl_ = curl_easy_init();
         if (!curl_) {
@@ -40,8 +179,6 @@ public:
         if (curl_) {
             curl_easy_cleanup(curl_);
         }
-        // Cleanup global curl environment
-        curl_global_cleanup();
     }
 
     bool fetch() {
@@ -50,37 +187,82 @@ public:
         // Reset response data
         response_data_.clear();
 
-        // Set URL
-        curl_easy_setopt(curl_, CURLOPT_URL, url_.c_str());
-
         // Set callback function
         curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, WriteCallback);
         curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &response_data_);
 
-        // Follow redirects
-        curl_easy_setopt(curl_, CURLOPT_FOLLOWLOCATION, 1L);
-
-        // Set timeout (10 seconds)
-        curl_easy_setopt(curl_, CURLOPT_TIMEOUT, 10L);
-
-        // Perform the request
-        CURLcode res = curl_easy_perform(curl_);
+        return perform();
+    }
 
-        if (res != CURLE_OK) {
-            std::cerr << "Failed to fetch playlist: "
-                      << curl_easy_strerror(res) << std::endl;
-            return false;
-        }
+    /**
+     * @brief Fetches the URL, streaming the body to on_chunk instead of buffering it.
+     *
+     * Chunks are delivered from inside the transfer, so consumers such as
+     * M3U8Parser::feed() run while the rest of the body is still downloading. Only the
+     * body of a 200 response is delivered. An exception thrown by on_chunk aborts the
+     * transfer and is rethrown from fetch().
+     *
+     * @return true if the transfer completed with HTTP status 200.
+     */
+    bool fetch(const ChunkHandler& on_chunk) {
+        if (!curl_) return false;
 
-        long http_code = 0;
-        curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &http_code);
+        StreamState state{curl_, &on_chunk, nullptr};
+        curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, StreamCallback);
+        curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &state);
 
-        return http_code == 200;
+        bool ok = perform();
+        if (state.error) std::rethrow_exception(state.error);
+        return ok;
     }
 
     const std::string& getResponse() const {
         return response_data_;
     }
+
+    // HTTP status of the last fetch, 0 if the transfer itself failed.
+    long getStatusCode() const {
+        return status_code_;
+    }
+
+    // DNS/connect/TLS/first byte/total timings and size of the last fetch.
+    const TransferMetrics& getTransferMetrics() const {
+        return transfer_metrics_;
+    }
+
+    // true if the last fetch was a conditional request answered with 304 Not Modified.
+    bool notModified() const {
+        return status_code_ == 304;
+    }
+
+    // ETag, Last-Modified and Cache-Control of the last successful (200) response.
+    const ResponseHeaders& getResponseHeaders() const {
+        return response_headers_;
+    }
+
+    /**
+     * @brief Makes subsequent fetches conditional (If-None-Match / If-Modified-Since).
+     *
+     * Pass the validators of a previous response, e.g. getResponseHeaders(). Empty values
+     * are not sent. An unchanged resource then yields fetch() == false and notModified().
+     */
+    void setValidators(const std::string& etag, const std::string& last_modified) {
+        if_none_match_     = etag;
+        if_modified_since_ = last_modified;
+    }
+
+    void setUrl(const std::string& url) {
+        url_ = url;
+    }
+
+    const std::string& getUrl() const {
+        return url_;
+    }
+
+    // Moves the response body out of the fetcher, e.g. to hand it to an M3U8ViewParser.
+    std::string takeResponse() {
+        return std::move(response_data_);
+    }
 };
 
 
@@ -0,0 +1,249 @@
+/*
+ *   Module responsible for fetching many playlists concurrently
+ */
+#ifndef HLS_FETCH_AND_SORT_HLSFETCHERPOOL_H
+#define HLS_FETCH_AND_SORT_HLSFETCHERPOOL_H
+
+#include <curl/curl.h>
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "CurlGlobal.h"
+#include "TransferMetrics.h"
+
+// Outcome of a single fetch performed by HLSFetcherPool
+struct FetchResult {
+    size_t          index = 0;         // position of the URL in the submitted batch
+    std::string     url;
+    long            http_code = 0;
+    CURLcode        curl_code = CURLE_OK;
+    std::string     body;
+    TransferMetrics transfer;          // phase timings of the transfer
+
+    bool ok() const { return curl_code == CURLE_OK && http_code == 200; }
+
+    std::string error() const {
+        if (curl_code != CURLE_OK) return curl_easy_strerror(curl_code);
+        if (http_code != 200) return "HTTP status " + std::to_string(http_code);
+        return "";
+    }
+};
+
+/**
+ * @brief Fetches batches of playlists concurrently over warm, shared connections.
+ *
+ * The pool drives its transfers with a single curl multi handle, so a batch costs no
+ * threads. All easy handles share one CURLSH for the DNS cache, TLS sessions and the
+ * connection cache, and HTTP/2 multiplexing is enabled so requests to the same CDN host
+ * are pipelined on existing connections instead of paying a handshake each. Easy handles
+ * are recycled across batches.
+ *
+ * A pool instance must be driven from one thread at a time.
+ *
+ * Example:
+ *
+ *     HLSFetcherPool pool({.max_concurrency = 32});
+ *     pool.fetchAll(urls, [](FetchResult&& result) {
+ *         if (result.ok()) process(result.url, result.body);
+ *     });
+ */
+class HLSFetcherPool {
+public:
+    struct Options {
+        size_t max_concurrency      = 16;     // transfers in flight at once
+        long   max_host_connections = 0;      // connections per host, 0 = unlimited
+        long   timeout_seconds      = 10;
+        bool   http2                = true;   // negotiate HTTP/2 and multiplex requests
+    };
+
+    // Invoked for every URL of a batch, in completion order.
+    using CompletionHandler = std::function<void(FetchResult&& result)>;
+
+    HLSFetcherPool() : HLSFetcherPool(Options()) {}
+
+    explicit HLSFetcherPool(Options options) : options_(options) {
+        if (options_.max_concurrency == 0) {
+            throw std::invalid_argument("HLSFetcherPool requires a concurrency of at least 1");
+        }
+        CurlGlobal::ensureInitialized();
+
+        share_ = curl_share_init();
+        multi_ = curl_multi_init();
+        if (!share_ || !multi_) {
+            cleanup();
+            throw std::runtime_error("Failed to initialize CURL multi/share handles");
+        }
+
+        curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, LockCallback);
+        curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, UnlockCallback);
+        curl_share_setopt(share_, CURLSHOPT_USERDATA, &share_locks_);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+        curl_multi_setopt(multi_, CURLMOPT_PIPELINING, options_.http2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+        curl_multi_setopt(multi_, CURLMOPT_MAX_HOST_CONNECTIONS, options_.max_host_connections);
+    }
+
+    ~HLSFetcherPool() {
+        cleanup();
+    }
+
+    HLSFetcherPool(const HLSFetcherPool&) = delete;
+    HLSFetcherPool& operator=(const HLSFetcherPool&) = delete;
+
+    /**
+     * @brief Fetches all URLs, keeping at most max_concurrency transfers in flight.
+     *
+     * on_done is called as soon as each transfer finishes, so the caller can start parsing
+     * early results while later ones are still downloading. Returns once every URL has
+     * been reported. Failures are reported through FetchResult, never thrown.
+     */
+    void fetchAll(const std::vector<std::string>& urls, const CompletionHandler& on_done) {
+        size_t next = 0;
+
+        try {
+            while (next < urls.size() || !active_.empty()) {
+                while (active_.size() < options_.max_concurrency && next < urls.size()) {
+                    start(next, urls[next]);
+                    ++next;
+                }
+
+                int running = 0;
+                curl_multi_perform(multi_, &running);
+
+                int queued = 0;
+                while (CURLMsg* msg = curl_multi_info_read(multi_, &queued)) {
+                    if (msg->msg != CURLMSG_DONE) continue;
+                    on_done(complete(msg->easy_handle, msg->data.result));
+                }
+
+                if (!active_.empty()) {
+                    curl_multi_poll(multi_, nullptr, 0, 1000, nullptr);
+                }
+            }
+        } catch (...) {
+            // Abandon the rest of the batch but keep the handles reusable
+            while (!active_.empty()) {
+                complete(active_.back()->easy, CURLE_ABORTED_BY_CALLBACK);
+            }
+            throw;
+        }
+    }
+
+    // Convenience overload collecting all results, in the order of urls.
+    std::vector<FetchResult> fetchAll(const std::vector<std::string>& urls) {
+        std::vector<FetchResult> results(urls.size());
+        fetchAll(urls, [&results](FetchResult&& result) {
+            size_t index = result.index;
+            results[index] = std::move(result);
+        });
+        return results;
+    }
+
+    // The share handle, for components that want to reuse the pool's caches.
+    CURLSH* share() const { return share_; }
+
+private:
+    Options options_;
+    CURLM*  multi_ = nullptr;
+    CURLSH* share_ = nullptr;
+    std::array<std::mutex, CURL_LOCK_DATA_LAST> share_locks_;
+
+    // Per-transfer state, reachable from the easy handle through CURLOPT_PRIVATE
+    struct Transfer {
+        CURL*       easy = nullptr;
+        FetchResult result;
+    };
+    std::vector<std::unique_ptr<Transfer>> active_;     // added to the multi handle
+    std::vector<std::unique_ptr<Transfer>> idle_;       // ready for reuse
+
+    static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+        size_t totalSize = size * nmemb;
+        static_cast<std::string*>(userp)->append(static_cast<const char*>(contents), totalSize);
+        return totalSize;
+    }
+
+    static void LockCallback(CURL*, curl_lock_data data, curl_lock_access, void* userp) {
+        (*static_cast<std::array<std::mutex, CURL_LOCK_DATA_LAST>*>(userp))[data].lock();
+    }
+
+    static void UnlockCallback(CURL*, curl_lock_data data, void* userp) {
+        (*static_cast<std::array<std::mutex, CURL_LOCK_DATA_LAST>*>(userp))[data].unlock();
+    }
+
+    // Configures a (recycled) easy handle for url and adds it to the multi handle.
+    void start(size_t index, const std::string& url) {
+        std::unique_ptr<Transfer> transfer;
+        if (idle_.empty()) {
+            transfer = std::make_unique<Transfer>();
+            transfer->easy = curl_easy_init();
+            if (!transfer->easy) throw std::runtime_error("Failed to initialize CURL");
+        } else {
+            transfer = std::move(idle_.back());
+            idle_.pop_back();
+            curl_easy_reset(transfer->easy);
+        }
+
+        transfer->result = FetchResult{};
+        transfer->result.index = index;
+        transfer->result.url   = url;
+
+        CURL* easy = transfer->easy;
+        curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, WriteCallback);
+        curl_easy_setopt(easy, CURLOPT_WRITEDATA, &transfer->result.body);
+        curl_easy_setopt(easy, CURLOPT_PROTOCOLS_STR, "http,https");         // no file://, ftp://, ...
+        curl_easy_setopt(easy, CURLOPT_REDIR_PROTOCOLS_STR, "http,https");
+        curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(easy, CURLOPT_ACCEPT_ENCODING, "");      // any encoding curl decodes
+        curl_easy_setopt(easy, CURLOPT_TIMEOUT, options_.timeout_seconds);
+        curl_easy_setopt(easy, CURLOPT_SHARE, share_);
+        if (options_.http2) {
+            curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+            // Prefer waiting for a multiplexable connection over opening a new one
+            curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+        }
+        curl_easy_setopt(easy, CURLOPT_PRIVATE, transfer.get());
+
+        curl_multi_add_handle(multi_, easy);
+        active_.emplace_back(std::move(transfer));
+    }
+
+    // Detaches a finished transfer, recycles its handle and returns its result.
+    FetchResult complete(CURL* easy, CURLcode code) {
+        Transfer* raw = nullptr;
+        curl_easy_getinfo(easy, CURLINFO_PRIVATE, &raw);
+        auto it = std::find_if(active_.begin(), active_.end(),
+                               [raw](const auto& transfer) { return transfer.get() == raw; });
+        std::unique_ptr<Transfer> transfer = std::move(*it);
+        active_.erase(it);
+
+        curl_multi_remove_handle(multi_, easy);
+        transfer->result.curl_code = code;
+        curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &transfer->result.http_code);
+        transfer->result.transfer = TransferMetrics::collect(easy);
+
+        FetchResult result = std::move(transfer->result);
+        idle_.emplace_back(std::move(transfer));
+        return result;
+    }
+
+    void cleanup() {
+        for (auto& transfer : idle_) {
+            curl_easy_cleanup(transfer->easy);
+        }
+        idle_.clear();
+        if (multi_) curl_multi_cleanup(multi_);
+        if (share_) curl_share_cleanup(share_);
+        multi_ = nullptr;
+        share_ = nullptr;
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_HLSFETCHERPOOL_H
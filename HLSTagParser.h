@@ -5,10 +5,23 @@
 #ifndef HLS_FETCH_AND_SORT_HLSTAGPARSER_H
 #define HLS_FETCH_AND_SORT_HLSTAGPARSER_H
 
+#include <algorithm>
+#include <array>
+#include <compare>
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <stdexcept>
 #include <string>
-#include <regex>
-#include <sstream>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
+#include "AttributeDictionary.h"
+#include "AttributeList.h"
+#include "M3U8Tokenizer.h"
+#include "RenditionIndex.h"
 
 /**
  * @brief Abstract base class for parsing HLS tags.
@@ -16,6 +29,10 @@
  * This class defines the common interface that all HLS tag parsers must implement.
  * It declares methods for parsing content and sorting parsed elements based on various
  * attributes. Derived classes are expected to provide concrete implementations.
+ *
+ * Parsers are line driven: the owner tokenizes the playlist once and hands each line whose
+ * tag matches tag() to parseLine(), along with any URI lines that follow it. This lets
+ * M3U8Parser feed all sub-parsers from a single pass over the input.
  */
 class HLSTagParser{
 public:
@@ -30,29 +47,108 @@ public:
         AUDIO, CLOSED_CAPTIONS, TYPE,
         ID, NAME, LANGUAGE, DEFAULT_, AUTOSELECT, CHANNELS
     };
+    static constexpr size_t kSortAttributeCount = static_cast<size_t>(SortAttribute::CHANNELS) + 1;
+
+    enum class SortOrder { ASCENDING, DESCENDING };
+
+    // One key of a lexicographic sort. Converts implicitly from a SortAttribute (ascending).
+    struct SortKey {
+        SortAttribute attribute;
+        SortOrder     order;
+
+        constexpr SortKey(SortAttribute attr, SortOrder ord = SortOrder::ASCENDING) : attribute(attr), order(ord) {}
+    };
+
+    // How sortByKeys() orders the elements; both engines are stable and produce the same order.
+    enum class SortEngine {
+        COMPARISON,     // std::stable_sort over the elements
+        RADIX,          // LSD radix sort over packed (key, index) pairs, then one permutation pass
+        AUTO            // RADIX from kRadixSortThreshold elements on, COMPARISON below
+    };
+    static constexpr size_t kRadixSortThreshold = 512;
+
+    static constexpr SortKey ascending(SortAttribute attr)  { return {attr, SortOrder::ASCENDING}; }
+    static constexpr SortKey descending(SortAttribute attr) { return {attr, SortOrder::DESCENDING}; }
+
+    // Name of the attribute as used in messages, e.g. "AVERAGE_BANDWIDTH"
+    static constexpr std::string_view attributeName(SortAttribute attr) {
+        constexpr std::array<std::string_view, kSortAttributeCount> names = {
+            "BANDWIDTH", "AVERAGE_BANDWIDTH", "CODECS", "RESOLUTION", "FRAME_RATE", "VIDEO_RANGE",
+            "AUDIO", "CLOSED_CAPTIONS", "TYPE",
+            "ID", "NAME", "LANGUAGE", "DEFAULT", "AUTOSELECT", "CHANNELS"
+        };
+        return names[static_cast<size_t>(attr)];
+    }
+
     virtual ~HLSTagParser() = default;
-    virtual void parse(const std::string& content) = 0;
-    virtual void sortByAttribute(SortAttribute attr) = 0;
-    virtual void sortByAttribute(SortAttribute attr1, SortAttribute attr2) = 0;
 
-protected:
+    // The tag this parser handles, e.g. "#EXT-X-STREAM-INF"
+    virtual std::string_view tag() const = 0;
+
+    // Consumes one line: either a line carrying tag(), or a URI line following one.
+    virtual void parseLine(std::string_view line) = 0;
+
+    // Called once all lines were consumed. Parsers may validate their results here.
+    virtual void finish() {}
+
     /**
-     * @brief Extracts the value of an attribute from a given line.
+     * @brief Parses a complete playlist with this parser alone.
      *
-     * This static helper function uses a regular expression to locate and extract an attribute's
-     * value from the provided line. It supports both quoted and unquoted values.
+     * Convenience for using a sub-parser standalone; M3U8Parser dispatches lines itself
+     * instead of calling this for each of its sub-parsers.
+     */
+    virtual void parse(const std::string& content) {
+        M3U8Tokenizer::forEachLine(content, [this](std::string_view line) {
+            if (line.empty()) return;
+            if (line[0] != '#' || M3U8Tokenizer::tagName(line) == tag()) parseLine(line);
+        });
+        finish();
+    }
+
+    /**
+     * @brief Sorts the parsed elements lexicographically by keys.
      *
-     * @param line The line from which to extract the attribute.
-     * @param attr The attribute key to search for.
-     * @return The extracted attribute value, or an empty string if the attribute is not found.
+     * Elements are ordered by the first key; ties fall through to the next key. Elements that
+     * compare equal on every key keep their playlist order, whichever engine runs, so the
+     * output does not depend on the playlist size crossing kRadixSortThreshold.
+     * @throws std::invalid_argument if a key names an attribute this parser cannot sort by.
      */
-    static std::string extractAttribute(const std::string& line, const std::string& attr) {
-        std::regex pattern(attr + "=(?:\"([^\"]*)\"|([^,\\s]*))");
-        std::smatch matches;
-        if (std::regex_search(line, matches, pattern)) {
-            return matches[1].str().empty() ? matches[2].str() : matches[1].str();
-        }
-        return "";
+    virtual void sortByKeys(std::span<const SortKey> keys, SortEngine engine = SortEngine::AUTO) = 0;
+
+    // Whether elements of this parser can be sorted by attr.
+    virtual bool supports(SortAttribute attr) const = 0;
+
+    void sortByAttribute(SortAttribute attr) {
+        const SortKey keys[] = {attr};
+        sortByKeys(keys);
+    }
+
+    void sortByAttribute(SortAttribute primary, SortAttribute secondary) {
+        const SortKey keys[] = {primary, secondary};
+        sortByKeys(keys);
+    }
+};
+
+/**
+ * @brief Binds a sort attribute to the element member it compares.
+ *
+ * Parsers list one projection per sortable attribute in a SortProjections tuple; the sorter
+ * turns that list into a compile-time comparator table, so every comparison is a direct,
+ * inlinable member comparison instead of a type-erased call.
+ */
+template<HLSTagParser::SortAttribute Attr, auto Member>
+struct SortProjection {
+    static constexpr HLSTagParser::SortAttribute attribute = Attr;
+    static constexpr auto                        member    = Member;
+
+    template<typename Element>
+    static const auto& get(const Element& element) { return element.*Member; }
+
+    // Three-way comparison of the projected member: negative, zero or positive.
+    template<typename Element>
+    static int compare(const Element& a, const Element& b) {
+        auto order = get(a) <=> get(b);
+        return (order < 0) ? -1 : (order > 0) ? 1 : 0;
     }
 };
 
@@ -60,10 +156,26 @@ protected:
  * @brief CRTP-based helper class template for sorting HLS tags.
  *
  * This template uses the Curiously Recurring Template Pattern (CRTP) to provide a generic
- * implementation of sorting methods based on one or two attributes. The derived class must
+ * implementation of sorting methods based on any number of attributes. The derived class must
  * provide:
- *   - A getContainer() method returning a container (e.g., std::vector) of elements.
- *   - A getComparisons() method returning a mapping from SortAttribute to a comparator.
+ *   - A getContainer() method returning a std::pmr::vector of elements. Scratch space of a
+ *     sort is drawn from the same memory resource.
+ *   - A public SortProjections type: a std::tuple of SortProjection, one per sortable attribute.
+ *
+ *   - A queryKeys(element) method returning the element's RenditionKeys, which find(),
+ *     highest() and lowest() answer queries on.
+ *
+ * Low-cardinality string attributes are stored as AttributeId; once Derived renumbers them
+ * with orderInterned(), comparing ids compares the interned values.
+ *
+ * The primary key is dispatched at compile time, so its comparator is inlined into the sort;
+ * further keys are only consulted on ties, through the compile-time comparator table.
+ *
+ * For large element sets the radix engine avoids comparing (and swapping) wide structs
+ * altogether: every key is reduced to an order-preserving 32-bit rank (biased integers,
+ * AttributeIds as is, interned ranks for strings, bitwise NOT for descending keys), the ranks are packed with
+ * the element index into 64-bit words and LSD radix sorted, one key at a time starting with
+ * the least significant. The elements are then moved into place in a single pass.
  *
  * @tparam Derived  The derived class that implements the specific HLS tag parser.
  * @tparam Element  The type of element contained in the parser's container.
@@ -71,46 +183,241 @@ protected:
 template<typename Derived, typename Element>
 class HLSTagParserSorter : public HLSTagParser {
 public:
-    /* Retrieves the container and the associated comparator for the specified attribute,
-       then applies std::sort to arrange the elements.  */
-    void sortByAttribute(SortAttribute attr) override {
-        // Cast 'this' to the derived class to access its specific methods
-        Derived* derived  = static_cast<Derived*>(this);
-        auto& container   = derived->getContainer();
-        auto& comparisons = derived->getComparisons();
-        // Use the comparison functor corresponding to attr
-        std::sort(container.begin(), container.end(), comparisons.at(attr));
-    }
-
-    /* First, the primary comparator is used. If two elements are deemed equal (i.e., neither is
-    * strictly less than the other with respect to the primary attribute), the secondary comparator
-    * is then used to determine the order.  */
-    void sortByAttribute(SortAttribute primary, SortAttribute secondary) override {
-        Derived* derived  = static_cast<Derived*>(this);
-        auto& container   = derived->getContainer();
-        auto& comparisons = derived->getComparisons();
-
-        // Retrieve comparators for the primary and secondary attributes.
-        auto primary_comp   = comparisons.at(primary);
-        auto secondary_comp = comparisons.at(secondary);
-
-        // Sort using a lambda that applies the primary comparator and falls back to the secondary if needed.
-        std::sort(container.begin(), container.end(),
-                  [primary_comp, secondary_comp]
-                  (const Element& a, const Element& b) {
-                        // Get comparison result for primary attribute
-                        bool primary_a_less_b = primary_comp(a, b);
-                        bool primary_b_less_a = primary_comp(b, a);
-
-                         // if primary attributes doesn't determine order, use secondary attribute
-                         if (!primary_a_less_b && !primary_b_less_a) {
-                             return secondary_comp(a, b);
-                         }
-
-                         // Otherwise, use primary attribute's ordering
-                         return primary_a_less_b;
-                  }
-        );
+    void sortByKeys(std::span<const SortKey> keys, SortEngine engine = SortEngine::AUTO) override {
+        if (keys.empty()) return;
+
+        auto& container = static_cast<Derived*>(this)->getContainer();
+        index_.invalidate();
+
+        // Resolve every key up front, so unsupported attributes fail before anything moves
+        const auto resolved = resolveKeys(keys, container.get_allocator().resource());
+        const std::span<const ResolvedKey> tie_breakers = std::span(resolved).subspan(1);
+
+        if (engine == SortEngine::RADIX ||
+            (engine == SortEngine::AUTO && container.size() >= kRadixSortThreshold)) {
+            radixSort(container, keys);
+            return;
+        }
+
+        const bool primary_descending = keys[0].order == SortOrder::DESCENDING;
+
+        visitProjection(keys[0].attribute, [&]<typename Primary>() {
+            auto less = [&](const Element& a, const Element& b) {
+                int order = Primary::compare(a, b);
+                if (order != 0) return primary_descending ? order > 0 : order < 0;
+                for (const ResolvedKey& key : tie_breakers) {
+                    order = key.compare(a, b);
+                    if (order != 0) return key.descending ? order > 0 : order < 0;
+                }
+                return false;
+            };
+            std::stable_sort(container.begin(), container.end(), less);
+        });
+    }
+
+    bool supports(SortAttribute attr) const override {
+        return comparator(attr) != nullptr;
+    }
+
+    /**
+     * @brief Elements matching query, in container order.
+     *
+     * Queries are answered from secondary indexes (see RenditionIndex) built by the first
+     * query and kept until the elements change. Like sorting, querying must not run
+     * concurrently on one parser.
+     */
+    std::pmr::vector<const Element*> find(const RenditionQuery& query) {
+        auto& container = static_cast<Derived*>(this)->getContainer();
+        std::pmr::memory_resource* resource = container.get_allocator().resource();
+        std::pmr::vector<const Element*> result(resource);
+        for (uint32_t position : index_.find(container, query, keysOf(), resource)) {
+            result.push_back(&container[position]);
+        }
+        return result;
+    }
+
+    // Matching element with the highest BANDWIDTH, nullptr if none
+    const Element* highest(const RenditionQuery& query) { return extreme(query, true); }
+
+    // Matching element with the lowest BANDWIDTH, nullptr if none
+    const Element* lowest(const RenditionQuery& query) { return extreme(query, false); }
+
+protected:
+    /**
+     * @brief Renumbers dictionary in value order and rewrites every AttributeId member named
+     * in SortProjections to match. Derived calls this from finish(), before sorting.
+     */
+    template<typename Dictionary>
+    void orderInterned(Dictionary& dictionary) {
+        index_.invalidate();
+        if (dictionary.ordered()) return;
+        const auto remap = dictionary.order();
+
+        auto& container = static_cast<Derived*>(this)->getContainer();
+        [&]<typename... P>(std::type_identity<std::tuple<P...>>) {
+            ([&] {
+                using Value = std::remove_cvref_t<decltype(std::declval<Element&>().*P::member)>;
+                if constexpr (std::is_same_v<Value, AttributeId>) {
+                    for (Element& element : container) {
+                        AttributeId& id = element.*P::member;
+                        id = remap[static_cast<uint32_t>(id)];
+                    }
+                }
+            }(), ...);
+        }(std::type_identity<typename Derived::SortProjections>());
+    }
+
+private:
+    using CompareFunc = int (*)(const Element&, const Element&);
+
+    RenditionIndex<Element> index_;
+
+    auto keysOf() const {
+        return [this](const Element& element) { return static_cast<const Derived*>(this)->queryKeys(element); };
+    }
+
+    const Element* extreme(const RenditionQuery& query, bool highest) {
+        auto& container = static_cast<Derived*>(this)->getContainer();
+        auto position = index_.extreme(container, query, keysOf(), highest, container.get_allocator().resource());
+        return position ? &container[*position] : nullptr;
+    }
+
+    // Comparator per SortAttribute, nullptr where Derived has no projection
+    static constexpr std::array<CompareFunc, kSortAttributeCount> makeComparatorTable() {
+        std::array<CompareFunc, kSortAttributeCount> table{};
+        [&table]<typename... P>(std::type_identity<std::tuple<P...>>) {
+            ((table[static_cast<size_t>(P::attribute)] = &P::template compare<Element>), ...);
+        }(std::type_identity<typename Derived::SortProjections>());
+        return table;
+    }
+
+    static CompareFunc comparator(SortAttribute attr) {
+        static constexpr auto table = makeComparatorTable();
+        return table[static_cast<size_t>(attr)];
+    }
+
+    struct ResolvedKey {
+        CompareFunc compare;
+        bool        descending;
+    };
+
+    // Comparator and direction of every key.
+    // @throws std::invalid_argument if a key names an attribute Derived cannot sort by.
+    std::pmr::vector<ResolvedKey> resolveKeys(std::span<const SortKey> keys, std::pmr::memory_resource* resource) const {
+        std::pmr::vector<ResolvedKey> resolved(resource);
+        resolved.reserve(keys.size());
+        for (const SortKey& key : keys) {
+            CompareFunc compare = comparator(key.attribute);
+            if (!compare) {
+                throw std::invalid_argument("Cannot sort " + std::string(tag()) + " by " +
+                                            std::string(attributeName(key.attribute)));
+            }
+            resolved.push_back({compare, key.order == SortOrder::DESCENDING});
+        }
+        return resolved;
+    }
+
+    // Moves the elements into the order of positions, in one pass.
+    template<typename Container>
+    static void permute(Container& container, std::span<const uint32_t> order) {
+        Container sorted(container.get_allocator());      // swapping requires equal allocators
+        sorted.reserve(container.size());
+        for (uint32_t index : order) sorted.push_back(std::move(container[index]));
+        container.swap(sorted);
+    }
+
+    /*  Radix engine */
+
+    // Order-preserving 32-bit rank of each element's projected member, complemented for descending keys.
+    template<typename Projection, typename Container>
+    static void computeRanks(const Container& elements, bool descending, std::pmr::vector<uint32_t>& ranks) {
+        using Value = std::remove_cvref_t<decltype(Projection::get(elements.front()))>;
+        const uint32_t mask = descending ? ~uint32_t(0) : 0;
+        ranks.resize(elements.size());
+
+        if constexpr (std::is_same_v<Value, AttributeId>) {
+            // Ordered ids are ranks already
+            for (size_t i = 0; i < elements.size(); ++i) {
+                ranks[i] = static_cast<uint32_t>(Projection::get(elements[i])) ^ mask;
+            }
+        } else if constexpr (std::is_integral_v<Value>) {
+            static_assert(sizeof(Value) <= sizeof(uint32_t), "Radix keys are 32 bits wide");
+            // Flip the sign bit so negative values order before positive ones
+            constexpr uint32_t bias = std::is_signed_v<Value> ? 0x80000000u : 0;
+            for (size_t i = 0; i < elements.size(); ++i) {
+                ranks[i] = (static_cast<uint32_t>(Projection::get(elements[i])) ^ bias) ^ mask;
+            }
+        } else {
+            // Intern the (typically few) distinct strings and rank them in sorted order
+            std::pmr::unordered_map<std::string_view, uint32_t> interned(ranks.get_allocator());
+            for (const auto& element : elements) {
+                interned.emplace(std::string_view(Projection::get(element)), 0);
+            }
+            std::pmr::vector<std::string_view> distinct(ranks.get_allocator());
+            distinct.reserve(interned.size());
+            for (const auto& entry : interned) distinct.push_back(entry.first);
+            std::sort(distinct.begin(), distinct.end());
+            for (uint32_t rank = 0; rank < distinct.size(); ++rank) interned[distinct[rank]] = rank;
+
+            for (size_t i = 0; i < elements.size(); ++i) {
+                ranks[i] = interned.find(std::string_view(Projection::get(elements[i])))->second ^ mask;
+            }
+        }
+    }
+
+    // Stable LSD radix sort of (rank << 32 | index) words on their upper 32 bits, 8 bits per pass.
+    static void radixSortPacked(std::pmr::vector<uint64_t>& packed, std::pmr::vector<uint64_t>& scratch) {
+        scratch.resize(packed.size());
+        for (int shift = 32; shift < 64; shift += 8) {
+            std::array<size_t, 256> counts{};
+            for (uint64_t word : packed) ++counts[(word >> shift) & 0xFF];
+            // A pass where every word lands in one bucket would not move anything
+            if (counts[(packed.front() >> shift) & 0xFF] == packed.size()) continue;
+
+            size_t offset = 0;
+            for (size_t& count : counts) {
+                size_t bucket = count;
+                count = offset;
+                offset += bucket;
+            }
+            for (uint64_t word : packed) scratch[counts[(word >> shift) & 0xFF]++] = word;
+            packed.swap(scratch);
+        }
+    }
+
+    template<typename Container>
+    static void radixSort(Container& container, std::span<const SortKey> keys) {
+        const size_t size = container.size();
+        if (size < 2) return;
+        if (size > UINT32_MAX) throw std::length_error("Too many elements for the radix sort engine");
+
+        std::pmr::memory_resource* resource = container.get_allocator().resource();
+        std::pmr::vector<uint32_t> order(size, resource);     // current permutation, refined key by key
+        for (uint32_t i = 0; i < size; ++i) order[i] = i;
+
+        std::pmr::vector<uint32_t> ranks(resource);
+        std::pmr::vector<uint64_t> packed(size, resource), scratch(resource);
+        for (size_t k = keys.size(); k-- > 0;) {
+            const bool descending = keys[k].order == SortOrder::DESCENDING;
+            visitProjection(keys[k].attribute, [&]<typename Projection>() {
+                computeRanks<Projection>(container, descending, ranks);
+            });
+            for (size_t i = 0; i < size; ++i) {
+                packed[i] = (uint64_t(ranks[order[i]]) << 32) | order[i];
+            }
+            radixSortPacked(packed, scratch);
+            for (size_t i = 0; i < size; ++i) order[i] = static_cast<uint32_t>(packed[i]);
+        }
+
+        permute(container, order);     // once
+    }
+
+    // Invokes visitor.template operator()<P>() for the projection P of attr.
+    template<typename Visitor>
+    static void visitProjection(SortAttribute attr, Visitor&& visitor) {
+        [&]<typename... P>(std::type_identity<std::tuple<P...>>) {
+            ((P::attribute == attr ? (visitor.template operator()<P>(), true) : false) || ...);
+        }(std::type_identity<typename Derived::SortProjections>());
     }
 };
 
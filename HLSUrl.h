@@ -0,0 +1,74 @@
+//
+// URL helpers for following playlist references
+//
+
+#ifndef HLS_FETCH_AND_SORT_HLSURL_H
+#define HLS_FETCH_AND_SORT_HLSURL_H
+
+#include <cctype>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+class HLSUrl {
+public:
+    /**
+     * @brief Resolves a URI found in a playlist against the URL of that playlist.
+     *
+     * Handles the forms used by HLS playlists: absolute URLs ("https://..."), host-relative
+     * paths ("/path/vod.m3u8") and paths relative to the playlist ("1650k/vod.m3u8").
+     * Query strings and fragments of the base are dropped; dot segments are kept as is.
+     */
+    static std::string resolve(std::string_view base, std::string_view reference) {
+        if (reference.find("://") != std::string_view::npos) return std::string(reference);
+
+        size_t scheme_end = base.find("://");
+        size_t authority  = scheme_end == std::string_view::npos ? 0 : scheme_end + 3;
+        size_t path_start = base.find('/', authority);
+        if (path_start == std::string_view::npos) path_start = base.size();
+
+        if (!reference.empty() && reference[0] == '/') {
+            return std::string(base.substr(0, path_start)).append(reference);
+        }
+
+        std::string_view path = base.substr(0, base.find_first_of("?#", path_start));
+        size_t last_slash = path.rfind('/');
+        if (last_slash == std::string_view::npos || last_slash < path_start) {
+            return std::string(path).append("/").append(reference);
+        }
+        return std::string(path.substr(0, last_slash + 1)).append(reference);
+    }
+
+    // true for http:// and https:// URLs, the only schemes the fetchers accept.
+    static bool isHttp(std::string_view url) {
+        auto hasScheme = [url](std::string_view scheme) {
+            if (url.size() < scheme.size()) return false;
+            for (size_t i = 0; i < scheme.size(); ++i) {
+                if (std::tolower(static_cast<unsigned char>(url[i])) != scheme[i]) return false;
+            }
+            return true;
+        };
+        return hasScheme("http://") || hasScheme("https://");
+    }
+
+    /**
+     * @brief Relative local path mirroring a URL's host and path, or a local path itself.
+     *
+     * https://cdn.example.com/a/master.m3u8?token=1 -> cdn.example.com/a/master.m3u8. Root,
+     * "." and ".." segments are dropped, so the result always stays below the directory it
+     * is appended to.
+     */
+    static std::filesystem::path localPath(std::string_view url) {
+        if (size_t scheme_end = url.find("://"); scheme_end != std::string_view::npos) {
+            url.remove_prefix(scheme_end + 3);
+            url = url.substr(0, url.find_first_of("?#"));
+        }
+        std::filesystem::path relative;
+        for (const auto& part : std::filesystem::path(url).lexically_normal().relative_path()) {
+            if (part != ".." && part != "." && !part.empty()) relative /= part;
+        }
+        return relative;
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_HLSURL_H
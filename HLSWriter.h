@@ -1,11 +1,41 @@
 #ifndef HLSWRITER_H
 #define HLSWRITER_H
 
-#include <fstream>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "CompressionSink.h"
+
 // Simple file writer for HLS playlists
+//
+// Files are replaced atomically: the playlist is written to a temporary file next to the
+// target and renamed over it, so readers of the output directory see either the previous
+// or the new playlist, never a partial one. Playlists providing serialize() (M3U8Parser)
+// are written with writev straight from the parser's line storage, without building the
+// output string first; the same path streams to any descriptor (stdout, a pipe, a socket).
+// Optionally every write also leaves pre-compressed copies next to the file (playlist.m3u8.gz,
+// playlist.m3u8.br), replaced atomically as well, for origins that serve them as is.
 class HLSWriter {
+public:
+    struct Options {
+        std::vector<Encoding> precompressed;                 // copies written next to the file
+        int                   level = CompressionSink::kDefaultLevel;   // of every encoding
+    };
+
 private:
     std::string file_name_;
+    Options     options_;
 
     static std::string ensureExtension(const std::string& filename) {
         if (filename.size() < 5 || filename.substr(filename.size() - 5) != ".m3u8") {
@@ -14,14 +44,134 @@ private:
         return filename;
     }
 
+    // Collects byte ranges into an iovec batch and flushes it with writev when full.
+    class GatherWriter {
+    public:
+        explicit GatherWriter(int fd) : fd_(fd) {}
+
+        void operator()(std::string_view piece) {
+            if (piece.empty()) return;
+            if (count_ == kBatchSize) flush();
+            iov_[count_++] = iovec{const_cast<char*>(piece.data()), piece.size()};
+        }
+
+        // Writes the whole batch, resuming after partial writes and interrupts.
+        void flush() {
+            iovec* pending = iov_;
+            size_t remaining = count_;
+            while (remaining > 0) {
+                ssize_t written = ::writev(fd_, pending, static_cast<int>(remaining));
+                if (written < 0) {
+                    if (errno == EINTR) continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {     // non-blocking pipe or socket
+                        pollfd pfd{fd_, POLLOUT, 0};
+                        ::poll(&pfd, 1, -1);
+                        continue;
+                    }
+                    throw std::runtime_error(std::string("Write failed: ") + std::strerror(errno));
+                }
+                auto left = static_cast<size_t>(written);
+                while (remaining > 0 && left >= pending->iov_len) {
+                    left -= pending->iov_len;
+                    ++pending;
+                    --remaining;
+                }
+                if (remaining > 0) {
+                    pending->iov_base = static_cast<char*>(pending->iov_base) + left;
+                    pending->iov_len -= left;
+                }
+            }
+            count_ = 0;
+        }
+
+    private:
+        static constexpr size_t kBatchSize = std::min<size_t>(IOV_MAX, 1024);
+
+        int    fd_;
+        iovec  iov_[kBatchSize];
+        size_t count_ = 0;
+    };
+
+    // Runs emit(int fd) against a temporary file and renames it over file_name on success.
+    template<typename Emitter>
+    static void replaceAtomically(const std::string& file_name, Emitter&& emit) {
+        std::string temp_name = file_name + ".XXXXXX";
+        int fd = ::mkstemp(temp_name.data());
+        if (fd < 0) throw std::runtime_error("Could not open file " + file_name + " for writing");
+
+        try {
+            ::fchmod(fd, 0644);     // mkstemp creates 0600
+            emit(fd);
+            if (::close(fd) != 0) {
+                fd = -1;
+                throw std::runtime_error("Could not write file " + file_name + ": " + std::strerror(errno));
+            }
+            fd = -1;
+            if (::rename(temp_name.c_str(), file_name.c_str()) != 0) {
+                throw std::runtime_error("Could not replace file " + file_name + ": " + std::strerror(errno));
+            }
+        } catch (...) {
+            if (fd >= 0) ::close(fd);
+            ::unlink(temp_name.c_str());
+            throw;
+        }
+    }
+
+    // Writes the pre-compressed copies; emit(sink) hands the playlist to a CompressionSink.
+    template<typename Emitter>
+    void writePrecompressed(Emitter&& emit) {
+        for (Encoding encoding : options_.precompressed) {
+            replaceAtomically(file_name_ + std::string(CompressionSink::extension(encoding)), [&](int fd) {
+                CompressionSink out(fd, encoding, options_.level);
+                emit(out);
+                out.finish();
+            });
+        }
+    }
+
 public:
     explicit HLSWriter(const std::string& filename)
-        : file_name_(ensureExtension(filename)) {}
+        : HLSWriter(filename, Options()) {}
+
+    HLSWriter(const std::string& filename, Options options)
+        : file_name_(ensureExtension(filename)), options_(std::move(options)) {}
+
+    void write(std::string_view content) {
+        replaceAtomically(file_name_, [content](int fd) {
+            GatherWriter out(fd);
+            out(content);
+            out.flush();
+        });
+        writePrecompressed([content](CompressionSink& out) { out(content); });
+    }
+
+    // Writes a playlist providing serialize(sink), gathering its lines with writev.
+    template<typename Playlist>
+        requires requires(const Playlist& playlist, GatherWriter& out) { playlist.serialize(out); }
+    void write(const Playlist& playlist) {
+        replaceAtomically(file_name_, [&playlist](int fd) { writeTo(fd, playlist); });
+        writePrecompressed([&playlist](CompressionSink& out) { playlist.serialize(out); });
+    }
+
+    /**
+     * @brief Streams a playlist to an open descriptor, e.g. STDOUT_FILENO, a pipe or a socket.
+     *
+     * The descriptor is neither closed nor synced. Throws std::runtime_error on write errors.
+     */
+    template<typename Playlist>
+    static void writeTo(int fd, const Playlist& playlist) {
+        GatherWriter out(fd);
+        playlist.serialize(out);
+        out.flush();
+    }
 
-    void write(const std::string& content) {
-        std::ofstream outFile(file_name_, std::ios::out | std::ios::trunc);
-        if (!outFile) throw std::runtime_error("Could not open file " + file_name_ + " for writing");
-        outFile << content;
+    /**
+     * @brief Atomically replaces path, taken as is, with anything providing serialize(sink),
+     * e.g. a SnapshotBuilder.
+     */
+    template<typename Source>
+    static void writeFile(const std::string& path, const Source& source) {
+        replaceAtomically(path, [&source](int fd) { writeTo(fd, source); });
     }
 
     const std::string& getFileName() const {
@@ -0,0 +1,158 @@
+/*
+ *          Module responsible for keeping live media playlists current
+ */
+
+#ifndef HLS_FETCH_AND_SORT_LIVEPLAYLISTREFRESHER_H
+#define HLS_FETCH_AND_SORT_LIVEPLAYLISTREFRESHER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include "HLSFetcher.h"
+#include "MediaPlaylistParser.h"
+
+/**
+ * @brief Reloads a live media playlist and merges the changes into its parsed model.
+ *
+ * Every reload is a conditional GET carrying the ETag and Last-Modified of the previous
+ * response, so an unchanged playlist costs a 304 without a body. Once the server advertises
+ * CAN-SKIP-UNTIL, reloads request delta updates (_HLS_skip=YES), and only segments that are
+ * new since the last load are appended to the model (MediaPlaylistParser::update()).
+ *
+ * Example:
+ *
+ *     LivePlaylistRefresher channel(url);
+ *     while (!channel.finished()) {
+ *         channel.refresh();
+ *         std::this_thread::sleep_for(channel.reloadInterval());
+ *     }
+ */
+class LivePlaylistRefresher {
+public:
+    struct Options {
+        bool request_delta_updates = true;     // use _HLS_skip=YES when the server supports it
+    };
+
+    explicit LivePlaylistRefresher(const std::string& url) : LivePlaylistRefresher(url, Options()) {}
+
+    LivePlaylistRefresher(const std::string& url, Options options)
+        : url_(url), options_(options), fetcher_(url) {}
+
+    /**
+     * @brief Reloads the playlist once.
+     *
+     * @return The number of segments appended to playlist().
+     * @throws std::runtime_error if the playlist could not be fetched or parsed.
+     */
+    size_t refresh() {
+        bool delta = options_.request_delta_updates && !playlist_.segments().empty() && playlist_.canSkipUntil() > 0.0;
+        try {
+            return reload(delta);
+        } catch (const std::runtime_error&) {
+            if (!delta) throw;
+            // The delta could not be applied, e.g. after falling too far behind
+            return reload(false);
+        }
+    }
+
+    /**
+     * @brief Time to wait before the next refresh() (RFC 8216, section 6.3.4).
+     *
+     * The target duration after a reload that changed the playlist, half of it otherwise.
+     */
+    std::chrono::milliseconds reloadInterval() const {
+        std::chrono::milliseconds target(std::max(playlist_.targetDuration(), 1) * 1000);
+        return changed_ ? target : target / 2;
+    }
+
+    // true once the playlist carries #EXT-X-ENDLIST and will not change anymore
+    bool finished() const { return playlist_.hasEndList(); }
+
+    // true if the last refresh() returned new content (as opposed to 304 Not Modified)
+    bool changed() const { return changed_; }
+
+    const std::string& url() const { return url_; }
+    const MediaPlaylistParser& playlist() const { return playlist_; }
+
+    // Timings of the last reload's transfer, its decoded body size, and the time spent merging it
+    const TransferMetrics& lastTransfer() const { return fetcher_.getTransferMetrics(); }
+    uint64_t lastBodyBytes() const { return fetcher_.getResponse().size(); }
+    uint64_t lastUpdateNanos() const { return last_update_ns_; }
+
+    // Called after each successful refresh; returning false stops run().
+    using UpdateHandler = std::function<bool(const LivePlaylistRefresher& channel, size_t new_segments)>;
+
+    /**
+     * @brief Keeps a set of live channels current from the calling thread.
+     *
+     * Each channel is reloaded when its reloadInterval() expires, earliest first. Failed
+     * reloads are reported on stderr and retried after the channel's interval. Returns when
+     * all channels have ended or on_update returns false.
+     */
+    static void run(std::vector<std::unique_ptr<LivePlaylistRefresher>>& channels, const UpdateHandler& on_update) {
+        using Clock = std::chrono::steady_clock;
+        using Due   = std::pair<Clock::time_point, size_t>;
+        std::priority_queue<Due, std::vector<Due>, std::greater<>> schedule;
+        for (size_t i = 0; i < channels.size(); ++i) schedule.emplace(Clock::now(), i);
+
+        while (!schedule.empty()) {
+            auto [due, index] = schedule.top();
+            schedule.pop();
+            std::this_thread::sleep_until(due);
+
+            LivePlaylistRefresher& channel = *channels[index];
+            try {
+                size_t new_segments = channel.refresh();
+                if (!on_update(channel, new_segments)) return;
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to refresh " << channel.url() << ": " << e.what() << std::endl;
+            }
+            if (!channel.finished()) schedule.emplace(Clock::now() + channel.reloadInterval(), index);
+        }
+    }
+
+private:
+    std::string         url_;
+    Options             options_;
+    HLSFetcher          fetcher_;
+    MediaPlaylistParser playlist_;
+    bool                changed_ = true;
+    bool                last_was_delta_ = false;
+    uint64_t            last_update_ns_ = 0;
+
+    size_t reload(bool delta) {
+        std::string url = url_;
+        if (delta) url += (url.find('?') == std::string::npos ? "?" : "&") + std::string("_HLS_skip=YES");
+        fetcher_.setUrl(url);
+
+        // Validators belong to the URL they were received for
+        const auto& headers = fetcher_.getResponseHeaders();
+        if (delta == last_was_delta_) fetcher_.setValidators(headers.etag, headers.last_modified);
+        else                          fetcher_.setValidators("", "");
+
+        if (!fetcher_.fetch()) {
+            if (fetcher_.notModified()) {
+                changed_ = false;
+                last_update_ns_ = 0;
+                return 0;
+            }
+            throw std::runtime_error("HTTP status " + std::to_string(fetcher_.getStatusCode()));
+        }
+        last_was_delta_ = delta;
+        changed_ = true;
+        auto start = std::chrono::steady_clock::now();
+        size_t appended = playlist_.update(fetcher_.getResponse());
+        last_update_ns_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        return appended;
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_LIVEPLAYLISTREFRESHER_H
@@ -5,9 +5,18 @@
 #ifndef HLS_FETCH_AND_SORT_M3U8PARSER_H
 #define HLS_FETCH_AND_SORT_M3U8PARSER_H
 
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <concepts>
+#include <deque>
+#include <memory>
+#include <memory_resource>
+#include <span>
 #include "StreamInfParser.h"
 #include "MediaParser.h"
 #include "iFrameParser.h"
+#include "TagRegistry.h"
 
 /**
  * @brief Enum representing the type of sub-parser available in an M3U8Parser.
@@ -18,10 +27,29 @@ enum class ParserType {
     IFRAME
 };
 
+// Who handles the lines of a registered master playlist tag, see BasicM3U8Parser::kTags
+enum class MasterTagHandler : uint8_t {
+    STREAM, AUDIO, IFRAME,      // the sub-parser of the same ParserType
+    HEADER                      // playlist-wide tag, kept verbatim at the top of the output
+};
+static_assert(static_cast<int>(MasterTagHandler::IFRAME) == static_cast<int>(ParserType::IFRAME));
+
+// Time spent in the sub-parsers, see BasicM3U8Parser::collectTimings()
+struct ParseTimings {
+    std::array<uint64_t, 3> sub_parser_ns{};     // indexed by ParserType
+    size_t                  tag_lines = 0;       // lines dispatched to a sub-parser
+};
+
 // Forward declaration of ParserAccessor helper friend class.
-template <ParserType T>
+template <ParserType T, typename String = std::string>
 class ParserAccessor;
 
+// Lays out a parser's state as a PlaylistSnapshot, see PlaylistSnapshot.h
+class SnapshotBuilder;
+
+// Compares two parsers' states, see PlaylistDiff.h
+class PlaylistDiff;
+
 /**
  * @brief Main class for parsing HLS master playlists.
  *
@@ -29,48 +57,309 @@ class ParserAccessor;
  * The user can access a specific sub-parser via the select() method which returns
  * a ParserAccessor, a lightweight proxy that forwards calls (like sort()) to the
  * appropriate sub-parser.
+ *
+ * @tparam String  Field type of the parsed elements. With std::string (M3U8Parser) every
+ *                 element owns copies of its fields. With std::string_view (M3U8ViewParser)
+ *                 the parser takes ownership of the playlist buffer and all fields are views
+ *                 into it, so parsing does no per-element heap allocations and sorting moves
+ *                 trivially-copyable records.
+ *
+ * Containers (elements, headers, the pending line) and sort scratch space come from the
+ * std::pmr::memory_resource given at construction, so a parse session can run on an arena:
+ *
+ *     std::pmr::monotonic_buffer_resource arena(64 * 1024);
+ *     M3U8ViewParser parser(&arena);        // destroyed before the arena
+ *     parser.parse(file->view(), file);
+ *
+ * Copies use the default resource, so they may outlive the arena; a parser that is assigned
+ * to keeps its own resource. The buffer shared with copies and the owning model's field
+ * strings always live on the heap.
  */
-class M3U8Parser {
+template<typename String>
+class BasicM3U8Parser {
 private:
-    std::vector<std::string> headers_;
-    StreamInfParser  stream_parser_;
-    MediaParser      audio_parser_;
-    iFrameParser     iframe_parser_;
+    static constexpr bool kOwnsFields = !std::is_same_v<String, std::string_view>;
+
+    // Playlist content the fields of a view model point into. Blocks are only ever
+    // appended, so views into them stay valid; copies of the parser share them.
+    std::shared_ptr<std::deque<std::string>> buffer_;
+    std::pmr::vector<std::shared_ptr<const void>> owners_;     // external storage, see parse(content, owner)
+
+    // Line-dispatch state, kept across feed() calls
+    std::pmr::string pending_;         // incomplete last line of the previous chunk
+    int         current_ = -1;         // index of the sub-parser of the most recent tag line
+    bool        first_line_ = true;
+
+    bool         collect_timings_ = false;
+    ParseTimings timings_;
+
+    // Tag and comment lines without a handler of the section (ParserType) they appeared in, each
+    // with the number of that section's elements preceding it. Lines ahead of every section are
+    // headers. A line between a variant's tag line and its URI line is within that slot.
+    struct Passthrough {
+        String   line;
+        uint32_t slot;
+        bool     within;
+    };
+
+    std::pmr::vector<String> headers_;
+    std::array<std::pmr::vector<Passthrough>, 3> passthrough_;
+    BasicStreamInfParser<String>  stream_parser_;
+    BasicMediaParser<String>      audio_parser_;
+    BasicIFrameParser<String>     iframe_parser_;
+
+    // Sub-parsers in dispatch order.
+    std::array<HLSTagParser*, 3> subParsers() {
+        return {&stream_parser_, &audio_parser_, &iframe_parser_};
+    }
 
     // Grant ParserAccessor access to private members.
-    template<ParserType T>
+    template<ParserType T, typename S>
     friend class ParserAccessor;
+    friend class SnapshotBuilder;
+    friend class PlaylistDiff;
 
 public:
+    /**
+     * @brief Tags with a handler. A line is dispatched with one perfect-hash lookup of its tag
+     * name; supporting a new tag takes an entry here (and a sub-parser, if its lines become
+     * sortable elements). #EXT tags without an entry and comments are kept verbatim where they
+     * appeared.
+     */
+    static constexpr auto kTags = makeTagRegistry<MasterTagHandler>({
+        {BasicStreamInfParser<String>::kTag, MasterTagHandler::STREAM},
+        {BasicMediaParser<String>::kTag,     MasterTagHandler::AUDIO},
+        {BasicIFrameParser<String>::kTag,    MasterTagHandler::IFRAME},
+        {"#EXT-X-VERSION",                   MasterTagHandler::HEADER},
+        {"#EXT-X-INDEPENDENT-SEGMENTS",      MasterTagHandler::HEADER},
+        {"#EXT-X-START",                     MasterTagHandler::HEADER},
+        {"#EXT-X-DEFINE",                    MasterTagHandler::HEADER},
+        {"#EXT-X-SESSION-DATA",              MasterTagHandler::HEADER},
+        {"#EXT-X-SESSION-KEY",               MasterTagHandler::HEADER},
+        {"#EXT-X-CONTENT-STEERING",          MasterTagHandler::HEADER},
+    });
+
+    BasicM3U8Parser() : BasicM3U8Parser(std::pmr::get_default_resource()) {}
+
+    // Allocates from resource, which must outlive the parser.
+    explicit BasicM3U8Parser(std::pmr::memory_resource* resource)
+        : owners_(resource), pending_(resource), headers_(resource),
+          passthrough_{std::pmr::vector<Passthrough>(resource), std::pmr::vector<Passthrough>(resource),
+                       std::pmr::vector<Passthrough>(resource)},
+          stream_parser_(resource), audio_parser_(resource), iframe_parser_(resource) {}
+
+    // Resource the parser allocates from
+    std::pmr::memory_resource* resource() const { return headers_.get_allocator().resource(); }
+
     /**
      * @brief Parses the provided M3U8 content.
+     *
+     * The content is tokenized once. Each tag line is dispatched to the sub-parser
+     * registered for its tag, and URI lines go to the sub-parser that handled the
+     * preceding tag, so the cost stays a single pass regardless of the number of
+     * sub-parsers.
+     *
+     * Only available for the owning model, since a view model must not point into
+     * a buffer it does not own.
+     *
      * @param content The full M3U8 file content.
      * @throws std::runtime_error if the file does not start with the expected header.
      */
-    void parse(const std::string& content) {
-        std::istringstream stream(content);
-        std::string line;
+    void parse(const std::string& content) requires kOwnsFields {
+        feed(content);
+        finish();
+    }
 
-        // Verify & acquire header
-        std::getline(stream, line);
-        if (line.find("#EXTM3U") == std::string::npos) {
+    /**
+     * @brief Parses the provided M3U8 content, taking ownership of it.
+     *
+     * The view model keeps the buffer alive for as long as the parser (or any copy of it)
+     * exists, e.g. parser.parse(fetcher.takeResponse()).
+     */
+    void parse(std::string&& content) {
+        if constexpr (kOwnsFields) {
+            feed(content);
+        } else {
+            feedRetained(retain(std::move(content)));
+        }
+        finish();
+    }
+
+    /**
+     * @brief Parses content stored elsewhere, e.g. a memory-mapped file, without copying it.
+     *
+     * The view model keeps owner alive for as long as the parser (or any copy of it) exists,
+     * so its fields can point straight into content. The owning model copies the fields and
+     * does not retain owner.
+     */
+    void parse(std::string_view content, std::shared_ptr<const void> owner) {
+        if constexpr (!kOwnsFields) {
+            owners_.push_back(std::move(owner));
+        }
+        feedRetained(content);
+        finish();
+    }
+
+    /**
+     * @brief Incrementally parses the next chunk of a playlist.
+     *
+     * Chunks may split lines at arbitrary byte positions; an incomplete trailing line is
+     * kept until the chunk completing it arrives. Complete lines are dispatched right away,
+     * so parsing can overlap the transfer, e.g. when fed from HLSFetcher::fetch(ChunkHandler).
+     * The owning model only holds on to the incomplete line, the view model copies each
+     * chunk into its buffer.
+     *
+     * Call finish() after the last chunk.
+     */
+    void feed(std::string_view chunk) {
+        if constexpr (kOwnsFields) {
+            feedRetained(chunk);
+        } else {
+            feedRetained(retain(std::string(chunk)));
+        }
+    }
+
+    /**
+     * @brief Completes a parse started with feed().
+     *
+     * Dispatches a final line lacking a newline and lets every sub-parser validate its results.
+     * @throws std::runtime_error if the playlist was empty or is missing required elements.
+     */
+    void finish() {
+        if (!pending_.empty()) {
+            parseLine(M3U8Tokenizer::trimLine(retainPending()));
+            pending_.clear();
+        }
+        if (first_line_) {
             throw std::runtime_error("Invalid M3U8 file - missing #EXTM3U header");
         }
-        else{
+        for (HLSTagParser* sub_parser : subParsers()) {
+            sub_parser->finish();
+        }
+        current_    = -1;
+        first_line_ = true;
+    }
+
+private:
+    // Moves a block into the view model's buffer and returns a view of its final location.
+    std::string_view retain(std::string&& block) {
+        if (!buffer_) buffer_ = std::make_shared<std::deque<std::string>>();
+        return buffer_->emplace_back(std::move(block));
+    }
+
+    // Returns the completed pending line as a view that outlives the current chunk.
+    std::string_view retainPending() {
+        std::string_view line;
+        if constexpr (kOwnsFields) {
+            line = pending_;                       // fields are copied while parsing the line
+        } else {
+            line = retain(std::string(pending_));
+        }
+        return line;
+    }
+
+    // Splits a chunk whose storage outlives the parse into lines.
+    void feedRetained(std::string_view chunk) {
+        size_t pos = 0;
+        if (!pending_.empty()) {
+            size_t eol = chunk.find('\n');
+            if (eol == std::string_view::npos) {
+                pending_.append(chunk);
+                return;
+            }
+            pending_.append(chunk.substr(0, eol));
+            parseLine(M3U8Tokenizer::trimLine(retainPending()));
+            pending_.clear();
+            pos = eol + 1;
+        }
+
+        size_t last_eol = chunk.rfind('\n');
+        if (last_eol == std::string_view::npos || last_eol < pos) {
+            pending_.assign(chunk.substr(pos));
+            return;
+        }
+        M3U8Tokenizer::forEachLine(chunk.substr(pos, last_eol - pos),
+                                   [this](std::string_view line) { parseLine(line); });
+        pending_.assign(chunk.substr(last_eol + 1));
+    }
+
+    // Hands a line to the sub-parser at index, timing it if requested.
+    void dispatch(size_t index, std::string_view line) {
+        HLSTagParser* sub_parser = subParsers()[index];
+        if (!collect_timings_) {
+            sub_parser->parseLine(line);
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        sub_parser->parseLine(line);
+        timings_.sub_parser_ns[index] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        ++timings_.tag_lines;
+    }
+
+    // Dispatches a single line to the header list or the sub-parser owning its tag.
+    void parseLine(std::string_view line) {
+        // Verify & acquire header
+        if (first_line_) {
+            if (line.find("#EXTM3U") == std::string_view::npos) {
+                throw std::runtime_error("Invalid M3U8 file - missing #EXTM3U header");
+            }
+            headers_.emplace_back(line);
+            first_line_ = false;
+            return;
+        }
+        if (line.empty()) return;
+
+        if (line[0] != '#') {
+            if (current_ >= 0) dispatch(current_, line);
+            return;
+        }
+
+        std::string_view tag = M3U8Tokenizer::tagName(line);
+        const MasterTagHandler* handler = kTags.find(tag);
+        if (!handler) {
+            keepInPlace(line);
+            return;
+        }
+        if (*handler == MasterTagHandler::HEADER) {
             headers_.emplace_back(line);
+            return;
         }
+        dispatch(static_cast<size_t>(*handler), line);
+        current_ = static_cast<int>(*handler);
+    }
 
-        std::getline(stream, line);
-        if (line.find("#EXT-X-INDEPENDENT-SEGMENTS") != std::string::npos) {
+    // Keeps a line without handler after the elements of the current section parsed so far, or
+    // within the variant whose tag line was parsed and whose URI line is still to come.
+    void keepInPlace(std::string_view line) {
+        if (current_ < 0) {
             headers_.emplace_back(line);
+            return;
         }
+        const bool within = current_ == static_cast<int>(ParserType::STREAM) && stream_parser_.expectingUri();
+        passthrough_[current_].push_back({String(line), static_cast<uint32_t>(elementCount(current_)), within});
+    }
 
-        // Parse content using sub-parsers
-        stream_parser_.parse(content);
-        audio_parser_.parse(content);
-        iframe_parser_.parse(content);
+    size_t elementCount(int section) const {
+        switch (static_cast<ParserType>(section)) {
+            case ParserType::STREAM: return stream_parser_.variants_.size();
+            case ParserType::AUDIO:  return audio_parser_.audio_tracks_.size();
+            case ParserType::IFRAME: return iframe_parser_.iframes_.size();
+        }
+        return 0;
     }
 
+public:
+    /**
+     * @brief Enables per-sub-parser timing of subsequent parsing.
+     *
+     * Off by default: it costs two clock reads per dispatched line.
+     */
+    void collectTimings(bool enabled) { collect_timings_ = enabled; }
+
+    // Accumulated sub-parser timings since collectTimings(true).
+    const ParseTimings& timings() const { return timings_; }
+
     /**
      * @brief Provides access to a specific sub-parser.
      *
@@ -84,8 +373,22 @@ public:
      * @return ParserAccessor<T> proxy object for the chosen sub-parser.
      */
     template<ParserType T>
-    ParserAccessor<T> select(){
-        return ParserAccessor<T>(*this);
+    ParserAccessor<T, String> select(){
+        return ParserAccessor<T, String>(*this);
+    }
+
+    /**
+     * @brief I-frame stream matching a variant: the highest-bandwidth one whose codecs are
+     * all among the variant's, with the variant's VIDEO-RANGE and at most its height.
+     * @return nullptr if no I-frame stream matches.
+     */
+    const BasicIFrame<String>* iFrameFor(const BasicVideoStreamVariant<String>& variant) {
+        const auto& dictionary = stream_parser_.dictionary();
+        RenditionQuery query;
+        query.codecs      = dictionary.value(variant.codecs);
+        query.video_range = dictionary.value(variant.video_range);
+        if (variant.resolution_height > 0) query.max_height = variant.resolution_height;
+        return iframe_parser_.highest(query);
     }
 
     /*
@@ -108,29 +411,74 @@ public:
         iframe_parser_.sortByAttribute(primary, secondary);  }
     */
 
-    std::string stringify() const {
-        std::string manifest;
+    /**
+     * @brief Emits the serialized playlist as a sequence of byte ranges.
+     *
+     * sink(std::string_view piece) is called for every line and line terminator, in output
+     * order. The pieces point into the parser's own storage, so a sink can gather them (e.g.
+     * into an iovec list) without copying; they stay valid until the parser is modified.
+     *
+     * Tags without a handler and comments are emitted byte for byte at their position: ahead
+     * of every section they are headers, otherwise they follow as many (possibly sorted)
+     * elements of their section as preceded them in the playlist. Lines that stood between a
+     * variant's tag line and its URI line stay between those of the variant in that slot.
+     */
+    template<typename Sink>
+    void serialize(Sink&& sink) const {
+        constexpr std::string_view newline = "\n";
+        auto line = [&sink](std::string_view text) {
+            sink(text);
+            sink(newline);
+        };
+        auto section = [&line](const auto& elements, const auto& passthrough, auto&& emit) {
+            auto next = passthrough.begin();
+            for (uint32_t slot = 0; slot < elements.size(); ++slot) {
+                for (; next != passthrough.end() && (next->slot < slot || (next->slot == slot && !next->within));
+                     ++next) line(next->line);
+                emit(elements[slot], [&] {
+                    for (; next != passthrough.end() && next->slot == slot && next->within; ++next) line(next->line);
+                });
+            }
+            for (; next != passthrough.end(); ++next) line(next->line);
+        };
         for (const auto &header: headers_) {
-            manifest += header + "\n";
-        }
-        manifest += "\n";
-        for (const auto &variant: stream_parser_.variants_) {
-            manifest += variant.manifest_line + "\n";
-            manifest += variant.uri + "\n";
+            line(header);
         }
-        manifest += "\n";
-        for (const auto &track: audio_parser_.audio_tracks_) {
-            manifest += track.manifest_line + "\n";
-        }
-        manifest += "\n";
-        for (const auto &iframe: iframe_parser_.iframes_) {
-            manifest += iframe.manifest_line + "\n";
-        }
-        manifest += "\n";
+        sink(newline);
+        section(stream_parser_.variants_, passthrough_[0], [&line](const auto& variant, auto&& within) {
+            line(variant.manifest_line);
+            within();
+            line(variant.uri);
+        });
+        sink(newline);
+        section(audio_parser_.audio_tracks_, passthrough_[1], [&line](const auto& track, auto&&) {
+            line(track.manifest_line);
+        });
+        sink(newline);
+        section(iframe_parser_.iframes_, passthrough_[2], [&line](const auto& iframe, auto&&) {
+            line(iframe.manifest_line);
+        });
+        sink(newline);
+    }
+
+    // Exact size in bytes of the serialized playlist.
+    size_t serializedSize() const {
+        size_t size = 0;
+        serialize([&size](std::string_view piece) { size += piece.size(); });
+        return size;
+    }
+
+    std::string stringify() const {
+        std::string manifest;
+        manifest.reserve(serializedSize());
+        serialize([&manifest](std::string_view piece) { manifest.append(piece); });
         return manifest;
     }
 };
 
+using M3U8Parser     = BasicM3U8Parser<std::string>;
+using M3U8ViewParser = BasicM3U8Parser<std::string_view>;
+
 
 /**
  * @brief Proxy class to access and control a specific sub-parser within M3U8Parser.
@@ -139,12 +487,13 @@ public:
  * (stream, audio, or iFrame). It forwards operations (e.g., sort) to the
  * underlying sub-parser.
  *
- * @tparam T The type of sub-parser to access.
+ * @tparam T      The type of sub-parser to access.
+ * @tparam String Field type of the parser's model (see BasicM3U8Parser).
  */
-template<ParserType T>
+template<ParserType T, typename String>
 class ParserAccessor {
 private:
-    M3U8Parser& parser_;
+    BasicM3U8Parser<String>& parser_;
 
     // Returns a reference to the correct sub-parser based on the template parameter.
     auto& getParser() const {
@@ -154,15 +503,76 @@ private:
     }
 public:
     //  Construct a ParserAccessor for the specified M3U8Parser instance.
-    explicit ParserAccessor(M3U8Parser& parser) : parser_(parser) {}
+    explicit ParserAccessor(BasicM3U8Parser<String>& parser) : parser_(parser) {}
+
+    /**
+     * @brief Sorts the sub-parser's elements lexicographically by one or more keys.
+     *
+     * Keys are SortAttributes (ascending) or HLSTagParser::SortKeys, e.g.
+     *
+     *     acc.sort(SortAttribute::RESOLUTION, HLSTagParser::descending(SortAttribute::BANDWIDTH));
+     *
+     * @throws std::invalid_argument if the sub-parser cannot sort by one of the keys.
+     */
+    template<typename... Keys>
+        requires (sizeof...(Keys) > 0 && (std::convertible_to<Keys, HLSTagParser::SortKey> && ...))
+    void sort(Keys... keys) {
+        const std::array<HLSTagParser::SortKey, sizeof...(Keys)> list = {HLSTagParser::SortKey(keys)...};
+        getParser().sortByKeys(list);
+    }
+
+    // sort() with keys only known at run time, e.g. parsed from a SortSpec.
+    void sort(std::span<const HLSTagParser::SortKey> keys,
+              HLSTagParser::SortEngine engine = HLSTagParser::SortEngine::AUTO) {
+        getParser().sortByKeys(keys, engine);
+    }
+
+    // sort() with an explicit engine, e.g. sort(HLSTagParser::SortEngine::RADIX, SortAttribute::BANDWIDTH).
+    template<typename... Keys>
+        requires (sizeof...(Keys) > 0 && (std::convertible_to<Keys, HLSTagParser::SortKey> && ...))
+    void sort(HLSTagParser::SortEngine engine, Keys... keys) {
+        const std::array<HLSTagParser::SortKey, sizeof...(Keys)> list = {HLSTagParser::SortKey(keys)...};
+        getParser().sortByKeys(list, engine);
+    }
+
+    // Same as sort(), which keeps elements equal on every key in their relative order; for
+    // callers that rely on that.
+    template<typename... Keys>
+        requires (sizeof...(Keys) > 0 && (std::convertible_to<Keys, HLSTagParser::SortKey> && ...))
+    void stableSort(Keys... keys) {
+        sort(keys...);
+    }
+
+    // Read access to the parsed elements, in their current order
+    const auto& elements() const {
+        return getParser().getContainer();
+    }
+
+    /**
+     * @brief Elements matching query, in their current order, e.g. the audio renditions of
+     * one group in one language:
+     *
+     *     parser.select<ParserType::AUDIO>().find({.group = "aac-128k", .language = "de"});
+     *
+     * See RenditionQuery for the criteria and HLSTagParserSorter::find() for the indexes.
+     */
+    auto find(const RenditionQuery& query) const {
+        return getParser().find(query);
+    }
+
+    // Matching element with the highest BANDWIDTH, nullptr if none
+    auto highest(const RenditionQuery& query) const {
+        return getParser().highest(query);
+    }
 
-    // forwards the sort request to the underlying sub-parser
-    void sort(HLSTagParser::SortAttribute attr) {
-        getParser().sortByAttribute(attr);
+    // Matching element with the lowest BANDWIDTH, nullptr if none
+    auto lowest(const RenditionQuery& query) const {
+        return getParser().lowest(query);
     }
 
-    void sort(HLSTagParser::SortAttribute primary, HLSTagParser::SortAttribute secondary) {
-        getParser().sortByAttribute(primary, secondary);
+    // Value of an interned attribute of one of the elements, e.g. value(variant.codecs)
+    std::string_view value(AttributeId id) const {
+        return getParser().dictionary().value(id);
     }
 
 };
@@ -0,0 +1,68 @@
+//
+// Line tokenizer shared by the playlist parser and its tag sub-parsers
+//
+
+#ifndef HLS_FETCH_AND_SORT_M3U8TOKENIZER_H
+#define HLS_FETCH_AND_SORT_M3U8TOKENIZER_H
+
+#include <bit>
+#include <string_view>
+#include "DelimiterScanner.h"
+
+/**
+ * @brief Splits playlist content into lines and identifies tag names.
+ *
+ * The playlist is walked exactly once; every line is handed to the caller as a
+ * std::string_view into the original content, so no per-line copies are made.
+ * Trailing carriage returns (CRLF playlists) are stripped from each line. Line ends are
+ * taken from the newline masks of the DelimiterScanner kernel, a window of blocks at a time,
+ * instead of searching for each one separately.
+ */
+class M3U8Tokenizer {
+public:
+    /**
+     * @brief Invokes handler(std::string_view line) for each line in content.
+     *
+     * A final line without a terminating newline is reported as well.
+     */
+    template<typename LineHandler>
+    static void forEachLine(std::string_view content, LineHandler&& handler) {
+        const DelimiterScanner::Function scan = DelimiterScanner::activeKernel();
+        DelimiterMasks masks[DelimiterScanner::kWindowBlocks];
+        size_t start = 0;
+
+        for (size_t window = 0; window < content.size(); window += kWindowSize) {
+            const size_t blocks = scan(content.data() + window, content.size() - window, masks);
+            for (size_t block = 0; block < blocks; ++block) {
+                const size_t base = window + block * DelimiterScanner::kBlockSize;
+                for (uint64_t newlines = masks[block].newline; newlines; newlines &= newlines - 1) {
+                    const size_t eol = base + std::countr_zero(newlines);
+                    handler(trimLine(content.substr(start, eol - start)));
+                    start = eol + 1;
+                }
+            }
+        }
+        if (start < content.size()) handler(trimLine(content.substr(start)));
+    }
+
+    /**
+     * @brief Returns the tag name of a tag line, e.g. "#EXT-X-MEDIA" for "#EXT-X-MEDIA:TYPE=AUDIO,...".
+     *
+     * @return The tag name, or an empty view if the line is not a tag (URI, blank line or comment).
+     */
+    static std::string_view tagName(std::string_view line) {
+        if (line.size() < 4 || line.compare(0, 4, "#EXT") != 0) return {};
+        return line.substr(0, line.find(':'));
+    }
+
+    // Strips a trailing '\r' left behind by CRLF line endings.
+    static std::string_view trimLine(std::string_view line) {
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        return line;
+    }
+
+private:
+    static constexpr size_t kWindowSize = DelimiterScanner::kWindowBlocks * DelimiterScanner::kBlockSize;
+};
+
+#endif //HLS_FETCH_AND_SORT_M3U8TOKENIZER_H
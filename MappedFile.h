@@ -0,0 +1,71 @@
+//
+// Read-only memory mapping of a local file
+//
+
+#ifndef HLS_FETCH_AND_SORT_MAPPEDFILE_H
+#define HLS_FETCH_AND_SORT_MAPPEDFILE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Maps a file into memory for reading, unmapping it on destruction.
+ *
+ * Playlists read this way are never copied into a std::string: a view parser can parse
+ * view() directly and keep the mapping alive, e.g.
+ *
+ *     auto file = std::make_shared<MappedFile>(path);
+ *     M3U8ViewParser parser;
+ *     parser.parse(file->view(), file);
+ */
+class MappedFile {
+public:
+    // @throws std::runtime_error if the file cannot be opened or mapped.
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) throw std::runtime_error("Could not open file " + path + ": " + std::strerror(errno));
+
+        struct stat info{};
+        if (::fstat(fd, &info) != 0) {
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error("Could not stat file " + path + ": " + std::strerror(error));
+        }
+        size_ = static_cast<size_t>(info.st_size);
+
+        if (size_ > 0) {     // mmap rejects empty mappings
+            void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                int error = errno;
+                ::close(fd);
+                throw std::runtime_error("Could not map file " + path + ": " + std::strerror(error));
+            }
+            data_ = static_cast<const char*>(data);
+            ::madvise(data, size_, MADV_SEQUENTIAL);    // parsed front to back, once
+        }
+        ::close(fd);     // the mapping stays valid without the descriptor
+    }
+
+    ~MappedFile() {
+        if (data_) ::munmap(const_cast<char*>(data_), size_);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view view() const { return {data_, size_}; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t      size_ = 0;
+};
+
+#endif //HLS_FETCH_AND_SORT_MAPPEDFILE_H
@@ -5,86 +5,90 @@
 #include "HLSTagParser.h"
 
 // Tag-specific line & data attributes
-struct MediaGroup{
-    //std::string type;
-    std::string id;
-    std::string name;
-    std::string language;
-    std::string default_;
-    std::string autoselect;
+template<typename String>
+struct BasicMediaGroup{
+    //String type;
+    String      id;
+    String      name;
+    AttributeId language;           // in the parser's dictionary()
+    AttributeId default_;
+    AttributeId autoselect;
     int         channel_count;
-    std::string uri;
-    std::string manifest_line;
+    String      uri;
+    String      manifest_line;
 };
 
+using MediaGroup     = BasicMediaGroup<std::string>;
+using MediaGroupView = BasicMediaGroup<std::string_view>;
+static_assert(std::is_trivially_copyable_v<MediaGroupView>);
+
 // Concrete Media sub-parser
-class MediaParser : public HLSTagParserSorter<MediaParser, MediaGroup> {
+template<typename String>
+class BasicMediaParser : public HLSTagParserSorter<BasicMediaParser<String>, BasicMediaGroup<String>> {
 public:
-    std::vector<MediaGroup> audio_tracks_;
-
-    void parse(const std::string& content) override{
-        MediaGroup cur_audio_trk;
-        std::istringstream ss(content);
-        std::string line;
-
-
-        while(getline(ss, line)){
-            if(line.find("#EXT-X-MEDIA:") != std::string::npos){
-                cur_audio_trk = MediaGroup();
-                cur_audio_trk.manifest_line = line;
-
-                cur_audio_trk.uri        = extractAttribute(line,"URI");
-                cur_audio_trk.id         = extractAttribute(line,"GROUP-ID");
-                cur_audio_trk.name       = extractAttribute(line,"NAME");
-                cur_audio_trk.autoselect = extractAttribute(line,"AUTOSELECT");
-                std::string channelType  = extractAttribute(line,"CHANNELS");
-                cur_audio_trk.default_   = extractAttribute(line,"DEFAULT");
-                cur_audio_trk.language   = extractAttribute(line,"LANGUAGE");
-
-                // Extract channel count from Channels string
-                size_t slash_pos = channelType.find('/');
-                if(slash_pos == std::string::npos)  cur_audio_trk.channel_count = stoi(channelType);
-                else cur_audio_trk.channel_count = stoi(channelType.substr(0,slash_pos));
-
-                audio_tracks_.emplace_back(cur_audio_trk);
-            }
-        }
+    using Group         = BasicMediaGroup<String>;
+    using Dictionary    = BasicAttributeDictionary<String>;
+    using SortAttribute = HLSTagParser::SortAttribute;
+
+    std::pmr::vector<Group> audio_tracks_;
+
+    BasicMediaParser() = default;
+
+    // Elements are allocated from resource, which must outlive the parser.
+    explicit BasicMediaParser(std::pmr::memory_resource* resource) : audio_tracks_(resource), dictionary_(resource) {}
+
+    static constexpr std::string_view kTag = "#EXT-X-MEDIA";
+
+    std::string_view tag() const override { return kTag; }
+
+    void parseLine(std::string_view line) override{
+        if (line[0] != '#') return;
+
+        Group cur_audio_trk;
+        cur_audio_trk.manifest_line = line;
+
+        AttributeList attrs(line);
+        cur_audio_trk.uri        = attrs.get("URI");
+        cur_audio_trk.id         = attrs.get("GROUP-ID");
+        cur_audio_trk.name       = attrs.get("NAME");
+        cur_audio_trk.autoselect = dictionary_.intern(attrs.get("AUTOSELECT"));
+        cur_audio_trk.default_   = dictionary_.intern(attrs.get("DEFAULT"));
+        cur_audio_trk.language   = dictionary_.intern(attrs.get("LANGUAGE"));
+
+        // Channel count is the leading integer of the CHANNELS string, e.g. "16/JOC"
+        cur_audio_trk.channel_count = attrs.getInt("CHANNELS");
+
+        audio_tracks_.emplace_back(std::move(cur_audio_trk));
     }
 
-    // provide access to the container
-    std::vector<MediaGroup>& getContainer() { return audio_tracks_; }
+    void finish() override { this->orderInterned(dictionary_); }
 
-    /*  Map of comparison functions for each attribute */
-private:
-    using ComparisonFunc = std::function<bool(const MediaGroup&, const MediaGroup)>;
-
-    // Mapping between attributes and their comparators
-    const std::unordered_map<SortAttribute, ComparisonFunc> comparisons_ = {
-            {SortAttribute::ID, [](const MediaGroup& a, const MediaGroup& b){
-                return a.id < b.id;
-            }},
-            {SortAttribute::NAME, [](const MediaGroup& a, const MediaGroup& b){
-                return a.name < b.name;
-            }},
-            {SortAttribute::LANGUAGE, [](const MediaGroup& a, const MediaGroup& b){
-                return a.language < b.language;
-            }},
-            {SortAttribute::DEFAULT_, [](const MediaGroup& a, const MediaGroup& b){
-                return a.default_ < b.default_;
-            }},
-            {SortAttribute::AUTOSELECT, [](const MediaGroup& a, const MediaGroup& b){
-                return a.autoselect < b.autoselect;
-            }},
-            {SortAttribute::CHANNELS, [](const MediaGroup& a, const MediaGroup& b){
-                return a.channel_count < b.channel_count;
-            }}
-    };
+    // Values of the interned attributes
+    const Dictionary& dictionary() const { return dictionary_; }
 
-public:
-    // provide access to the comparisons map
-    const std::unordered_map<SortAttribute, ComparisonFunc>& getComparisons() const {
-        return comparisons_;
+    // Attributes queries filter on; the group is the GROUP-ID
+    RenditionKeys queryKeys(const Group& group) const {
+        return {0, 0, {}, {}, group.id, dictionary_.value(group.language)};
     }
+
+    // provide access to the container
+    std::pmr::vector<Group>& getContainer() { return audio_tracks_; }
+
+    // Element member compared for each supported sort attribute
+    using SortProjections = std::tuple<
+            SortProjection<SortAttribute::ID, &Group::id>,
+            SortProjection<SortAttribute::NAME, &Group::name>,
+            SortProjection<SortAttribute::LANGUAGE, &Group::language>,
+            SortProjection<SortAttribute::DEFAULT_, &Group::default_>,
+            SortProjection<SortAttribute::AUTOSELECT, &Group::autoselect>,
+            SortProjection<SortAttribute::CHANNELS, &Group::channel_count>
+    >;
+
+private:
+    Dictionary dictionary_;
 };
 
+using MediaParser     = BasicMediaParser<std::string>;
+using MediaViewParser = BasicMediaParser<std::string_view>;
+
 #endif //HLS_FETCH_AND_SORT_MEDIAPARSER_H
@@ -0,0 +1,561 @@
+/*
+ *          Module responsible for parsing HLS media playlists (segment lists)
+ */
+
+#ifndef HLS_FETCH_AND_SORT_MEDIAPLAYLISTPARSER_H
+#define HLS_FETCH_AND_SORT_MEDIAPLAYLISTPARSER_H
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "AttributeList.h"
+#include "M3U8Tokenizer.h"
+
+// Encryption of a run of segments (#EXT-X-KEY)
+struct SegmentKey {
+    std::string method;
+    std::string uri;
+    std::string iv;
+    std::string key_format;
+};
+
+// Media initialization section of a run of segments (#EXT-X-MAP)
+struct SegmentMap {
+    std::string uri;
+    uint64_t    byterange_length = 0;      // 0 = whole resource
+    uint64_t    byterange_offset = 0;
+};
+
+/**
+ * @brief Column-wise storage of the segments of a media playlist.
+ *
+ * Each attribute lives in its own array indexed by segment position, so scans over one
+ * attribute (e.g. summing durations over thousands of segments) touch only that column.
+ * URIs are concatenated into a single string and addressed by offset/length.
+ */
+struct SegmentStore {
+    enum Flags : uint8_t {
+        DISCONTINUITY = 1 << 0,            // preceded by #EXT-X-DISCONTINUITY
+        GAP           = 1 << 1             // marked with #EXT-X-GAP
+    };
+
+    // program_date_times value of segments without a known date. A sentinel rather than
+    // NaN, since the build enables -ffast-math.
+    static constexpr double kNoDateTime = std::numeric_limits<double>::lowest();
+
+    std::vector<double>   durations;          // #EXTINF duration in seconds
+    std::vector<uint64_t> sequence_numbers;   // media sequence number
+    std::vector<uint32_t> uri_offsets;        // into uri_data
+    std::vector<uint32_t> uri_lengths;
+    std::vector<uint64_t> byterange_lengths;  // 0 = whole resource
+    std::vector<uint64_t> byterange_offsets;
+    std::vector<uint8_t>  flags;              // Flags bit set
+    std::vector<int32_t>  key_indices;        // into MediaPlaylistParser::keys(), -1 = not encrypted
+    std::vector<int32_t>  map_indices;        // into MediaPlaylistParser::maps(), -1 = none
+    std::vector<double>   program_date_times; // seconds since the epoch, kNoDateTime if unknown
+    std::string           uri_data;
+
+    size_t size() const { return durations.size(); }
+    bool empty() const { return durations.empty(); }
+
+    std::string_view uri(size_t i) const {
+        return std::string_view(uri_data).substr(uri_offsets[i], uri_lengths[i]);
+    }
+
+    void reserve(size_t count) {
+        durations.reserve(count);
+        sequence_numbers.reserve(count);
+        uri_offsets.reserve(count);
+        uri_lengths.reserve(count);
+        byterange_lengths.reserve(count);
+        byterange_offsets.reserve(count);
+        flags.reserve(count);
+        key_indices.reserve(count);
+        map_indices.reserve(count);
+        program_date_times.reserve(count);
+    }
+
+    void clear() {
+        *this = SegmentStore();
+    }
+
+    // Removes the first count segments, e.g. those that slid out of a live playlist's window.
+    void eraseFront(size_t count) {
+        count = std::min(count, size());
+        if (count == 0) return;
+        uint32_t uri_shift = count < size() ? uri_offsets[count] : static_cast<uint32_t>(uri_data.size());
+
+        auto eraseColumn = [count](auto& column) { column.erase(column.begin(), column.begin() + count); };
+        eraseColumn(durations);
+        eraseColumn(sequence_numbers);
+        eraseColumn(uri_offsets);
+        eraseColumn(uri_lengths);
+        eraseColumn(byterange_lengths);
+        eraseColumn(byterange_offsets);
+        eraseColumn(flags);
+        eraseColumn(key_indices);
+        eraseColumn(map_indices);
+        eraseColumn(program_date_times);
+
+        uri_data.erase(0, uri_shift);
+        for (uint32_t& offset : uri_offsets) offset -= uri_shift;
+    }
+};
+
+/**
+ * @brief Parser for HLS media playlists.
+ *
+ * Handles #EXTINF, #EXT-X-TARGETDURATION, #EXT-X-MEDIA-SEQUENCE, #EXT-X-BYTERANGE,
+ * #EXT-X-DISCONTINUITY, #EXT-X-KEY, #EXT-X-MAP, #EXT-X-PROGRAM-DATE-TIME, #EXT-X-GAP,
+ * #EXT-X-PLAYLIST-TYPE, #EXT-X-ENDLIST, #EXT-X-SERVER-CONTROL and #EXT-X-SKIP. Segments
+ * are stored in a SegmentStore.
+ *
+ * Live playlists are kept current with update(), which appends only the segments that are
+ * new since the last load and accepts delta updates (#EXT-X-SKIP, requested with
+ * _HLS_skip=YES) as well as full playlists.
+ *
+ * Example:
+ *
+ *     MediaPlaylistParser media;
+ *     media.parse(fetcher.getResponse());
+ *     double seconds = media.totalDuration();
+ */
+class MediaPlaylistParser {
+public:
+    /**
+     * @brief Parses the provided media playlist content, in a single pass.
+     * @throws std::runtime_error if the content does not start with #EXTM3U.
+     */
+    void parse(std::string_view content) {
+        *this = MediaPlaylistParser();
+        parseContent(content);
+    }
+
+    /**
+     * @brief Merges a newer version of the playlist into the parsed model.
+     *
+     * Segments whose media sequence number is already known are skipped without touching
+     * the segment columns, new ones are appended, and segments that slid out of the new
+     * playlist's window are dropped. The content may be a delta update whose older segments
+     * were replaced by #EXT-X-SKIP.
+     *
+     * If the media sequence went backwards (e.g. the encoder restarted or the origin failed
+     * over), the model is replaced by the new playlist and all of its segments count as appended.
+     *
+     * @return The number of segments appended.
+     * @throws std::runtime_error if a delta update skips segments the model does not hold, or
+     *         restarts the media sequence; reload the full playlist in that case.
+     */
+    size_t update(std::string_view content) {
+        if (segments_.empty()) {
+            parse(content);
+            return segments_.size();
+        }
+
+        size_t before = segments_.size();
+        const uint64_t first_known = segments_.sequence_numbers.front();
+        state_ = PlaylistState();
+        append_after_ = segments_.sequence_numbers.back();
+        parseContent(content);
+        append_after_.reset();
+
+        // No playlist starts ahead of the one before it, unless its sequence was reset
+        if (state_.media_sequence < first_known) {
+            if (state_.skipped_segments > 0) {
+                throw std::runtime_error("Delta update restarts the media sequence");
+            }
+            parse(content);
+            return segments_.size();
+        }
+        size_t appended = segments_.size() - before;
+
+        // Slide the window to the oldest segment of the new playlist
+        const auto& sequences = segments_.sequence_numbers;
+        size_t expired = std::lower_bound(sequences.begin(), sequences.end(), state_.media_sequence) - sequences.begin();
+        if (expired > 0) {
+            segments_.eraseFront(expired);
+            compact(keys_, key_index_, segments_.key_indices, state_.current_key);
+            compact(maps_, map_index_, segments_.map_indices, state_.current_map);
+        }
+        return appended;
+    }
+
+    // Keys and maps of the stored segments; after update() slid the window, entries only the
+    // dropped segments used are gone and the indices of SegmentStore are renumbered.
+    const SegmentStore&            segments() const { return segments_; }
+    const std::vector<SegmentKey>& keys() const { return keys_; }
+    const std::vector<SegmentMap>& maps() const { return maps_; }
+
+    int                targetDuration() const { return state_.target_duration; }
+    uint64_t           mediaSequence() const { return state_.media_sequence; }
+    uint64_t           discontinuitySequence() const { return state_.discontinuity_sequence; }
+    const std::string& playlistType() const { return state_.playlist_type; }
+    bool               hasEndList() const { return state_.end_list; }
+
+    // CAN-SKIP-UNTIL of #EXT-X-SERVER-CONTROL in seconds; 0 if the server offers no delta updates.
+    double canSkipUntil() const { return state_.can_skip_until; }
+
+    // SKIPPED-SEGMENTS of #EXT-X-SKIP, non-zero if the last content was a delta update.
+    uint64_t skippedSegments() const { return state_.skipped_segments; }
+
+    /*  Scans over the segment columns */
+
+    double totalDuration() const {
+        double total = 0.0;
+        for (double duration : segments_.durations) total += duration;
+        return total;
+    }
+
+    double maxSegmentDuration() const {
+        double longest = 0.0;
+        for (double duration : segments_.durations) longest = std::max(longest, duration);
+        return longest;
+    }
+
+    // Segments whose rounded duration exceeds #EXT-X-TARGETDURATION (RFC 8216, 4.3.3.1).
+    std::vector<size_t> targetDurationViolations() const {
+        std::vector<size_t> violations;
+        for (size_t i = 0; i < segments_.durations.size(); ++i) {
+            if (std::lround(segments_.durations[i]) > state_.target_duration) violations.push_back(i);
+        }
+        return violations;
+    }
+
+    /**
+     * @brief Highest bitrate of any byte-range segment, in bits per second.
+     *
+     * Only segments with #EXT-X-BYTERANGE carry their size in the playlist; returns 0 if
+     * there are none. Useful to sanity check a variant's BANDWIDTH attribute.
+     */
+    double peakByteRangeBitrate() const {
+        double peak = 0.0;
+        for (size_t i = 0; i < segments_.durations.size(); ++i) {
+            double duration = segments_.durations[i];
+            if (segments_.byterange_lengths[i] == 0 || duration <= 0.0) continue;
+            peak = std::max(peak, static_cast<double>(segments_.byterange_lengths[i]) * 8.0 / duration);
+        }
+        return peak;
+    }
+
+    /**
+     * @brief Segments starting later than the previous segment's end by more than tolerance seconds.
+     *
+     * Compares consecutive #EXT-X-PROGRAM-DATE-TIME values against the preceding duration.
+     * Segments after a discontinuity or without a date are skipped.
+     */
+    std::vector<size_t> programDateTimeGaps(double tolerance = 0.5) const {
+        std::vector<size_t> gaps;
+        const auto& pdt = segments_.program_date_times;
+        for (size_t i = 1; i < pdt.size(); ++i) {
+            if (pdt[i] == SegmentStore::kNoDateTime || pdt[i - 1] == SegmentStore::kNoDateTime) continue;
+            if (segments_.flags[i] & SegmentStore::DISCONTINUITY) continue;
+            if (pdt[i] - (pdt[i - 1] + segments_.durations[i - 1]) > tolerance) gaps.push_back(i);
+        }
+        return gaps;
+    }
+
+    // Number of segments carrying the given SegmentStore::Flags bit.
+    size_t countFlagged(SegmentStore::Flags flag) const {
+        size_t count = 0;
+        for (uint8_t flags : segments_.flags) count += (flags & flag) ? 1 : 0;
+        return count;
+    }
+
+    /**
+     * @brief Parses an ISO/IEC 8601 date-time as used by #EXT-X-PROGRAM-DATE-TIME.
+     *
+     * Accepts "YYYY-MM-DDThh:mm:ss[.fff](Z|+hh:mm|-hh:mm)".
+     * @return Seconds since the Unix epoch, or SegmentStore::kNoDateTime if the value is malformed.
+     */
+    static double parseDateTime(std::string_view value) {
+        auto number = [&value](size_t pos, size_t len) {
+            int result = -1;
+            if (pos + len <= value.size()) {
+                std::from_chars(value.data() + pos, value.data() + pos + len, result);
+            }
+            return result;
+        };
+        const double invalid = SegmentStore::kNoDateTime;
+        if (value.size() < 19 || value[4] != '-' || value[7] != '-' || value[10] != 'T') return invalid;
+
+        int year = number(0, 4), month = number(5, 2), day = number(8, 2);
+        int hour = number(11, 2), minute = number(14, 2), second = number(17, 2);
+        if (year < 0 || month < 1 || month > 12 || day < 1 || hour < 0 || minute < 0 || second < 0) return invalid;
+
+        // Days since the epoch of a proleptic Gregorian date (H. Hinnant's days_from_civil)
+        int y = year - (month <= 2);
+        int era = (y >= 0 ? y : y - 399) / 400;
+        int yoe = y - era * 400;
+        int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        double days = static_cast<double>(era) * 146097 + doe - 719468;
+
+        double seconds = days * 86400.0 + hour * 3600.0 + minute * 60.0 + second;
+
+        size_t pos = 19;
+        if (pos < value.size() && value[pos] == '.') {
+            size_t start = pos;
+            ++pos;
+            while (pos < value.size() && value[pos] >= '0' && value[pos] <= '9') ++pos;
+            seconds += AttributeList::decimalFloat(value.substr(start, pos - start));
+        }
+        if (pos < value.size() && (value[pos] == '+' || value[pos] == '-')) {
+            int offset_hours = number(pos + 1, 2), offset_minutes = number(pos + 4, 2);
+            if (offset_hours < 0 || offset_minutes < 0) return invalid;
+            double offset = offset_hours * 3600.0 + offset_minutes * 60.0;
+            seconds += (value[pos] == '+') ? -offset : offset;
+        }
+        return seconds;
+    }
+
+private:
+    // Attribute text of #EXT-X-KEY / #EXT-X-MAP tags -> index into keys_ / maps_
+    struct TextHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view text) const { return std::hash<std::string_view>()(text); }
+    };
+    using TagIndex = std::unordered_map<std::string, int32_t, TextHash, std::equal_to<>>;
+
+    SegmentStore            segments_;
+    std::vector<SegmentKey> keys_;
+    std::vector<SegmentMap> maps_;
+    TagIndex                key_index_;
+    TagIndex                map_index_;
+
+    // Attributes of the most recently parsed playlist version and the tag state carried
+    // from line to line while parsing it
+    struct PlaylistState {
+        int         target_duration = 0;
+        uint64_t    media_sequence = 0;
+        uint64_t    discontinuity_sequence = 0;
+        std::string playlist_type;
+        bool        end_list = false;
+        double      can_skip_until = 0.0;
+        uint64_t    skipped_segments = 0;
+
+        uint64_t    next_sequence = 0;            // media sequence number of the next segment
+        int32_t     current_key = -1;
+        int32_t     current_map = -1;
+        uint64_t    next_byterange_offset = 0;    // implicit offset of a BYTERANGE without '@'
+        double      next_program_date_time = SegmentStore::kNoDateTime;
+    };
+    PlaylistState state_;
+
+    // State of the segment being assembled from the tags preceding its URI line
+    struct PendingSegment {
+        bool     has_extinf = false;
+        double   duration = 0.0;
+        uint64_t byterange_length = 0;
+        uint64_t byterange_offset = 0;
+        bool     has_byterange_offset = false;
+        uint8_t  flags = 0;
+        double   program_date_time = SegmentStore::kNoDateTime;
+    };
+    PendingSegment pending_;
+
+    // Set during update(): segments up to this sequence number are already stored
+    std::optional<uint64_t> append_after_;
+
+    void parseContent(std::string_view content) {
+        bool first_line = true;
+        pending_ = PendingSegment();
+        M3U8Tokenizer::forEachLine(content, [&](std::string_view line) {
+            if (first_line) {
+                if (line.find("#EXTM3U") == std::string_view::npos) {
+                    throw std::runtime_error("Invalid M3U8 file - missing #EXTM3U header");
+                }
+                first_line = false;
+                return;
+            }
+            parseLine(line);
+        });
+        if (first_line) {
+            throw std::runtime_error("Invalid M3U8 file - missing #EXTM3U header");
+        }
+    }
+
+    // Index of the entry of table a tag's attribute text stands for; the text is parsed into
+    // a new entry only the first time. Live playlists repeat their keys and maps on every reload.
+    template<typename Entry, typename Parse>
+    static int32_t findOrAdd(std::vector<Entry>& table, TagIndex& index, std::string_view text, Parse parse) {
+        if (auto it = index.find(text); it != index.end()) return it->second;
+        table.push_back(parse());
+        auto id = static_cast<int32_t>(table.size() - 1);
+        index.emplace(std::string(text), id);
+        return id;
+    }
+
+    // Drops the entries of table that neither a stored segment nor the current tag state
+    // refers to and renumbers the rest, so the keys and maps of a live playlist stay
+    // bounded by its window.
+    template<typename Entry>
+    static void compact(std::vector<Entry>& table, TagIndex& index, std::vector<int32_t>& ids, int32_t& current) {
+        std::vector<int32_t> remap(table.size(), -1);
+        for (int32_t id : ids) {
+            if (id >= 0) remap[id] = 0;
+        }
+        if (current >= 0) remap[current] = 0;
+
+        int32_t next = 0;
+        for (size_t i = 0; i < table.size(); ++i) {
+            if (remap[i] < 0) continue;
+            if (static_cast<size_t>(next) != i) table[next] = std::move(table[i]);
+            remap[i] = next++;
+        }
+        if (static_cast<size_t>(next) == table.size()) return;
+
+        table.resize(next);
+        for (int32_t& id : ids) {
+            if (id >= 0) id = remap[id];
+        }
+        if (current >= 0) current = remap[current];
+        for (auto it = index.begin(); it != index.end();) {
+            if (remap[it->second] < 0) {
+                it = index.erase(it);
+            } else {
+                it->second = remap[it->second];
+                ++it;
+            }
+        }
+    }
+
+    // Continues the tag state from the stored segment with the given sequence number, as if
+    // it had just been parsed: date, implicit byte range offset, key and map.
+    void continueAfter(uint64_t sequence) {
+        const auto& sequences = segments_.sequence_numbers;
+        auto it = std::lower_bound(sequences.begin(), sequences.end(), sequence);
+        if (it == sequences.end() || *it != sequence) return;
+        size_t i = it - sequences.begin();
+
+        double pdt = segments_.program_date_times[i];
+        state_.next_program_date_time = (pdt == SegmentStore::kNoDateTime) ? pdt : pdt + segments_.durations[i];
+        state_.next_byterange_offset  = segments_.byterange_lengths[i] ? segments_.byterange_offsets[i] + segments_.byterange_lengths[i] : 0;
+        state_.current_key = segments_.key_indices[i];
+        state_.current_map = segments_.map_indices[i];
+    }
+
+    // Parses "<length>[@<offset>]" of #EXT-X-BYTERANGE and the BYTERANGE attribute of #EXT-X-MAP.
+    static bool parseByteRange(std::string_view value, uint64_t& length, uint64_t& offset) {
+        size_t at = value.find('@');
+        std::string_view len = value.substr(0, at);
+        if (std::from_chars(len.data(), len.data() + len.size(), length).ec != std::errc()) return false;
+        if (at == std::string_view::npos) return false;
+        std::string_view off = value.substr(at + 1);
+        return std::from_chars(off.data(), off.data() + off.size(), offset).ec == std::errc();
+    }
+
+    static std::string_view tagValue(std::string_view line) {
+        size_t colon = line.find(':');
+        return colon == std::string_view::npos ? std::string_view() : line.substr(colon + 1);
+    }
+
+    void parseLine(std::string_view line) {
+        if (line.empty()) return;
+        if (line[0] != '#') {
+            appendSegment(line);
+            return;
+        }
+
+        std::string_view tag = M3U8Tokenizer::tagName(line);
+        std::string_view value = tagValue(line);
+
+        if (tag == "#EXTINF") {
+            pending_.has_extinf = true;
+            pending_.duration = AttributeList::decimalFloat(value.substr(0, value.find(',')));
+        } else if (tag == "#EXT-X-BYTERANGE") {
+            uint64_t length = 0, offset = 0;
+            pending_.has_byterange_offset = parseByteRange(value, length, offset);
+            pending_.byterange_length = length;
+            pending_.byterange_offset = pending_.has_byterange_offset ? offset : state_.next_byterange_offset;
+        } else if (tag == "#EXT-X-DISCONTINUITY") {
+            pending_.flags |= SegmentStore::DISCONTINUITY;
+        } else if (tag == "#EXT-X-GAP") {
+            pending_.flags |= SegmentStore::GAP;
+        } else if (tag == "#EXT-X-PROGRAM-DATE-TIME") {
+            pending_.program_date_time = parseDateTime(value);
+        } else if (tag == "#EXT-X-KEY") {
+            AttributeList attrs(line);
+            if (attrs.get("METHOD") == "NONE") {
+                state_.current_key = -1;
+            } else {
+                state_.current_key = findOrAdd(keys_, key_index_, value, [&attrs] {
+                    return SegmentKey{std::string(attrs.get("METHOD")), std::string(attrs.get("URI")),
+                                      std::string(attrs.get("IV")), std::string(attrs.get("KEYFORMAT"))};
+                });
+            }
+        } else if (tag == "#EXT-X-MAP") {
+            state_.current_map = findOrAdd(maps_, map_index_, value, [line] {
+                AttributeList attrs(line);
+                SegmentMap map;
+                map.uri = attrs.get("URI");
+                if (attrs.has("BYTERANGE")) {
+                    parseByteRange(attrs.get("BYTERANGE"), map.byterange_length, map.byterange_offset);
+                }
+                return map;
+            });
+        } else if (tag == "#EXT-X-TARGETDURATION") {
+            state_.target_duration = AttributeList::decimalInteger(value);
+        } else if (tag == "#EXT-X-MEDIA-SEQUENCE") {
+            std::from_chars(value.data(), value.data() + value.size(), state_.media_sequence);
+            state_.next_sequence = state_.media_sequence;
+        } else if (tag == "#EXT-X-DISCONTINUITY-SEQUENCE") {
+            std::from_chars(value.data(), value.data() + value.size(), state_.discontinuity_sequence);
+        } else if (tag == "#EXT-X-PLAYLIST-TYPE") {
+            state_.playlist_type = value;
+        } else if (tag == "#EXT-X-ENDLIST") {
+            state_.end_list = true;
+        } else if (tag == "#EXT-X-SERVER-CONTROL") {
+            state_.can_skip_until = AttributeList::decimalFloat(AttributeList(line).get("CAN-SKIP-UNTIL"));
+        } else if (tag == "#EXT-X-SKIP") {
+            // The skipped segments are the oldest ones, which a previous load must have stored
+            state_.skipped_segments = AttributeList(line).getInt("SKIPPED-SEGMENTS");
+            state_.next_sequence += state_.skipped_segments;
+            if (!append_after_ || state_.next_sequence > *append_after_ + 1) {
+                throw std::runtime_error("Delta update skips segments that were never loaded");
+            }
+            // The segments after the skip continue from the last skipped one
+            if (state_.next_sequence > 0) continueAfter(state_.next_sequence - 1);
+        }
+    }
+
+    // Completes the pending segment with its URI line.
+    void appendSegment(std::string_view uri) {
+        if (!pending_.has_extinf) {
+            throw std::runtime_error("Segment URI without #EXTINF: " + std::string(uri));
+        }
+
+        // A date applies to its segment; later segments continue from it (RFC 8216, 4.3.2.6)
+        double pdt = pending_.program_date_time;
+        if (pdt == SegmentStore::kNoDateTime && !(pending_.flags & SegmentStore::DISCONTINUITY)) {
+            pdt = state_.next_program_date_time;
+        }
+        state_.next_program_date_time = (pdt == SegmentStore::kNoDateTime) ? pdt : pdt + pending_.duration;
+        state_.next_byterange_offset = pending_.byterange_length ? pending_.byterange_offset + pending_.byterange_length : 0;
+        uint64_t sequence = state_.next_sequence++;
+
+        if (!append_after_ || sequence > *append_after_) {
+            segments_.durations.push_back(pending_.duration);
+            segments_.sequence_numbers.push_back(sequence);
+            segments_.uri_offsets.push_back(static_cast<uint32_t>(segments_.uri_data.size()));
+            segments_.uri_lengths.push_back(static_cast<uint32_t>(uri.size()));
+            segments_.uri_data.append(uri);
+            segments_.byterange_lengths.push_back(pending_.byterange_length);
+            segments_.byterange_offsets.push_back(pending_.byterange_offset);
+            segments_.flags.push_back(pending_.flags);
+            segments_.key_indices.push_back(state_.current_key);
+            segments_.map_indices.push_back(state_.current_map);
+            segments_.program_date_times.push_back(pdt);
+        }
+        pending_ = PendingSegment();
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_MEDIAPLAYLISTPARSER_H
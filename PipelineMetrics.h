@@ -0,0 +1,288 @@
+//
+// Per-stage timings and transfer metrics of the fetch -> parse -> sort -> write pipeline
+//
+
+#ifndef HLS_FETCH_AND_SORT_PIPELINEMETRICS_H
+#define HLS_FETCH_AND_SORT_PIPELINEMETRICS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "M3U8Parser.h"
+#include "TransferMetrics.h"
+
+/**
+ * @brief Collects what happened to each playlist of a run, and aggregates it per stage.
+ *
+ * Pipeline code fills one Record per playlist and hands it to record(). Records are kept
+ * for the JSON report of a run; every record also feeds per-stage histograms, which are
+ * what long-running modes export as Prometheus text (records can be switched off there so
+ * memory stays flat). Thread-safe.
+ *
+ * Stages: the transfer phases dns, connect, tls, server (TLS done to first byte) and
+ * download (first byte to done), fetch (total transfer), parse, the stream/audio/iframe
+ * sub-parsers, sort and write.
+ */
+class PipelineMetrics {
+public:
+    // Everything measured while processing one playlist
+    struct Record {
+        std::string                    source;
+        bool                           ok = true;
+        std::string                    error;
+        std::optional<TransferMetrics> transfer;        // remote inputs only
+        uint64_t                       parse_ns = 0;
+        ParseTimings                   parse_timings;   // master playlists, if collected
+        std::array<size_t, 3>          elements{};      // variants, audio tracks, I-frames
+        size_t                         segments = 0;    // media playlists
+        uint64_t                       sort_ns = 0;
+        uint64_t                       write_ns = 0;
+        uint64_t                       bytes_in = 0;
+        uint64_t                       bytes_out = 0;
+    };
+
+    struct Options {
+        bool keep_records = true;       // false: aggregate only
+    };
+
+    // Measures the time since construction or the last restart().
+    class Stopwatch {
+    public:
+        uint64_t elapsedNanos() const {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start_).count();
+        }
+        void restart() { start_ = std::chrono::steady_clock::now(); }
+
+    private:
+        std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+    };
+
+    PipelineMetrics() : PipelineMetrics(Options()) {}
+
+    explicit PipelineMetrics(Options options) : options_(options) {}
+
+    void record(Record record) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++(record.ok ? succeeded_ : failed_);
+        bytes_in_  += record.bytes_in;
+        bytes_out_ += record.bytes_out;
+        if (record.transfer) bytes_transferred_ += record.transfer->bytes;
+        for (size_t i = 0; i < record.elements.size(); ++i) elements_[i] += record.elements[i];
+        segments_ += record.segments;
+
+        if (const auto& t = record.transfer) {
+            observe(DNS,      t->name_lookup);
+            observe(CONNECT,  t->connect - t->name_lookup);
+            observe(TLS,      t->tls - t->connect);
+            observe(SERVER,   t->first_byte - t->tls);
+            observe(DOWNLOAD, t->total - t->first_byte);
+            observe(FETCH,    t->total);
+        }
+        observeNanos(PARSE, record.parse_ns);
+        for (size_t i = 0; i < record.parse_timings.sub_parser_ns.size(); ++i) {
+            observeNanos(static_cast<Stage>(PARSE_STREAM + i), record.parse_timings.sub_parser_ns[i]);
+        }
+        observeNanos(SORT,  record.sort_ns);
+        observeNanos(WRITE, record.write_ns);
+
+        if (options_.keep_records) records_.push_back(std::move(record));
+    }
+
+    // Report of the run: aggregates per stage, followed by every record.
+    std::string toJson() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string out = "{\n  \"summary\": {";
+        out += "\"playlists\": " + std::to_string(succeeded_ + failed_);
+        out += ", \"failed\": " + std::to_string(failed_);
+        out += ", \"bytes_in\": " + std::to_string(bytes_in_);
+        out += ", \"bytes_out\": " + std::to_string(bytes_out_);
+        out += ", \"bytes_transferred\": " + std::to_string(bytes_transferred_);
+        out += ", \"elements\": " + elementsJson(elements_, segments_);
+        out += ",\n    \"stages\": {";
+        bool first = true;
+        for (size_t stage = 0; stage < kStageCount; ++stage) {
+            const Histogram& h = histograms_[stage];
+            if (h.count == 0) continue;
+            out += first ? "\n" : ",\n";
+            first = false;
+            out += "      \"" + std::string(kStageNames[stage]) + "\": {\"count\": " + std::to_string(h.count) +
+                   ", \"sum_seconds\": " + number(h.sum) + ", \"max_seconds\": " + number(h.max) + "}";
+        }
+        out += "\n    }\n  },\n  \"playlists\": [";
+
+        for (size_t i = 0; i < records_.size(); ++i) {
+            const Record& r = records_[i];
+            out += i ? ",\n    {" : "\n    {";
+            out += "\"source\": " + quote(r.source) + ", \"ok\": " + (r.ok ? "true" : "false");
+            if (!r.ok) out += ", \"error\": " + quote(r.error);
+            if (const auto& t = r.transfer) {
+                out += ", \"transfer\": {\"name_lookup\": " + number(t->name_lookup) +
+                       ", \"connect\": " + number(t->connect) + ", \"tls\": " + number(t->tls) +
+                       ", \"first_byte\": " + number(t->first_byte) + ", \"total\": " + number(t->total) +
+                       ", \"bytes\": " + std::to_string(t->bytes) + ", \"http_code\": " + std::to_string(t->http_code) + "}";
+            }
+            out += ", \"parse_ns\": " + std::to_string(r.parse_ns);
+            const auto& sub = r.parse_timings.sub_parser_ns;
+            out += ", \"sub_parser_ns\": {\"stream\": " + std::to_string(sub[0]) + ", \"audio\": " +
+                   std::to_string(sub[1]) + ", \"iframe\": " + std::to_string(sub[2]) + "}";
+            out += ", \"elements\": " + elementsJson(r.elements, r.segments);
+            out += ", \"sort_ns\": " + std::to_string(r.sort_ns) + ", \"write_ns\": " + std::to_string(r.write_ns);
+            out += ", \"bytes_in\": " + std::to_string(r.bytes_in) + ", \"bytes_out\": " + std::to_string(r.bytes_out) + "}";
+        }
+        out += records_.empty() ? "]\n}\n" : "\n  ]\n}\n";
+        return out;
+    }
+
+    // Aggregates in the Prometheus text exposition format.
+    std::string toPrometheus() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string out;
+        out += "# HELP hls_playlists_total Playlists processed, by result.\n# TYPE hls_playlists_total counter\n";
+        out += "hls_playlists_total{result=\"ok\"} " + std::to_string(succeeded_) + "\n";
+        out += "hls_playlists_total{result=\"error\"} " + std::to_string(failed_) + "\n";
+        out += "# HELP hls_bytes_read_total Playlist bytes fetched or read.\n# TYPE hls_bytes_read_total counter\n";
+        out += "hls_bytes_read_total " + std::to_string(bytes_in_) + "\n";
+        out += "# HELP hls_bytes_written_total Playlist bytes written.\n# TYPE hls_bytes_written_total counter\n";
+        out += "hls_bytes_written_total " + std::to_string(bytes_out_) + "\n";
+        out += "# HELP hls_bytes_transferred_total Playlist body bytes received over the network, before decompression.\n"
+               "# TYPE hls_bytes_transferred_total counter\n";
+        out += "hls_bytes_transferred_total " + std::to_string(bytes_transferred_) + "\n";
+        out += "# HELP hls_elements_total Parsed playlist elements, by type.\n# TYPE hls_elements_total counter\n";
+        static constexpr std::array<std::string_view, 3> element_names = {"variant", "audio", "iframe"};
+        for (size_t i = 0; i < element_names.size(); ++i) {
+            out += "hls_elements_total{type=\"" + std::string(element_names[i]) + "\"} " + std::to_string(elements_[i]) + "\n";
+        }
+        out += "hls_elements_total{type=\"segment\"} " + std::to_string(segments_) + "\n";
+
+        out += "# HELP hls_stage_duration_seconds Duration of each pipeline stage.\n"
+               "# TYPE hls_stage_duration_seconds histogram\n";
+        for (size_t stage = 0; stage < kStageCount; ++stage) {
+            const Histogram& h = histograms_[stage];
+            std::string label = "stage=\"" + std::string(kStageNames[stage]) + "\"";
+            uint64_t cumulative = 0;
+            for (size_t b = 0; b < kBuckets.size(); ++b) {
+                cumulative += h.buckets[b];
+                out += "hls_stage_duration_seconds_bucket{" + label + ",le=\"" + number(kBuckets[b]) + "\"} " +
+                       std::to_string(cumulative) + "\n";
+            }
+            out += "hls_stage_duration_seconds_bucket{" + label + ",le=\"+Inf\"} " + std::to_string(h.count) + "\n";
+            out += "hls_stage_duration_seconds_sum{" + label + "} " + number(h.sum) + "\n";
+            out += "hls_stage_duration_seconds_count{" + label + "} " + std::to_string(h.count) + "\n";
+        }
+        return out;
+    }
+
+    /**
+     * @brief Writes toPrometheus() for a path ending in ".prom", toJson() otherwise.
+     *
+     * The file is replaced atomically, so it can be polled by e.g. the node_exporter
+     * textfile collector while a long-running mode keeps rewriting it.
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    void writeFile(const std::filesystem::path& path) const {
+        std::string content = path.extension() == ".prom" ? toPrometheus() : toJson();
+        std::filesystem::path temp = path;
+        temp += ".tmp";
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            out << content;
+            if (!out) throw std::runtime_error("Could not write metrics to " + temp.string());
+        }
+        std::filesystem::rename(temp, path);
+    }
+
+private:
+    enum Stage {
+        DNS, CONNECT, TLS, SERVER, DOWNLOAD, FETCH, PARSE, PARSE_STREAM, PARSE_AUDIO, PARSE_IFRAME, SORT, WRITE,
+        kStageCount
+    };
+    static constexpr std::array<std::string_view, kStageCount> kStageNames = {
+        "dns", "connect", "tls", "server", "download", "fetch", "parse",
+        "parse_stream", "parse_audio", "parse_iframe", "sort", "write"
+    };
+    // Upper bounds of the histogram buckets, in seconds
+    static constexpr std::array<double, 16> kBuckets = {
+        0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+    };
+
+    struct Histogram {
+        std::array<uint64_t, kBuckets.size()> buckets{};     // per bucket, not cumulative
+        uint64_t count = 0;
+        double   sum   = 0.0;
+        double   max   = 0.0;
+    };
+
+    Options options_;
+    mutable std::mutex mutex_;
+    std::vector<Record> records_;
+    std::array<Histogram, kStageCount> histograms_{};
+    uint64_t succeeded_ = 0;
+    uint64_t failed_    = 0;
+    uint64_t bytes_in_  = 0;
+    uint64_t bytes_out_ = 0;
+    uint64_t bytes_transferred_ = 0;    // wire bytes of remote inputs, compressed if encoded
+    std::array<uint64_t, 3> elements_{};
+    uint64_t segments_  = 0;
+
+    void observe(Stage stage, double seconds) {
+        if (seconds < 0) seconds = 0;
+        Histogram& h = histograms_[stage];
+        size_t bucket = 0;
+        while (bucket < kBuckets.size() && seconds > kBuckets[bucket]) ++bucket;
+        if (bucket < kBuckets.size()) ++h.buckets[bucket];
+        ++h.count;
+        h.sum += seconds;
+        if (seconds > h.max) h.max = seconds;
+    }
+
+    // Stages that did not run (0 ns) are not observed.
+    void observeNanos(Stage stage, uint64_t nanos) {
+        if (nanos > 0) observe(stage, static_cast<double>(nanos) / 1e9);
+    }
+
+    template<typename Counts>
+    static std::string elementsJson(const Counts& elements, uint64_t segments) {
+        return "{\"variants\": " + std::to_string(elements[0]) + ", \"audio\": " + std::to_string(elements[1]) +
+               ", \"iframes\": " + std::to_string(elements[2]) + ", \"segments\": " + std::to_string(segments) + "}";
+    }
+
+    static std::string number(double value) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+        return buffer;
+    }
+
+    static std::string quote(std::string_view text) {
+        std::string out = "\"";
+        for (char c : text) {
+            switch (c) {
+                case '"':  out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n";  break;
+                case '\r': out += "\\r";  break;
+                case '\t': out += "\\t";  break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char escape[8];
+                        std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                        out += escape;
+                    } else {
+                        out += c;
+                    }
+            }
+        }
+        return out + "\"";
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_PIPELINEMETRICS_H
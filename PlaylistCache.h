@@ -0,0 +1,378 @@
+/*
+ *          Module responsible for caching fetched and parsed playlists
+ */
+
+#ifndef HLS_FETCH_AND_SORT_PLAYLISTCACHE_H
+#define HLS_FETCH_AND_SORT_PLAYLISTCACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "HLSFetcher.h"
+#include "M3U8Parser.h"
+
+/**
+ * @brief A cached playlist: its body, HTTP caching metadata and, lazily, its parsed form.
+ */
+class CachedPlaylist {
+public:
+    using Clock = std::chrono::system_clock;
+
+    std::string       url;
+    std::string       body;
+    std::string       etag;
+    std::string       last_modified;
+    Clock::time_point expires;             // fresh until then, revalidated afterwards
+
+    bool fresh(Clock::time_point now = Clock::now()) const { return now < expires; }
+
+    /**
+     * @brief The master playlist parsed from body, parsed on first use only.
+     *
+     * The view model is cheap to copy (shared buffer, trivially-copyable records), so callers
+     * that want to sort copy it: M3U8ViewParser parser = *entry->parsed();
+     * @throws std::runtime_error if body is not a valid master playlist.
+     */
+    std::shared_ptr<const M3U8ViewParser> parsed() const {
+        std::lock_guard<std::mutex> lock(parse_mutex_);
+        if (!parsed_) {
+            auto parser = std::make_shared<M3U8ViewParser>();
+            parser->parse(std::string(body));
+            parsed_ = std::move(parser);
+        }
+        return parsed_;
+    }
+
+    // Creates a copy with a new freshness lifetime that keeps the parsed result.
+    std::shared_ptr<CachedPlaylist> revalidated(Clock::time_point new_expires) const {
+        auto copy = std::make_shared<CachedPlaylist>();
+        copy->url           = url;
+        copy->body          = body;
+        copy->etag          = etag;
+        copy->last_modified = last_modified;
+        copy->expires       = new_expires;
+        std::lock_guard<std::mutex> lock(parse_mutex_);
+        copy->parsed_ = parsed_;
+        return copy;
+    }
+
+private:
+    mutable std::mutex                            parse_mutex_;
+    mutable std::shared_ptr<const M3U8ViewParser> parsed_;
+};
+
+/**
+ * @brief Two-tier cache in front of HLSFetcher, keyed on URL.
+ *
+ * Tier one is a bounded in-memory LRU of CachedPlaylist entries, which also keep the parsed
+ * playlist so repeated jobs on the same master skip both the origin and the parser. Tier two
+ * is an optional directory of entry files that survives restarts, so a freshly deployed
+ * process starts warm instead of hitting the CDN for every playlist at once.
+ *
+ * Freshness follows Cache-Control: max-age (no-store bypasses the cache, no-cache forces
+ * revalidation). Stale entries are revalidated with a conditional GET using their ETag /
+ * Last-Modified; a 304 only extends the entry's lifetime, and rewrites just the expiry of its
+ * entry file rather than the body. Concurrent misses for the same URL are collapsed into a
+ * single fetch. All methods are thread-safe.
+ *
+ * Example:
+ *
+ *     PlaylistCache cache({.memory_capacity = 512, .disk_directory = "/var/cache/hls"});
+ *     M3U8ViewParser parser = *cache.get(url)->parsed();
+ */
+class PlaylistCache {
+public:
+    struct Options {
+        size_t                    memory_capacity = 256;    // entries kept in memory
+        std::filesystem::path     disk_directory;           // empty = memory tier only
+        std::chrono::seconds      default_max_age{0};       // lifetime without Cache-Control max-age
+    };
+
+    // Snapshot of the cache counters
+    struct Stats {
+        uint64_t memory_hits   = 0;
+        uint64_t disk_hits     = 0;
+        uint64_t misses        = 0;     // fetched from the origin
+        uint64_t revalidations = 0;     // stale entries confirmed by 304 Not Modified
+        uint64_t evictions     = 0;     // entries dropped from the memory tier
+    };
+
+    PlaylistCache() : PlaylistCache(Options()) {}
+
+    explicit PlaylistCache(Options options) : options_(std::move(options)) {
+        if (!options_.disk_directory.empty()) {
+            std::filesystem::create_directories(options_.disk_directory);
+        }
+    }
+
+    /**
+     * @brief Returns the playlist at url, from cache when fresh.
+     *
+     * @throws std::runtime_error if the playlist is neither cached nor fetchable. A stale
+     *         entry is served when revalidation fails.
+     */
+    std::shared_ptr<const CachedPlaylist> get(const std::string& url) {
+        std::shared_ptr<const CachedPlaylist> stale;
+        std::promise<std::shared_ptr<const CachedPlaylist>> promise;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto it = index_.find(url);
+            if (it != index_.end()) {
+                lru_.splice(lru_.begin(), lru_, it->second);    // mark most recently used
+                if ((*it->second)->fresh()) {
+                    ++memory_hits_;
+                    return *it->second;
+                }
+                stale = *it->second;
+            }
+
+            // Join a fetch of the same URL that is already in progress
+            auto pending = in_flight_.find(url);
+            if (pending != in_flight_.end()) {
+                auto future = pending->second;
+                lock.unlock();
+                return future.get();
+            }
+            in_flight_.emplace(url, promise.get_future().share());
+        }
+
+        try {
+            auto entry = load(url, stale);
+            promise.set_value(entry);
+            finishInFlight(url);
+            return entry;
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+            finishInFlight(url);
+            throw;
+        }
+    }
+
+    Stats stats() const {
+        Stats stats;
+        stats.memory_hits   = memory_hits_;
+        stats.disk_hits     = disk_hits_;
+        stats.misses        = misses_;
+        stats.revalidations = revalidations_;
+        stats.evictions     = evictions_;
+        return stats;
+    }
+
+    // Number of entries in the memory tier.
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return lru_.size();
+    }
+
+    /**
+     * @brief Extracts the freshness lifetime from a Cache-Control header value.
+     * @return max-age in seconds; 0 for no-cache; -1 for no-store or when max-age is absent.
+     */
+    static long maxAge(std::string_view cache_control) {
+        if (cache_control.find("no-store") != std::string_view::npos) return -1;
+        if (cache_control.find("no-cache") != std::string_view::npos) return 0;
+        size_t pos = cache_control.find("max-age=");
+        if (pos == std::string_view::npos) return -1;
+        return AttributeList::decimalInteger(cache_control.substr(pos + 8), -1);
+    }
+
+private:
+    using Entry = std::shared_ptr<const CachedPlaylist>;
+
+    Options options_;
+
+    mutable std::mutex                                          mutex_;
+    std::list<Entry>                                            lru_;      // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    std::unordered_map<std::string, std::shared_future<Entry>>  in_flight_;
+
+    std::atomic<uint64_t> memory_hits_{0};
+    std::atomic<uint64_t> disk_hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> revalidations_{0};
+    std::atomic<uint64_t> evictions_{0};
+
+    void finishInFlight(const std::string& url) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_.erase(url);
+    }
+
+    // Resolves a memory miss: disk tier first, then the origin.
+    Entry load(const std::string& url, Entry stale) {
+        if (!stale) {
+            stale = loadFromDisk(url);
+            if (stale && stale->fresh()) {
+                ++disk_hits_;
+                store(stale, false);
+                return stale;
+            }
+        }
+
+        HLSFetcher fetcher(url);
+        if (stale) fetcher.setValidators(stale->etag, stale->last_modified);
+
+        bool ok = fetcher.fetch();
+        const auto& headers = fetcher.getResponseHeaders();
+        long max_age = maxAge(headers.cache_control);
+        auto expires = CachedPlaylist::Clock::now() +
+                       (max_age >= 0 ? std::chrono::seconds(max_age) : options_.default_max_age);
+
+        if (!ok && fetcher.notModified() && stale) {
+            ++revalidations_;
+            Entry entry = stale->revalidated(expires);
+            store(entry, false);
+            refreshOnDisk(*entry);
+            return entry;
+        }
+        if (!ok) {
+            if (stale) return stale;     // serve stale rather than fail
+            throw std::runtime_error("Failed to fetch " + url + " (HTTP status " +
+                                     std::to_string(fetcher.getStatusCode()) + ")");
+        }
+
+        ++misses_;
+        auto entry = std::make_shared<CachedPlaylist>();
+        entry->url           = url;
+        entry->body          = fetcher.takeResponse();
+        entry->etag          = headers.etag;
+        entry->last_modified = headers.last_modified;
+        entry->expires       = expires;
+        if (headers.cache_control.find("no-store") == std::string::npos) store(entry, true);
+        return entry;
+    }
+
+    // Inserts into the memory tier (evicting the least recently used) and optionally to disk.
+    void store(const Entry& entry, bool write_to_disk) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = index_.find(entry->url);
+            if (it != index_.end()) {
+                lru_.erase(it->second);
+                index_.erase(it);
+            }
+            lru_.push_front(entry);
+            index_.emplace(entry->url, lru_.begin());
+            while (lru_.size() > options_.memory_capacity) {
+                index_.erase(lru_.back()->url);
+                lru_.pop_back();
+                ++evictions_;
+            }
+        }
+        if (write_to_disk) saveToDisk(*entry);
+    }
+
+    /*  Disk tier: one file per URL, named by a stable hash of the URL */
+
+    static constexpr std::string_view kDiskMagic = "HLSCACHE 2";
+    static constexpr size_t           kExpiryDigits = 20;       // fixed width, so it can be rewritten in place
+
+    std::filesystem::path diskPath(const std::string& url) const {
+        uint64_t hash = 14695981039346656037ull;        // FNV-1a, stable across builds
+        for (unsigned char c : url) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        std::ostringstream name;
+        name << std::hex << hash << ".entry";
+        return options_.disk_directory / name.str();
+    }
+
+    // Expiry line: seconds since the epoch, zero-padded to kExpiryDigits
+    static std::string expiryField(CachedPlaylist::Clock::time_point expires) {
+        long long seconds = std::chrono::duration_cast<std::chrono::seconds>(expires.time_since_epoch()).count();
+        std::string digits = std::to_string(std::max(seconds, 0LL));
+        return std::string(kExpiryDigits - digits.size(), '0') + digits;
+    }
+
+    // Entry file layout: magic and expiry lines, url, etag and last-modified lines, then the body.
+    void saveToDisk(const CachedPlaylist& entry) const {
+        if (options_.disk_directory.empty()) return;
+
+        auto path = diskPath(entry.url);
+        auto temp = path;
+        temp += ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        bool written = false;
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            if (!out) return;       // the disk tier is best effort
+            out << kDiskMagic << '\n' << expiryField(entry.expires) << '\n'
+                << entry.url << '\n' << entry.etag << '\n' << entry.last_modified << '\n' << entry.body;
+            out.close();
+            written = !out.fail();
+        }
+        std::error_code ec;
+        if (!written) {
+            std::filesystem::remove(temp, ec);      // e.g. the disk is full
+            return;
+        }
+        std::filesystem::rename(temp, path, ec);    // readers never see a partial entry
+        if (ec) std::filesystem::remove(temp, ec);
+    }
+
+    // After a 304: rewrites only the expiry line of the entry file if it still holds this response
+    // (same URL and validators), writes the whole entry otherwise.
+    void refreshOnDisk(const CachedPlaylist& entry) const {
+        if (options_.disk_directory.empty()) return;
+        {
+            std::fstream file(diskPath(entry.url), std::ios::in | std::ios::out | std::ios::binary);
+            std::string magic, expires, stored_url, etag, last_modified;
+            std::getline(file, magic);
+            std::getline(file, expires);
+            std::getline(file, stored_url);
+            std::getline(file, etag);
+            std::getline(file, last_modified);
+            if (file && magic == kDiskMagic && expires.size() == kExpiryDigits && stored_url == entry.url &&
+                etag == entry.etag && last_modified == entry.last_modified) {
+                file.seekp(static_cast<std::streamoff>(kDiskMagic.size() + 1));
+                file << expiryField(entry.expires);
+                file.close();
+                if (!file.fail()) return;
+            }
+        }
+        saveToDisk(entry);
+    }
+
+    Entry loadFromDisk(const std::string& url) const {
+        if (options_.disk_directory.empty()) return nullptr;
+
+        const auto path = diskPath(url);
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return nullptr;
+
+        std::string magic, stored_url, expires;
+        auto entry = std::make_shared<CachedPlaylist>();
+        std::getline(in, magic);
+        std::getline(in, expires);
+        std::getline(in, stored_url);
+        std::getline(in, entry->etag);
+        std::getline(in, entry->last_modified);
+        long long expires_seconds = 0;
+        auto [end, error] = std::from_chars(expires.data(), expires.data() + expires.size(), expires_seconds);
+        if (!in || magic != kDiskMagic || error != std::errc() || end != expires.data() + expires.size()) {
+            // Truncated or corrupt entry: drop it, the next fetch writes a new one
+            in.close();
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            return nullptr;
+        }
+        if (stored_url != url) return nullptr;      // another URL with the same hash
+
+        entry->url = url;
+        entry->expires = CachedPlaylist::Clock::time_point(std::chrono::seconds(expires_seconds));
+        entry->body.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return entry;
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_PLAYLISTCACHE_H
@@ -0,0 +1,273 @@
+//
+// Structural diff between two versions of a master playlist
+//
+
+#ifndef HLS_FETCH_AND_SORT_PLAYLISTDIFF_H
+#define HLS_FETCH_AND_SORT_PLAYLISTDIFF_H
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "M3U8Parser.h"
+#include "PlaylistSnapshot.h"
+
+/**
+ * @brief What changed between two versions of a master playlist.
+ *
+ * Elements are matched by identity: variants and I-frame streams by URI, renditions by
+ * GROUP-ID and NAME; repeated identities pair up in playlist order. A matched element with a
+ * different tag line (or URI line) is CHANGED, unmatched ones are ADDED or REMOVED. Unchanged
+ * elements that no longer appear in their previous relative order (e.g. after the sort spec
+ * changed) mark the diff reordered. Headers and the passthrough tags of the sections are
+ * compared as a whole.
+ *
+ * The previous version is a parser (e.g. the previous output parsed again) or, cheaper still,
+ * the PlaylistSnapshot taken of it.
+ */
+class PlaylistDiff {
+public:
+    struct Change {
+        enum class Kind { ADDED, REMOVED, CHANGED };
+
+        ParserType  section;
+        Kind        kind;
+        std::string key;            // URI, or GROUP-ID and NAME of a rendition
+        std::string before;         // tag line, empty if ADDED
+        std::string after;          // tag line, empty if REMOVED
+    };
+
+    std::vector<Change> changes;    // by section; removed elements in previous order, the rest in new playlist order
+    bool headers_changed     = false;
+    bool passthrough_changed = false;
+    bool reordered           = false;   // elements are in a different order, beyond the changes
+
+    bool empty() const {
+        return changes.empty() && !headers_changed && !passthrough_changed && !reordered;
+    }
+
+    size_t count(Change::Kind kind) const {
+        return static_cast<size_t>(std::count_if(changes.begin(), changes.end(),
+                                                 [kind](const Change& change) { return change.kind == kind; }));
+    }
+
+    // One line for logs, e.g. "1 added, 0 removed, 2 changed, headers changed"
+    std::string summary() const {
+        std::string text = std::to_string(count(Change::Kind::ADDED)) + " added, " +
+                           std::to_string(count(Change::Kind::REMOVED)) + " removed, " +
+                           std::to_string(count(Change::Kind::CHANGED)) + " changed";
+        if (headers_changed)     text += ", headers changed";
+        if (passthrough_changed) text += ", passthrough tags changed";
+        if (reordered)           text += ", reordered";
+        return text;
+    }
+
+    /**
+     * @brief Every change, for alerts: a "<kind> <section> <key>" line followed by the tag
+     * line before ("- ") and after ("+ ") the change.
+     */
+    std::string describe() const {
+        static constexpr std::string_view kKinds[]    = {"added", "removed", "changed"};
+        static constexpr std::string_view kSections[] = {"stream", "audio", "iframe"};
+        std::string text;
+        for (const Change& change : changes) {
+            text.append(kKinds[static_cast<size_t>(change.kind)]).append(" ")
+                .append(kSections[static_cast<size_t>(change.section)]).append(" ")
+                .append(change.key).append("\n");
+            if (!change.before.empty()) text.append("- ").append(change.before).append("\n");
+            if (!change.after.empty())  text.append("+ ").append(change.after).append("\n");
+        }
+        if (headers_changed)     text += "changed headers\n";
+        if (passthrough_changed) text += "changed passthrough tags\n";
+        if (reordered)           text += "reordered elements\n";
+        return text;
+    }
+
+    // Differences from before (a parser or PlaylistSnapshot) to after; neither is modified.
+    template<typename Previous, typename String>
+    static PlaylistDiff compare(const Previous& before, const BasicM3U8Parser<String>& after) {
+        PlaylistDiff diff;
+        diff.compareTags(before, after);
+        for (ParserType type : {ParserType::STREAM, ParserType::AUDIO, ParserType::IFRAME}) {
+            std::vector<uint32_t> kept = diff.match(type, entries(before, type), entries(after, type));
+            diff.reordered |= !std::is_sorted(kept.begin(), kept.end());
+        }
+        return diff;
+    }
+
+private:
+    // Identity of an element: URI, or GROUP-ID and NAME
+    using Identity = std::pair<std::string_view, std::string_view>;
+
+    // An element as far as pairing goes. Paired elements share their URI (the identity, or
+    // part of the tag line), so they are equal if their tag lines are.
+    struct Entry {
+        Identity         identity;
+        size_t           hash;
+        std::string_view line;
+    };
+
+    static Entry entry(std::string_view first, std::string_view second, std::string_view line) {
+        const std::hash<std::string_view> hash;
+        return {{first, second}, hash(first) * 31 + hash(second), line};
+    }
+
+    template<typename String>
+    static std::vector<Entry> entries(const BasicM3U8Parser<String>& parser, ParserType type) {
+        std::vector<Entry> result;
+        auto add = [&result](const auto& elements) {
+            result.reserve(elements.size());
+            for (const auto& element : elements) {
+                if constexpr (requires { element.name; }) result.push_back(entry(element.id, element.name, element.manifest_line));
+                else                                      result.push_back(entry(element.uri, {}, element.manifest_line));
+            }
+        };
+        if (type == ParserType::STREAM)     add(parser.stream_parser_.variants_);
+        else if (type == ParserType::AUDIO) add(parser.audio_parser_.audio_tracks_);
+        else                                add(parser.iframe_parser_.iframes_);
+        return result;
+    }
+
+    static std::vector<Entry> entries(const PlaylistSnapshot& snapshot, ParserType type) {
+        std::vector<Entry> result;
+        auto add = [&result, &snapshot](auto records) {
+            result.reserve(records.size());
+            for (const auto& record : records) {
+                if constexpr (requires { record.name; }) {
+                    result.push_back(entry(snapshot.string(record.id), snapshot.string(record.name),
+                                           snapshot.string(record.manifest_line)));
+                } else {
+                    result.push_back(entry(snapshot.string(record.uri), {}, snapshot.string(record.manifest_line)));
+                }
+            }
+        };
+        if (type == ParserType::STREAM)     add(snapshot.variants());
+        else if (type == ParserType::AUDIO) add(snapshot.audioTracks());
+        else                                add(snapshot.iframes());
+        return result;
+    }
+
+    // Header lines, and the passthrough tags of a section as (slot, within, line)
+    using Tag = std::tuple<uint32_t, bool, std::string_view>;
+
+    template<typename String>
+    static std::vector<std::string_view> headers(const BasicM3U8Parser<String>& parser) {
+        return {parser.headers_.begin(), parser.headers_.end()};
+    }
+
+    static std::vector<std::string_view> headers(const PlaylistSnapshot& snapshot) {
+        std::vector<std::string_view> result;
+        for (SnapshotString header : snapshot.headers()) result.push_back(snapshot.string(header));
+        return result;
+    }
+
+    template<typename String>
+    static std::vector<Tag> passthrough(const BasicM3U8Parser<String>& parser, ParserType type) {
+        std::vector<Tag> result;
+        for (const auto& tag : parser.passthrough_[static_cast<size_t>(type)]) {
+            result.emplace_back(tag.slot, tag.within, tag.line);
+        }
+        return result;
+    }
+
+    static std::vector<Tag> passthrough(const PlaylistSnapshot& snapshot, ParserType type) {
+        std::vector<Tag> result;
+        for (const SnapshotPassthrough& tag : snapshot.passthrough(type)) {
+            result.emplace_back(tag.slot, tag.within != 0, snapshot.string(tag.line));
+        }
+        return result;
+    }
+
+    static std::string describeIdentity(const Identity& identity, ParserType section) {
+        if (section != ParserType::AUDIO) return std::string(identity.first);
+        return "GROUP-ID=\"" + std::string(identity.first) + "\",NAME=\"" + std::string(identity.second) + "\"";
+    }
+
+    template<typename Previous, typename Next>
+    void compareTags(const Previous& before, const Next& after) {
+        headers_changed = headers(before) != headers(after);
+        for (ParserType type : {ParserType::STREAM, ParserType::AUDIO, ParserType::IFRAME}) {
+            passthrough_changed |= passthrough(before, type) != passthrough(after, type);
+        }
+    }
+
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    // Open-addressing table slot of one identity: its first previous position, which probes
+    // compare against, and the next one not paired yet (kNone once all are)
+    struct Slot {
+        uint32_t first = kNone;
+        uint32_t next  = kNone;
+        uint32_t hash  = 0;         // low bits of the identity's hash, to skip most comparisons
+    };
+
+    /**
+     * @brief Pairs the elements of one section and records the differences.
+     * @return Positions in after of the unchanged elements, in their order in before.
+     */
+    std::vector<uint32_t> match(ParserType section, const std::vector<Entry>& before, const std::vector<Entry>& after) {
+        // Previous positions by identity; repeated identities are chained in playlist order
+        const size_t mask = std::bit_ceil(2 * before.size() + 1) - 1;
+        std::vector<Slot> table(mask + 1);
+        std::vector<uint32_t> chain(before.size(), kNone);
+        auto find = [&table, &before, mask](const Entry& entry) -> Slot& {
+            const auto hash = static_cast<uint32_t>(entry.hash);
+            for (size_t probe = entry.hash & mask;; probe = (probe + 1) & mask) {
+                Slot& slot = table[probe];
+                if (slot.first == kNone) {
+                    slot.hash = hash;
+                    return slot;
+                }
+                if (slot.hash == hash && before[slot.first].identity == entry.identity) return slot;
+            }
+        };
+        for (uint32_t i = static_cast<uint32_t>(before.size()); i-- > 0;) {
+            Slot& slot = find(before[i]);
+            chain[i]   = slot.next;
+            slot.first = slot.next = i;
+        }
+
+        constexpr uint32_t kChanged = kNone - 1;
+        std::vector<uint32_t> partner(before.size(), kNone);       // unchanged: position in after
+        std::vector<Change> found;
+        for (uint32_t i = 0; i < after.size(); ++i) {
+            const Entry& entry = after[i];
+            Slot& slot = find(entry);
+            if (slot.next == kNone) {
+                found.push_back({section, Change::Kind::ADDED, describeIdentity(entry.identity, section), {},
+                                 std::string(entry.line)});
+                continue;
+            }
+            const uint32_t previous = slot.next;
+            slot.next = chain[previous];
+            if (before[previous].line == entry.line) {
+                partner[previous] = i;
+            } else {
+                partner[previous] = kChanged;
+                found.push_back({section, Change::Kind::CHANGED, describeIdentity(entry.identity, section),
+                                 std::string(before[previous].line), std::string(entry.line)});
+            }
+        }
+
+        std::vector<uint32_t> kept;
+        kept.reserve(before.size());
+        for (uint32_t i = 0; i < before.size(); ++i) {
+            if (partner[i] == kNone) {
+                changes.push_back({section, Change::Kind::REMOVED, describeIdentity(before[i].identity, section),
+                                   std::string(before[i].line), {}});
+            } else if (partner[i] != kChanged) {
+                kept.push_back(partner[i]);
+            }
+        }
+        changes.insert(changes.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+        return kept;
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_PLAYLISTDIFF_H
@@ -0,0 +1,397 @@
+//
+// Long-running HTTP service that serves sorted master playlists
+//
+
+#ifndef HLS_FETCH_AND_SORT_PLAYLISTSERVER_H
+#define HLS_FETCH_AND_SORT_PLAYLISTSERVER_H
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "HLSUrl.h"
+#include "M3U8Parser.h"
+#include "PipelineMetrics.h"
+#include "PlaylistCache.h"
+#include "SortSpec.h"
+#include "ThreadPool.h"
+
+/**
+ * @brief Serves sorted master playlists over plain HTTP/1.1, for local callers.
+ *
+ *     GET /sort?url=<master url>&stream=RESOLUTION,-BANDWIDTH&audio=ID&iframe=CODECS
+ *
+ * returns M3U8Parser::stringify() of the playlist at url, sorted by the given keys (the
+ * SortSpec syntax of one group per parameter; groups without a parameter keep playlist
+ * order, and a request without any sorts by SortSpec::kDefault). Playlists come from a
+ * PlaylistCache, so concurrent requests for one URL share a single fetch and the parsed
+ * playlist stays warm for later requests, which only copy and sort it.
+ *
+ * GET /metrics returns request, cache and per-stage counters as Prometheus text.
+ *
+ * The calling thread of run() accepts connections; each connection is served on a
+ * ThreadPool worker, with keep-alive, until the client closes it or stays idle too long.
+ */
+class PlaylistServer {
+public:
+    struct Options {
+        std::string           address = "127.0.0.1";
+        uint16_t              port    = 8080;           // 0 = any free port, see port()
+        size_t                threads = 16;             // connections served concurrently
+        int                   idle_timeout_ms = 5000;   // keep-alive connections
+        PlaylistCache::Options cache;
+    };
+
+    PlaylistServer() : PlaylistServer(Options()) {}
+
+    // Binds and listens right away, so port() is known before run().
+    // @throws std::runtime_error if the address cannot be bound.
+    explicit PlaylistServer(Options options)
+        : options_(std::move(options)), cache_(options_.cache),
+          metrics_(PipelineMetrics::Options{.keep_records = false}) {
+        listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) throw std::runtime_error(std::string("Could not create socket: ") + std::strerror(errno));
+
+        int reuse = 1;
+        ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port   = htons(options_.port);
+        if (::inet_pton(AF_INET, options_.address.c_str(), &addr.sin_addr) != 1) {
+            ::close(listen_fd_);
+            throw std::runtime_error("Invalid listen address " + options_.address);
+        }
+        if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+            ::listen(listen_fd_, SOMAXCONN) < 0) {
+            int error = errno;
+            ::close(listen_fd_);
+            throw std::runtime_error("Could not listen on " + options_.address + ":" +
+                                     std::to_string(options_.port) + ": " + std::strerror(error));
+        }
+        socklen_t length = sizeof(addr);
+        ::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &length);
+        port_ = ntohs(addr.sin_port);
+    }
+
+    ~PlaylistServer() {
+        ::close(listen_fd_);
+    }
+
+    PlaylistServer(const PlaylistServer&) = delete;
+    PlaylistServer& operator=(const PlaylistServer&) = delete;
+
+    uint16_t port() const { return port_; }
+
+    // Accepts and serves connections until stop(); open connections are finished first.
+    void run() {
+        ThreadPool pool(options_.threads);
+        while (!stopping_) {
+            pollfd listener{listen_fd_, POLLIN, 0};
+            if (::poll(&listener, 1, kPollSliceMs) <= 0) continue;
+
+            int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) continue;
+            pool.submit([this, fd] {
+                serveConnection(fd);
+                ::close(fd);
+            });
+        }
+        pool.wait();
+    }
+
+    // Makes run() return. Async-signal-safe.
+    void stop() { stopping_ = true; }
+
+    PlaylistCache& cache() { return cache_; }
+
+private:
+    static constexpr int    kPollSliceMs     = 250;         // how often blocked threads check stop()
+    static constexpr size_t kMaxRequestBytes = 16 * 1024;
+    static constexpr size_t kArenaBytes      = 256 * 1024;     // initial arena block per worker
+
+    struct Request {
+        std::string method;
+        std::string target;
+        bool        keep_alive = true;
+    };
+
+    struct Response {
+        int         status = 200;
+        std::string content_type = "application/vnd.apple.mpegurl";
+        std::string body;
+    };
+
+    Options           options_;
+    PlaylistCache     cache_;
+    PipelineMetrics   metrics_;
+    int               listen_fd_ = -1;
+    uint16_t          port_ = 0;
+    std::atomic<bool> stopping_{false};
+
+    std::mutex                 status_mutex_;
+    std::map<int, uint64_t>    responses_;         // count per status code
+
+    void serveConnection(int fd) {
+        std::string buffer;
+        while (!stopping_) {
+            Request request;
+            if (!readRequest(fd, buffer, request)) return;
+
+            Response response = handle(request);
+            {
+                std::lock_guard<std::mutex> lock(status_mutex_);
+                ++responses_[response.status];
+            }
+            if (!sendResponse(fd, response, request.keep_alive) || !request.keep_alive) return;
+        }
+    }
+
+    /**
+     * @brief Reads the next request head from fd; buffer carries bytes across requests.
+     * @return false when the connection is closed, idle too long or not speaking HTTP.
+     */
+    bool readRequest(int fd, std::string& buffer, Request& request) {
+        size_t end;
+        int idle_ms = 0;
+        while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (buffer.size() > kMaxRequestBytes || stopping_) return false;
+
+            pollfd connection{fd, POLLIN, 0};
+            int ready = ::poll(&connection, 1, kPollSliceMs);
+            if (ready < 0 && errno != EINTR) return false;
+            if (ready <= 0) {
+                if ((idle_ms += kPollSliceMs) >= options_.idle_timeout_ms) return false;
+                continue;
+            }
+            char chunk[4096];
+            ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) return false;
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+
+        std::string_view head(buffer.data(), end);
+        std::string_view line = head.substr(0, head.find("\r\n"));
+        size_t first = line.find(' ');
+        size_t last  = line.rfind(' ');
+        if (first == std::string_view::npos || first == last) return false;
+        request.method = line.substr(0, first);
+        request.target = line.substr(first + 1, last - first - 1);
+        std::string_view version = line.substr(last + 1);
+
+        // HTTP/1.1 keeps the connection by default, HTTP/1.0 only when asked to
+        std::string connection = lowercase(header(head, "connection"));
+        request.keep_alive = version == "HTTP/1.1" ? connection != "close" : connection == "keep-alive";
+
+        // Bodies are not expected; rather than skipping one, close the connection after responding
+        std::string_view length = header(head, "content-length");
+        if (!length.empty() && length != "0") request.keep_alive = false;
+        buffer.erase(0, end + 4);
+        return true;
+    }
+
+    Response handle(const Request& request) {
+        if (request.method != "GET") return error(405, "Only GET is supported");
+
+        std::string_view target = request.target;
+        std::string_view path   = target.substr(0, target.find('?'));
+        std::string_view query  = path.size() < target.size() ? target.substr(path.size() + 1) : std::string_view();
+
+        if (path == "/metrics") return {200, "text/plain; version=0.0.4", metricsText()};
+        if (path != "/sort")    return error(404, "Unknown path " + std::string(path));
+
+        std::string url;
+        SortSpec    spec;
+        bool        has_keys = false;
+        try {
+            while (!query.empty()) {
+                size_t amp = query.find('&');
+                std::string_view pair = query.substr(0, amp);
+                query = (amp == std::string_view::npos) ? std::string_view() : query.substr(amp + 1);
+                if (pair.empty()) continue;
+
+                size_t eq = pair.find('=');
+                std::string_view name  = pair.substr(0, eq);
+                std::string      value = eq == std::string_view::npos ? "" : percentDecode(pair.substr(eq + 1));
+                if (name == "url") {
+                    url = std::move(value);
+                    continue;
+                }
+                std::vector<HLSTagParser::SortKey>* keys =
+                        name == "stream" ? &spec.stream :
+                        name == "audio"  ? &spec.audio  :
+                        name == "iframe" ? &spec.iframe : nullptr;
+                if (!keys) throw std::invalid_argument("Unknown parameter " + std::string(name));
+                *keys = SortSpec::parseKeys(value);
+                has_keys = true;
+            }
+        } catch (const std::invalid_argument& e) {
+            return error(400, e.what());
+        }
+        if (url.empty()) return error(400, "Missing url parameter");
+        if (!HLSUrl::isHttp(url)) return error(400, "Only http and https URLs are supported");
+        if (!has_keys) spec = SortSpec::parse(SortSpec::kDefault);
+
+        PipelineMetrics::Record record;
+        record.source = url;
+        Response response;
+        try {
+            std::shared_ptr<const CachedPlaylist> entry = cache_.get(url);
+            record.bytes_in = entry->body.size();
+
+            // The request's copy of the parsed playlist and its sort scratch live in an arena
+            thread_local std::unique_ptr<std::byte[]> arena_block(new std::byte[kArenaBytes]);
+            std::pmr::monotonic_buffer_resource arena(arena_block.get(), kArenaBytes);
+
+            PipelineMetrics::Stopwatch stopwatch;
+            M3U8ViewParser parser(&arena);
+            parser = *entry->parsed();
+            record.elements = {parser.select<ParserType::STREAM>().elements().size(),
+                               parser.select<ParserType::AUDIO>().elements().size(),
+                               parser.select<ParserType::IFRAME>().elements().size()};
+            try {
+                spec.apply(parser);
+            } catch (const std::invalid_argument& e) {
+                response = error(400, e.what());
+            }
+            record.sort_ns = stopwatch.elapsedNanos();
+
+            if (response.status == 200) {
+                stopwatch.restart();
+                response.body    = parser.stringify();
+                record.write_ns  = stopwatch.elapsedNanos();
+                record.bytes_out = response.body.size();
+            }
+        } catch (const std::exception& e) {
+            response = error(502, e.what());
+        }
+        record.ok = response.status == 200;
+        if (!record.ok) record.error = response.body;
+        metrics_.record(std::move(record));
+        return response;
+    }
+
+    bool sendResponse(int fd, const Response& response, bool keep_alive) {
+        std::string head = "HTTP/1.1 " + std::to_string(response.status) + " " + reason(response.status) + "\r\n" +
+                           "Content-Type: " + response.content_type + "\r\n" +
+                           "Content-Length: " + std::to_string(response.body.size()) + "\r\n" +
+                           "Connection: " + (keep_alive ? "keep-alive" : "close") + "\r\n\r\n";
+        return sendAll(fd, head) && sendAll(fd, response.body);
+    }
+
+    static bool sendAll(int fd, std::string_view data) {
+        while (!data.empty()) {
+            ssize_t n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data.remove_prefix(static_cast<size_t>(n));
+        }
+        return true;
+    }
+
+    std::string metricsText() {
+        std::string out = metrics_.toPrometheus();
+        out += "# HELP hls_http_responses_total Responses sent, by status code.\n"
+               "# TYPE hls_http_responses_total counter\n";
+        {
+            std::lock_guard<std::mutex> lock(status_mutex_);
+            for (auto [status, count] : responses_) {
+                out += "hls_http_responses_total{code=\"" + std::to_string(status) + "\"} " + std::to_string(count) + "\n";
+            }
+        }
+        PlaylistCache::Stats stats = cache_.stats();
+        out += "# HELP hls_cache_events_total Playlist cache lookups and evictions, by outcome.\n"
+               "# TYPE hls_cache_events_total counter\n";
+        for (auto [event, count] : {std::pair{"memory_hit", stats.memory_hits}, std::pair{"disk_hit", stats.disk_hits},
+                                    std::pair{"miss", stats.misses}, std::pair{"revalidation", stats.revalidations},
+                                    std::pair{"eviction", stats.evictions}}) {
+            out += std::string("hls_cache_events_total{event=\"") + event + "\"} " + std::to_string(count) + "\n";
+        }
+        out += "# HELP hls_cache_entries Playlists in the memory tier of the cache.\n# TYPE hls_cache_entries gauge\n";
+        out += "hls_cache_entries " + std::to_string(cache_.size()) + "\n";
+        return out;
+    }
+
+    static Response error(int status, const std::string& message) {
+        return {status, "text/plain", message + "\n"};
+    }
+
+    static const char* reason(int status) {
+        switch (status) {
+            case 200: return "OK";
+            case 400: return "Bad Request";
+            case 404: return "Not Found";
+            case 405: return "Method Not Allowed";
+            case 502: return "Bad Gateway";
+            default:  return "Error";
+        }
+    }
+
+    // Value of the first header named name (lowercase), or empty.
+    static std::string_view header(std::string_view head, std::string_view name) {
+        size_t pos = head.find("\r\n");
+        while (pos != std::string_view::npos) {
+            size_t next = head.find("\r\n", pos + 2);
+            std::string_view line = head.substr(pos + 2, next == std::string_view::npos ? std::string_view::npos
+                                                                                        : next - pos - 2);
+            size_t colon = line.find(':');
+            if (colon == name.size() && lowercase(line.substr(0, colon)) == name) {
+                std::string_view value = line.substr(colon + 1);
+                while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+                while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+                return value;
+            }
+            pos = next;
+        }
+        return {};
+    }
+
+    static std::string lowercase(std::string_view text) {
+        std::string out(text);
+        for (char& c : out) {
+            if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+        }
+        return out;
+    }
+
+    // Decodes %XX escapes and '+' of a query parameter value.
+    static std::string percentDecode(std::string_view text) {
+        auto hex = [](char c) -> int {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        };
+        std::string out;
+        out.reserve(text.size());
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (text[i] == '+') {
+                out += ' ';
+            } else if (text[i] == '%' && i + 2 < text.size() && hex(text[i + 1]) >= 0 && hex(text[i + 2]) >= 0) {
+                out += static_cast<char>(hex(text[i + 1]) * 16 + hex(text[i + 2]));
+                i += 2;
+            } else {
+                out += text[i];
+            }
+        }
+        return out;
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_PLAYLISTSERVER_H
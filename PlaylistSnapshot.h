@@ -0,0 +1,486 @@
+//
+// Memory-mappable binary snapshot of a parsed master playlist
+//
+
+#ifndef HLS_FETCH_AND_SORT_PLAYLISTSNAPSHOT_H
+#define HLS_FETCH_AND_SORT_PLAYLISTSNAPSHOT_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "M3U8Parser.h"
+#include "MappedFile.h"
+
+// A string of a snapshot: a byte range of its string pool
+struct SnapshotString {
+    uint32_t offset;
+    uint32_t size;
+};
+
+// Element records, laid out as stored. Members mirror the parser's elements; AttributeIds
+// name values of the snapshot's dictionary of the same section (PlaylistSnapshot::value()).
+struct SnapshotVariant {
+    int32_t        bandwidth;
+    int32_t        avg_bandwidth;
+    AttributeId    codecs;
+    int32_t        resolution_height;
+    AttributeId    frame_rate;
+    AttributeId    video_range;
+    AttributeId    audio;
+    AttributeId    closed_captions;
+    SnapshotString uri;
+    SnapshotString manifest_line;
+};
+
+struct SnapshotMediaGroup {
+    SnapshotString id;
+    SnapshotString name;
+    AttributeId    language;
+    AttributeId    default_;
+    AttributeId    autoselect;
+    int32_t        channel_count;
+    SnapshotString uri;
+    SnapshotString manifest_line;
+};
+
+struct SnapshotIFrame {
+    int32_t        bandwidth;
+    AttributeId    codecs;
+    int32_t        resolution_height;
+    AttributeId    video_range;
+    SnapshotString uri;
+    SnapshotString manifest_line;
+};
+
+// Tag or comment without handler, emitted after slot elements of its section, or between the
+// tag line and URI line of the variant in that slot if within is set
+struct SnapshotPassthrough {
+    SnapshotString line;
+    uint32_t       slot;
+    uint32_t       within;
+};
+
+static_assert(sizeof(SnapshotString) == 8 && sizeof(SnapshotPassthrough) == 16);
+static_assert(sizeof(SnapshotVariant) == 48 && sizeof(SnapshotMediaGroup) == 48 && sizeof(SnapshotIFrame) == 32);
+static_assert(std::is_trivially_copyable_v<SnapshotVariant> && std::is_trivially_copyable_v<SnapshotMediaGroup> &&
+              std::is_trivially_copyable_v<SnapshotIFrame> && std::is_trivially_copyable_v<SnapshotPassthrough>);
+
+/**
+ * @brief Read-only view of a parsed master playlist stored in the snapshot format.
+ *
+ * A snapshot holds the parser state (headers, passthrough tags, the elements of every section
+ * in their current order and the interned attribute tables) as fixed-size records followed by
+ * one string pool, so it is queried where it lies: opening a file maps it and checks that every
+ * section and string lies within it, nothing is parsed or copied. serialize() reproduces the
+ * parser's output byte for byte.
+ *
+ * Layout (host byte order, every section 8-byte aligned):
+ *
+ *     Header     magic "HLSSNAP", version, byte order mark, total size, {offset, count} per Section
+ *     sections   HEADERS, passthrough per section, VARIANTS, AUDIO_TRACKS, IFRAMES (records),
+ *                STREAM_VALUES, AUDIO_VALUES, IFRAME_VALUES (SnapshotStrings by AttributeId)
+ *     STRINGS    string pool; strings are not terminated
+ *
+ * A snapshot is meant to be shared by processes of one host; files of another version or byte
+ * order are rejected. Dictionaries are stored in value order, so value lookups (id()) are a
+ * binary search and comparing ids compares values, as in the parser.
+ *
+ * Example:
+ *
+ *     HLSWriter::writeFile("master.m3u8.snap", SnapshotBuilder(parser));
+ *     ...
+ *     auto snapshot = PlaylistSnapshot::open("master.m3u8.snap");
+ *     auto hevc = snapshot.id(ParserType::STREAM, "hvc1.2.4.L150.90");
+ *     for (const SnapshotVariant& variant : snapshot.variants()) {
+ *         if (hevc && variant.codecs == *hevc) std::cout << snapshot.string(variant.uri) << '\n';
+ *     }
+ */
+class PlaylistSnapshot {
+public:
+    static constexpr std::array<char, 8> kMagic   = {'H', 'L', 'S', 'S', 'N', 'A', 'P', '\0'};
+    static constexpr uint32_t            kVersion = 2;
+    static constexpr uint32_t            kByteOrderMark = 0x01020304;     // reads differently on another byte order
+
+    enum Section : uint32_t {
+        HEADERS,
+        STREAM_PASSTHROUGH, AUDIO_PASSTHROUGH, IFRAME_PASSTHROUGH,     // by ParserType
+        VARIANTS, AUDIO_TRACKS, IFRAMES,
+        STREAM_VALUES, AUDIO_VALUES, IFRAME_VALUES,                    // by ParserType
+        STRINGS
+    };
+    static constexpr size_t kSectionCount = STRINGS + 1;
+
+    struct SectionEntry {
+        uint64_t offset;     // from the start of the snapshot
+        uint64_t count;      // records, or bytes of STRINGS
+    };
+
+    struct Header {
+        std::array<char, 8> magic;
+        uint32_t            version;
+        uint32_t            byte_order;
+        uint64_t            size;
+        SectionEntry        sections[kSectionCount];
+    };
+    static_assert(sizeof(Header) == 24 + kSectionCount * sizeof(SectionEntry));
+
+    // Size of one record of each section
+    static constexpr std::array<size_t, kSectionCount> kRecordSize = {
+        sizeof(SnapshotString),
+        sizeof(SnapshotPassthrough), sizeof(SnapshotPassthrough), sizeof(SnapshotPassthrough),
+        sizeof(SnapshotVariant), sizeof(SnapshotMediaGroup), sizeof(SnapshotIFrame),
+        sizeof(SnapshotString), sizeof(SnapshotString), sizeof(SnapshotString),
+        1
+    };
+
+    static constexpr size_t kAlignment = 8;
+
+    /**
+     * @brief Views bytes as a snapshot, keeping owner (e.g. the MappedFile) alive with it.
+     *
+     * bytes must be 8-byte aligned, as mappings and heap blocks are.
+     * @throws std::runtime_error if bytes are not a snapshot of this version and byte order,
+     *         or any section, string or AttributeId lies outside of it.
+     */
+    PlaylistSnapshot(std::string_view bytes, std::shared_ptr<const void> owner)
+        : owner_(std::move(owner)), data_(bytes.data()) {
+        validate(bytes);
+    }
+
+    // Maps the snapshot file at path.
+    static PlaylistSnapshot open(const std::string& path) {
+        auto file = std::make_shared<MappedFile>(path);
+        return PlaylistSnapshot(file->view(), file);
+    }
+
+    uint32_t version() const { return header().version; }
+    size_t size() const { return header().size; }
+
+    // Playlist-wide lines, starting with #EXTM3U
+    std::span<const SnapshotString> headers() const { return section<SnapshotString>(HEADERS); }
+
+    // Elements in the order the parser had them when the snapshot was taken
+    std::span<const SnapshotVariant>    variants() const    { return section<SnapshotVariant>(VARIANTS); }
+    std::span<const SnapshotMediaGroup> audioTracks() const { return section<SnapshotMediaGroup>(AUDIO_TRACKS); }
+    std::span<const SnapshotIFrame>     iframes() const     { return section<SnapshotIFrame>(IFRAMES); }
+
+    // Tags without handler of a section, with the number of elements preceding each
+    std::span<const SnapshotPassthrough> passthrough(ParserType type) const {
+        return section<SnapshotPassthrough>(static_cast<Section>(STREAM_PASSTHROUGH + static_cast<uint32_t>(type)));
+    }
+
+    std::string_view string(SnapshotString string) const {
+        return {data_ + header().sections[STRINGS].offset + string.offset, string.size};
+    }
+
+    // Value of an interned attribute of an element of section type, e.g. value(STREAM, variant.codecs)
+    std::string_view value(ParserType type, AttributeId id) const {
+        return string(values(type)[static_cast<uint32_t>(id)]);
+    }
+
+    // Id of value in the dictionary of section type, if any element has it.
+    std::optional<AttributeId> id(ParserType type, std::string_view value) const {
+        auto table = values(type);
+        auto it = std::lower_bound(table.begin(), table.end(), value,
+                                   [this](SnapshotString entry, std::string_view v) { return string(entry) < v; });
+        if (it == table.end() || string(*it) != value) return std::nullopt;
+        return AttributeId{static_cast<uint32_t>(it - table.begin())};
+    }
+
+    /**
+     * @brief Emits the playlist as the parser's serialize() did when the snapshot was taken.
+     *
+     * The pieces point into the snapshot's string pool.
+     */
+    template<typename Sink>
+    void serialize(Sink&& sink) const {
+        constexpr std::string_view newline = "\n";
+        auto line = [this, &sink](SnapshotString text) {
+            sink(string(text));
+            sink(newline);
+        };
+        auto emit_section = [&line](auto elements, std::span<const SnapshotPassthrough> passthrough, auto&& emit) {
+            auto next = passthrough.begin();
+            for (uint32_t slot = 0; slot < elements.size(); ++slot) {
+                for (; next != passthrough.end() && (next->slot < slot || (next->slot == slot && !next->within));
+                     ++next) line(next->line);
+                emit(elements[slot], [&] {
+                    for (; next != passthrough.end() && next->slot == slot && next->within; ++next) line(next->line);
+                });
+            }
+            for (; next != passthrough.end(); ++next) line(next->line);
+        };
+        for (SnapshotString header : headers()) line(header);
+        sink(newline);
+        emit_section(variants(), passthrough(ParserType::STREAM), [&line](const SnapshotVariant& variant, auto&& within) {
+            line(variant.manifest_line);
+            within();
+            line(variant.uri);
+        });
+        sink(newline);
+        emit_section(audioTracks(), passthrough(ParserType::AUDIO), [&line](const SnapshotMediaGroup& track, auto&&) {
+            line(track.manifest_line);
+        });
+        sink(newline);
+        emit_section(iframes(), passthrough(ParserType::IFRAME), [&line](const SnapshotIFrame& iframe, auto&&) {
+            line(iframe.manifest_line);
+        });
+        sink(newline);
+    }
+
+    // Exact size in bytes of the serialized playlist.
+    size_t serializedSize() const {
+        size_t size = 0;
+        serialize([&size](std::string_view piece) { size += piece.size(); });
+        return size;
+    }
+
+    std::string stringify() const {
+        std::string manifest;
+        manifest.reserve(serializedSize());
+        serialize([&manifest](std::string_view piece) { manifest.append(piece); });
+        return manifest;
+    }
+
+private:
+    std::shared_ptr<const void> owner_;
+    const char*                 data_;
+
+    const Header& header() const { return *reinterpret_cast<const Header*>(data_); }
+
+    template<typename Record>
+    std::span<const Record> section(Section id) const {
+        const SectionEntry& entry = header().sections[id];
+        return {reinterpret_cast<const Record*>(data_ + entry.offset), static_cast<size_t>(entry.count)};
+    }
+
+    std::span<const SnapshotString> values(ParserType type) const {
+        return section<SnapshotString>(static_cast<Section>(STREAM_VALUES + static_cast<uint32_t>(type)));
+    }
+
+    [[noreturn]] static void invalid(const std::string& reason) {
+        throw std::runtime_error("Invalid playlist snapshot: " + reason);
+    }
+
+    // Bounds-checks the header, every section, string and AttributeId once, so that the
+    // accessors need no checks.
+    void validate(std::string_view bytes) const {
+        if (reinterpret_cast<uintptr_t>(bytes.data()) % kAlignment != 0) invalid("data is not 8-byte aligned");
+        if (bytes.size() < sizeof(Header)) invalid("truncated header");
+        const Header& h = header();
+        if (h.magic != kMagic) invalid("bad magic");
+        if (h.byte_order != kByteOrderMark) invalid("written on a host of another byte order");
+        if (h.version != kVersion) {
+            invalid("version " + std::to_string(h.version) + ", expected " + std::to_string(kVersion));
+        }
+        if (h.size != bytes.size()) invalid("size mismatch, truncated file?");
+
+        for (size_t id = 0; id < kSectionCount; ++id) {
+            const SectionEntry& entry = h.sections[id];
+            if (entry.offset % kAlignment != 0 || entry.offset < sizeof(Header) || entry.offset > h.size ||
+                entry.count > (h.size - entry.offset) / kRecordSize[id]) {
+                invalid("section " + std::to_string(id) + " out of bounds");
+            }
+        }
+
+        const uint64_t pool = h.sections[STRINGS].count;
+        auto check = [pool](SnapshotString string) {
+            if (string.offset > pool || string.size > pool - string.offset) invalid("string out of bounds");
+        };
+        auto check_id = [this](ParserType type, AttributeId id) {
+            if (static_cast<uint32_t>(id) >= values(type).size()) invalid("attribute id out of bounds");
+        };
+
+        for (SnapshotString string : headers()) check(string);
+        for (ParserType type : {ParserType::STREAM, ParserType::AUDIO, ParserType::IFRAME}) {
+            for (const SnapshotPassthrough& tag : passthrough(type)) check(tag.line);
+            for (SnapshotString string : values(type)) check(string);
+        }
+        for (const SnapshotVariant& v : variants()) {
+            check(v.uri);
+            check(v.manifest_line);
+            for (AttributeId id : {v.codecs, v.frame_rate, v.video_range, v.audio, v.closed_captions}) {
+                check_id(ParserType::STREAM, id);
+            }
+        }
+        for (const SnapshotMediaGroup& g : audioTracks()) {
+            for (SnapshotString string : {g.id, g.name, g.uri, g.manifest_line}) check(string);
+            for (AttributeId id : {g.language, g.default_, g.autoselect}) check_id(ParserType::AUDIO, id);
+        }
+        for (const SnapshotIFrame& f : iframes()) {
+            check(f.uri);
+            check(f.manifest_line);
+            for (AttributeId id : {f.codecs, f.video_range}) check_id(ParserType::IFRAME, id);
+        }
+    }
+};
+
+/**
+ * @brief Lays out the state of a parsed playlist in the PlaylistSnapshot format.
+ *
+ * The builder collects the fixed-size records and references the parser's strings, which
+ * serialize() emits as pieces like the parser's own serialize(), so the pool is never copied
+ * before it is written (HLSWriter::writeTo(fd, builder) gathers it with writev). The parser
+ * must outlive the builder and not be modified meanwhile. Strings contained in their tag line
+ * (URI, GROUP-ID and NAME of media groups, URI of I-frame streams) share the line's bytes.
+ *
+ * @throws std::runtime_error if the parser was not finish()ed, std::length_error if the
+ *         strings exceed 4 GiB.
+ */
+class SnapshotBuilder {
+public:
+    template<typename String>
+    explicit SnapshotBuilder(const BasicM3U8Parser<String>& parser) {
+        for (const auto& line : parser.headers_) headers_.push_back(add(line));
+        for (size_t type = 0; type < passthrough_.size(); ++type) {
+            for (const auto& tag : parser.passthrough_[type]) {
+                passthrough_[type].push_back({add(tag.line), tag.slot, tag.within});
+            }
+        }
+
+        const auto& streams = parser.stream_parser_;
+        const auto& audio   = parser.audio_parser_;
+        const auto& iframes = parser.iframe_parser_;
+        if (!streams.dictionary().ordered() || !audio.dictionary().ordered() || !iframes.dictionary().ordered()) {
+            throw std::runtime_error("Cannot snapshot a playlist that was not finished");
+        }
+        addValues(streams.dictionary(), values_[0]);
+        addValues(audio.dictionary(), values_[1]);
+        addValues(iframes.dictionary(), values_[2]);
+
+        variants_.reserve(streams.variants_.size());
+        for (const auto& v : streams.variants_) {
+            SnapshotString line = add(v.manifest_line);
+            variants_.push_back({v.bandwidth, v.avg_bandwidth, v.codecs, v.resolution_height, v.frame_rate,
+                                 v.video_range, v.audio, v.closed_captions, add(v.uri), line});
+        }
+        audio_tracks_.reserve(audio.audio_tracks_.size());
+        for (const auto& g : audio.audio_tracks_) {
+            SnapshotString line = add(g.manifest_line);
+            audio_tracks_.push_back({addWithin(line, g.manifest_line, g.id), addWithin(line, g.manifest_line, g.name),
+                                     g.language, g.default_, g.autoselect, g.channel_count,
+                                     addWithin(line, g.manifest_line, g.uri), line});
+        }
+        iframes_.reserve(iframes.iframes_.size());
+        for (const auto& f : iframes.iframes_) {
+            SnapshotString line = add(f.manifest_line);
+            iframes_.push_back({f.bandwidth, f.codecs, f.resolution_height, f.video_range,
+                                addWithin(line, f.manifest_line, f.uri), line});
+        }
+        layout();
+    }
+
+    // Size in bytes of the snapshot.
+    size_t size() const { return header_.size; }
+
+    // Emits the snapshot as a sequence of byte ranges, see BasicM3U8Parser::serialize().
+    template<typename Sink>
+    void serialize(Sink&& sink) const {
+        static constexpr char padding[PlaylistSnapshot::kAlignment] = {};
+        uint64_t written = 0;
+        auto emit = [&](const void* data, size_t size) {
+            sink(std::string_view(static_cast<const char*>(data), size));
+            written += size;
+        };
+        auto emit_section = [&](PlaylistSnapshot::Section id, const auto& records) {
+            uint64_t offset = header_.sections[id].offset;
+            if (offset > written) emit(padding, offset - written);
+            if (!records.empty()) emit(records.data(), records.size() * sizeof(records[0]));
+        };
+
+        emit(&header_, sizeof(header_));
+        emit_section(PlaylistSnapshot::HEADERS, headers_);
+        for (size_t type = 0; type < passthrough_.size(); ++type) {
+            emit_section(static_cast<PlaylistSnapshot::Section>(PlaylistSnapshot::STREAM_PASSTHROUGH + type),
+                         passthrough_[type]);
+        }
+        emit_section(PlaylistSnapshot::VARIANTS, variants_);
+        emit_section(PlaylistSnapshot::AUDIO_TRACKS, audio_tracks_);
+        emit_section(PlaylistSnapshot::IFRAMES, iframes_);
+        for (size_t type = 0; type < values_.size(); ++type) {
+            emit_section(static_cast<PlaylistSnapshot::Section>(PlaylistSnapshot::STREAM_VALUES + type), values_[type]);
+        }
+        emit_section(PlaylistSnapshot::STRINGS, std::string_view());
+        for (std::string_view piece : pool_) {
+            if (!piece.empty()) emit(piece.data(), piece.size());
+        }
+    }
+
+    // The snapshot in one buffer, e.g. to open it in place: PlaylistSnapshot(bytes, nullptr).
+    std::string bytes() const {
+        std::string out;
+        out.reserve(size());
+        serialize([&out](std::string_view piece) { out.append(piece); });
+        return out;
+    }
+
+private:
+    PlaylistSnapshot::Header                         header_{};
+    std::vector<SnapshotString>                      headers_;
+    std::array<std::vector<SnapshotPassthrough>, 3>  passthrough_;
+    std::vector<SnapshotVariant>                     variants_;
+    std::vector<SnapshotMediaGroup>                  audio_tracks_;
+    std::vector<SnapshotIFrame>                      iframes_;
+    std::array<std::vector<SnapshotString>, 3>       values_;
+    std::vector<std::string_view>                    pool_;         // string pool pieces, in order
+    uint64_t                                         pool_size_ = 0;
+
+    // Appends string to the pool.
+    SnapshotString add(std::string_view string) {
+        if (pool_size_ + string.size() > UINT32_MAX) throw std::length_error("Playlist too large for a snapshot");
+        SnapshotString ref{static_cast<uint32_t>(pool_size_), static_cast<uint32_t>(string.size())};
+        pool_.push_back(string);
+        pool_size_ += string.size();
+        return ref;
+    }
+
+    // References value inside line (already added as line_ref) if it is part of it, else appends it.
+    SnapshotString addWithin(SnapshotString line_ref, std::string_view line, std::string_view value) {
+        const std::less<const char*> before;
+        size_t position;
+        if (!before(value.data(), line.data()) && !before(line.data() + line.size(), value.data() + value.size())) {
+            position = static_cast<size_t>(value.data() - line.data());      // a view into the line
+        } else {
+            position = line.find(value);                                    // a copy of part of the line
+            if (position == std::string_view::npos) return add(value);
+        }
+        return {line_ref.offset + static_cast<uint32_t>(position), static_cast<uint32_t>(value.size())};
+    }
+
+    template<typename Dictionary>
+    void addValues(const Dictionary& dictionary, std::vector<SnapshotString>& values) {
+        values.reserve(dictionary.size());
+        for (uint32_t id = 0; id < dictionary.size(); ++id) values.push_back(add(dictionary.value(AttributeId{id})));
+    }
+
+    // Places the sections one after the other and fills in the header.
+    void layout() {
+        std::copy(PlaylistSnapshot::kMagic.begin(), PlaylistSnapshot::kMagic.end(), header_.magic.begin());
+        header_.version    = PlaylistSnapshot::kVersion;
+        header_.byte_order = PlaylistSnapshot::kByteOrderMark;
+
+        const std::array<size_t, PlaylistSnapshot::kSectionCount> counts = {
+            headers_.size(), passthrough_[0].size(), passthrough_[1].size(), passthrough_[2].size(),
+            variants_.size(), audio_tracks_.size(), iframes_.size(),
+            values_[0].size(), values_[1].size(), values_[2].size(), pool_size_
+        };
+        uint64_t offset = sizeof(PlaylistSnapshot::Header);
+        for (size_t id = 0; id < PlaylistSnapshot::kSectionCount; ++id) {
+            offset = (offset + PlaylistSnapshot::kAlignment - 1) / PlaylistSnapshot::kAlignment * PlaylistSnapshot::kAlignment;
+            header_.sections[id] = {offset, counts[id]};
+            offset += counts[id] * PlaylistSnapshot::kRecordSize[id];
+        }
+        header_.size = offset;
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_PLAYLISTSNAPSHOT_H
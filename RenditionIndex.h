@@ -0,0 +1,323 @@
+//
+// Secondary indexes answering rendition queries over parsed elements
+//
+
+#ifndef HLS_FETCH_AND_SORT_RENDITIONINDEX_H
+#define HLS_FETCH_AND_SORT_RENDITIONINDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Attributes of one element as seen by queries. Attributes an element lacks are 0 or empty.
+struct RenditionKeys {
+    int              bandwidth = 0;
+    int              height    = 0;
+    std::string_view codecs{};          // CODECS list, e.g. "avc1.640028,mp4a.40.2"
+    std::string_view video_range{};
+    std::string_view group{};           // AUDIO group of a variant, GROUP-ID of a rendition
+    std::string_view language{};
+};
+
+/**
+ * @brief Filter of a rendition query, e.g. the highest-bandwidth HEVC variant under 6 Mbps
+ * with PQ video range:
+ *
+ *     acc.highest({.max_bandwidth = 6'000'000, .codec_family = "hvc1,hev1", .video_range = "PQ"});
+ *
+ * Every field narrows the result; the defaults match anything.
+ */
+struct RenditionQuery {
+    int              min_bandwidth = 0;
+    int              max_bandwidth = std::numeric_limits<int>::max();
+    int              min_height    = 0;
+    int              max_height    = std::numeric_limits<int>::max();
+    std::string_view codec_family{};    // sample entries, e.g. "hvc1,hev1": one of the element's codecs has one
+    std::string_view codecs{};          // CODECS list holding every codec of the element, e.g. a variant's
+    std::string_view video_range{};     // "SDR", "PQ", "HLG"
+    std::string_view group{};
+    std::string_view language{};
+
+    // Calls f with every entry of a comma-separated list, surrounding blanks removed.
+    template<typename F>
+    static void forEachCodec(std::string_view list, F&& f) {
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            std::string_view entry = list.substr(0, comma);
+            size_t first = entry.find_first_not_of(' ');
+            if (first != std::string_view::npos) {
+                f(entry.substr(first, entry.find_last_not_of(' ') + 1 - first));
+            }
+            if (comma == std::string_view::npos) break;
+            list.remove_prefix(comma + 1);
+        }
+    }
+
+    // Sample entry a codec string starts with: "hvc1" for "hvc1.2.4.L150.B0"
+    static std::string_view family(std::string_view codec) {
+        return codec.substr(0, codec.find('.'));
+    }
+
+    bool matches(const RenditionKeys& keys) const {
+        if (keys.bandwidth < min_bandwidth || keys.bandwidth > max_bandwidth) return false;
+        if (keys.height < min_height || keys.height > max_height) return false;
+        if (!video_range.empty() && keys.video_range != video_range) return false;
+        if (!group.empty() && keys.group != group) return false;
+        if (!language.empty() && keys.language != language) return false;
+        if (!codec_family.empty() || !codecs.empty()) {
+            // An element without CODECS cannot be matched against codecs
+            if (keys.codecs.empty()) return false;
+            bool family_found = codec_family.empty();
+            bool all_listed   = true;
+            forEachCodec(keys.codecs, [&](std::string_view codec) {
+                if (!family_found && contains(codec_family, family(codec))) family_found = true;
+                if (!codecs.empty() && !contains(codecs, codec)) all_listed = false;
+            });
+            if (!family_found || !all_listed) return false;
+        }
+        return true;
+    }
+
+    bool boundsBandwidth() const { return min_bandwidth > 0 || max_bandwidth < std::numeric_limits<int>::max(); }
+    bool boundsHeight() const    { return min_height > 0 || max_height < std::numeric_limits<int>::max(); }
+
+    // Whether list has entry
+    static bool contains(std::string_view list, std::string_view entry) {
+        bool found = false;
+        forEachCodec(list, [&](std::string_view item) { found = found || item == entry; });
+        return found;
+    }
+};
+
+/**
+ * @brief Secondary indexes over the elements of one sub-parser.
+ *
+ * Holds the elements' positions ordered by BANDWIDTH and by height, and grouped by group,
+ * codec family and VIDEO-RANGE. A query starts from whichever of these yields the fewest
+ * candidates (a binary search, or a hash lookup) and checks the remaining criteria on those
+ * candidates only, instead of scanning and re-sorting every element per question.
+ *
+ * Positions refer to the container the index was built from: the owner drops the index with
+ * invalidate() whenever it reorders the elements, and an index built for fewer elements than
+ * the container holds counts as stale. Copies start out empty.
+ *
+ * @tparam Element  Element type of the sub-parser.
+ */
+template<typename Element>
+class RenditionIndex {
+public:
+    RenditionIndex() = default;
+    RenditionIndex(const RenditionIndex&) {}
+    RenditionIndex& operator=(const RenditionIndex&) { tables_.reset(); return *this; }
+
+    void invalidate() { tables_.reset(); }
+
+    /**
+     * @brief Positions of the elements matching query, in container order.
+     * @param keys_of  Returns the RenditionKeys of an element.
+     */
+    template<typename KeysOf>
+    std::pmr::vector<uint32_t> find(std::span<const Element> elements, const RenditionQuery& query,
+                                    KeysOf&& keys_of, std::pmr::memory_resource* resource) {
+        const Tables& tables = update(elements, keys_of, resource);
+        return filter(elements, query, keys_of, select(tables, elements.size(), query, resource), resource);
+    }
+
+    /**
+     * @brief Position of the matching element with the highest (or lowest) BANDWIDTH; the
+     * first in container order on ties.
+     */
+    template<typename KeysOf>
+    std::optional<uint32_t> extreme(std::span<const Element> elements, const RenditionQuery& query,
+                                    KeysOf&& keys_of, bool highest, std::pmr::memory_resource* resource) {
+        const Tables& tables = update(elements, keys_of, resource);
+        Candidates candidates = select(tables, elements.size(), query, resource);
+        auto [first, last] = valueRange(tables.by_bandwidth, query.min_bandwidth, query.max_bandwidth);
+
+        // With the fewest candidates coming from a set of s elements out of n, about n / s
+        // entries of the bandwidth order are walked before a match: filter s when s * s <= n.
+        const bool walks_anyway = candidates.source == Candidates::Source::ALL ||
+                                  (candidates.source == Candidates::Source::RANGE && candidates.range.data() == first);
+        if (!walks_anyway && candidates.size * candidates.size <= elements.size()) {
+            // Another criterion is very selective: pick the extreme among its matches
+            std::optional<uint32_t> best;
+            int best_bandwidth = 0;
+            for (uint32_t position : filter(elements, query, keys_of, std::move(candidates), resource)) {
+                int bandwidth = keys_of(elements[position]).bandwidth;
+                if (!best || (highest ? bandwidth > best_bandwidth : bandwidth < best_bandwidth)) {
+                    best = position;
+                    best_bandwidth = bandwidth;
+                }
+            }
+            return best;
+        }
+
+        // Walk the bandwidth order inwards from the requested end; the first match decides
+        std::span<const Entry> range(first, last);
+        auto matches = [&](const Entry& entry) { return query.matches(keys_of(elements[entry.second])); };
+        if (highest) {
+            for (auto it = range.rbegin(); it != range.rend(); ++it) {
+                if (!matches(*it)) continue;
+                // Entries of one bandwidth are in position order, so look for an earlier match
+                uint32_t position = it->second;
+                for (auto tie = it + 1; tie != range.rend() && tie->first == it->first; ++tie) {
+                    if (matches(*tie)) position = tie->second;
+                }
+                return position;
+            }
+        } else {
+            for (const Entry& entry : range) {
+                if (matches(entry)) return entry.second;
+            }
+        }
+        return std::nullopt;
+    }
+
+private:
+    using Entry   = std::pair<int, uint32_t>;           // (value, position), sorted
+    using Buckets = std::pmr::unordered_map<std::string_view, std::pmr::vector<uint32_t>>;
+
+    struct Tables {
+        explicit Tables(std::pmr::memory_resource* resource)
+            : by_bandwidth(resource), by_height(resource),
+              by_group(resource), by_codec_family(resource), by_video_range(resource) {}
+
+        size_t                   size = 0;              // elements indexed
+        std::pmr::vector<Entry>  by_bandwidth;
+        std::pmr::vector<Entry>  by_height;
+        Buckets                  by_group;              // positions in ascending order
+        Buckets                  by_codec_family;
+        Buckets                  by_video_range;
+    };
+
+    // Where a query takes its candidates from
+    struct Candidates {
+        enum class Source { ALL, RANGE, BUCKETS };
+
+        Source                                      source = Source::ALL;
+        std::span<const Entry>                      range;
+        std::pmr::vector<std::span<const uint32_t>> buckets;    // possibly overlapping
+        size_t                                      size = 0;
+    };
+
+    std::optional<Tables> tables_;
+
+    template<typename KeysOf>
+    const Tables& update(std::span<const Element> elements, KeysOf& keys_of, std::pmr::memory_resource* resource) {
+        if (tables_ && tables_->size == elements.size()) return *tables_;
+
+        Tables& tables = tables_.emplace(resource);
+        tables.size = elements.size();
+        tables.by_bandwidth.reserve(elements.size());
+        tables.by_height.reserve(elements.size());
+        for (uint32_t position = 0; position < elements.size(); ++position) {
+            const RenditionKeys keys = keys_of(elements[position]);
+            tables.by_bandwidth.emplace_back(keys.bandwidth, position);
+            tables.by_height.emplace_back(keys.height, position);
+            if (!keys.group.empty())       tables.by_group[keys.group].push_back(position);
+            if (!keys.video_range.empty()) tables.by_video_range[keys.video_range].push_back(position);
+            RenditionQuery::forEachCodec(keys.codecs, [&](std::string_view codec) {
+                auto& bucket = tables.by_codec_family[RenditionQuery::family(codec)];
+                if (bucket.empty() || bucket.back() != position) bucket.push_back(position);
+            });
+        }
+        std::sort(tables.by_bandwidth.begin(), tables.by_bandwidth.end());
+        std::sort(tables.by_height.begin(), tables.by_height.end());
+        return tables;
+    }
+
+    static std::pair<const Entry*, const Entry*> valueRange(const std::pmr::vector<Entry>& entries, int min, int max) {
+        if (min > max) return {entries.data(), entries.data()};
+        auto first = std::lower_bound(entries.begin(), entries.end(), Entry{min, 0});
+        auto last  = std::upper_bound(first, entries.end(), Entry{max, UINT32_MAX});
+        return {entries.data() + (first - entries.begin()), entries.data() + (last - entries.begin())};
+    }
+
+    static std::span<const uint32_t> bucket(const Buckets& buckets, std::string_view key) {
+        auto it = buckets.find(key);
+        return it == buckets.end() ? std::span<const uint32_t>() : std::span<const uint32_t>(it->second);
+    }
+
+    // Smallest candidate set among the indexed criteria of query
+    static Candidates select(const Tables& tables, size_t size, const RenditionQuery& query,
+                             std::pmr::memory_resource* resource) {
+        Candidates best{Candidates::Source::ALL, {}, std::pmr::vector<std::span<const uint32_t>>(resource), size};
+        auto range = [&](std::pair<const Entry*, const Entry*> bounds) {
+            std::span<const Entry> entries(bounds.first, bounds.second);
+            if (entries.size() < best.size) {
+                best.source = Candidates::Source::RANGE;
+                best.range  = entries;
+                best.size   = entries.size();
+            }
+        };
+        auto buckets = [&](std::initializer_list<std::span<const uint32_t>> spans) {
+            size_t total = 0;
+            for (auto span : spans) total += span.size();
+            if (total < best.size) {
+                best.source = Candidates::Source::BUCKETS;
+                best.buckets.assign(spans.begin(), spans.end());
+                best.size   = total;
+            }
+        };
+
+        if (query.boundsBandwidth()) range(valueRange(tables.by_bandwidth, query.min_bandwidth, query.max_bandwidth));
+        if (query.boundsHeight())    range(valueRange(tables.by_height, query.min_height, query.max_height));
+        if (!query.group.empty())       buckets({bucket(tables.by_group, query.group)});
+        if (!query.video_range.empty()) buckets({bucket(tables.by_video_range, query.video_range)});
+
+        // Elements matching the codec criteria have a codec of one of these families
+        std::string_view families = query.codec_family.empty() ? query.codecs : query.codec_family;
+        if (!families.empty()) {
+            std::pmr::vector<std::span<const uint32_t>> spans(resource);
+            size_t total = 0;
+            RenditionQuery::forEachCodec(families, [&](std::string_view codec) {
+                spans.push_back(bucket(tables.by_codec_family, RenditionQuery::family(codec)));
+                total += spans.back().size();
+            });
+            if (total < best.size) {
+                best.source  = Candidates::Source::BUCKETS;
+                best.buckets = std::move(spans);
+                best.size    = total;
+            }
+        }
+        return best;
+    }
+
+    // Positions of the candidates matching query, in container order
+    template<typename KeysOf>
+    static std::pmr::vector<uint32_t> filter(std::span<const Element> elements, const RenditionQuery& query,
+                                             KeysOf& keys_of, Candidates&& candidates,
+                                             std::pmr::memory_resource* resource) {
+        std::pmr::vector<uint32_t> positions(resource);
+        auto check = [&](uint32_t position) {
+            if (query.matches(keys_of(elements[position]))) positions.push_back(position);
+        };
+        switch (candidates.source) {
+            case Candidates::Source::ALL:
+                for (uint32_t position = 0; position < elements.size(); ++position) check(position);
+                return positions;
+            case Candidates::Source::RANGE:
+                for (const Entry& entry : candidates.range) check(entry.second);
+                break;
+            case Candidates::Source::BUCKETS:
+                for (std::span<const uint32_t> bucket : candidates.buckets) {
+                    for (uint32_t position : bucket) check(position);
+                }
+                if (candidates.buckets.size() == 1) return positions;
+                break;
+        }
+        // Ranges are in value order and buckets may overlap
+        std::sort(positions.begin(), positions.end());
+        positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+        return positions;
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_RENDITIONINDEX_H
@@ -0,0 +1,422 @@
+/*
+ *   Module responsible for downloading media segments and initialization sections
+ */
+#ifndef HLS_FETCH_AND_SORT_SEGMENTDOWNLOADER_H
+#define HLS_FETCH_AND_SORT_SEGMENTDOWNLOADER_H
+
+#include <curl/curl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "CurlGlobal.h"
+#include "HLSUrl.h"
+#include "MediaPlaylistParser.h"
+#include "TransferMetrics.h"
+
+// One resource (range) to download: a media segment or an initialization section
+struct SegmentJob {
+    std::string           url;
+    uint64_t              byterange_length = 0;     // 0 = whole resource
+    uint64_t              byterange_offset = 0;
+    std::filesystem::path path;                     // written at byterange_offset
+    size_t                rendition = 0;            // jobs of one rendition share its in-flight limit
+    bool                  init_section = false;     // #EXT-X-MAP rather than a media segment
+    uint64_t              sequence_number = 0;      // media segments only
+};
+
+// Outcome of a SegmentJob, reported by SegmentDownloader
+struct SegmentResult {
+    size_t          index = 0;          // position of the job in the submitted list
+    SegmentJob      job;
+    bool            ok = false;
+    std::string     error;
+    unsigned        attempts = 0;
+    uint64_t        bytes = 0;          // written to job.path
+    TransferMetrics transfer;           // of the last attempt
+
+    double megabitsPerSecond() const {
+        return transfer.total > 0 ? static_cast<double>(bytes) * 8.0 / 1e6 / transfer.total : 0.0;
+    }
+};
+
+/**
+ * @brief Downloads media segments and #EXT-X-MAP sections in parallel, straight to disk.
+ *
+ * Transfers run on one curl multi handle with up to max_in_flight of them per rendition.
+ * Byte ranges are requested with CURLOPT_RANGE and every received buffer is pwrite()n to
+ * the job's file descriptor at its offset, directly from curl's buffer, so sub-ranges of one
+ * resource reassemble into a single file and no body is ever held in memory. Connection
+ * errors, timeouts, 408/429 and 5xx responses are retried with exponential backoff and
+ * jitter; other failures are reported at once. Failures are reported, never thrown.
+ *
+ * Example:
+ *
+ *     MediaPlaylistParser media;
+ *     media.parse(body);
+ *     SegmentDownloader downloader({.max_in_flight = 8});
+ *     downloader.download(SegmentDownloader::plan(media, url, "segments"), [](SegmentResult&& result) {
+ *         std::cout << result.job.url << ": " << result.megabitsPerSecond() << " Mbit/s\n";
+ *     });
+ */
+class SegmentDownloader {
+public:
+    struct Options {
+        size_t                    max_in_flight = 6;        // transfers per rendition
+        unsigned                  max_attempts  = 4;
+        std::chrono::milliseconds initial_backoff{250};     // doubled per retry, jittered
+        std::chrono::milliseconds max_backoff{8000};
+        long                      timeout_seconds = 60;
+        bool                      http2 = true;
+    };
+
+    // Invoked once per job, in completion order.
+    using CompletionHandler = std::function<void(SegmentResult&& result)>;
+
+    SegmentDownloader() : SegmentDownloader(Options()) {}
+
+    explicit SegmentDownloader(Options options) : options_(options) {
+        if (options_.max_in_flight == 0 || options_.max_attempts == 0) {
+            throw std::invalid_argument("SegmentDownloader requires at least one transfer and one attempt");
+        }
+        CurlGlobal::ensureInitialized();
+        multi_ = curl_multi_init();
+        if (!multi_) throw std::runtime_error("Failed to initialize CURL multi handle");
+        curl_multi_setopt(multi_, CURLMOPT_PIPELINING, options_.http2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+    }
+
+    ~SegmentDownloader() {
+        for (CURL* easy : idle_) curl_easy_cleanup(easy);
+        curl_multi_cleanup(multi_);
+    }
+
+    SegmentDownloader(const SegmentDownloader&) = delete;
+    SegmentDownloader& operator=(const SegmentDownloader&) = delete;
+
+    /**
+     * @brief Jobs for every initialization section and segment of a media playlist.
+     *
+     * URIs are resolved against playlist_url, and files mirror each resource's host and path
+     * below output_directory (see HLSUrl::localPath). Initialization sections come first, so
+     * they are in place before the segments that need them.
+     */
+    static std::vector<SegmentJob> plan(const MediaPlaylistParser& playlist, std::string_view playlist_url,
+                                        const std::filesystem::path& output_directory, size_t rendition = 0) {
+        std::vector<SegmentJob> jobs;
+        const SegmentStore& segments = playlist.segments();
+        jobs.reserve(playlist.maps().size() + segments.size());
+
+        auto job = [&](std::string_view uri, uint64_t length, uint64_t offset) {
+            SegmentJob result;
+            result.url              = HLSUrl::resolve(playlist_url, uri);
+            result.byterange_length = length;
+            result.byterange_offset = offset;
+            result.path             = output_directory / HLSUrl::localPath(result.url);
+            result.rendition        = rendition;
+            return result;
+        };
+        for (const SegmentMap& map : playlist.maps()) {
+            jobs.push_back(job(map.uri, map.byterange_length, map.byterange_offset));
+            jobs.back().init_section = true;
+        }
+        for (size_t i = 0; i < segments.size(); ++i) {
+            if (segments.flags[i] & SegmentStore::GAP) continue;
+            jobs.push_back(job(segments.uri(i), segments.byterange_lengths[i], segments.byterange_offsets[i]));
+            jobs.back().sequence_number = segments.sequence_numbers[i];
+        }
+        return jobs;
+    }
+
+    // Downloads all jobs; returns once every job has been reported to on_done.
+    void download(const std::vector<SegmentJob>& jobs, const CompletionHandler& on_done) {
+        size_t renditions = 0;
+        for (const auto& job : jobs) renditions = std::max(renditions, job.rendition + 1);
+        std::vector<std::deque<size_t>> pending(renditions);     // ready to start, per rendition
+        std::vector<size_t>             in_flight(renditions, 0);
+        for (size_t i = 0; i < jobs.size(); ++i) pending[jobs[i].rendition].push_back(i);
+
+        std::vector<unsigned> attempts(jobs.size(), 0);
+        using Retry = std::pair<Clock::time_point, size_t>;
+        std::priority_queue<Retry, std::vector<Retry>, std::greater<>> retries;
+        size_t remaining = jobs.size();
+
+        auto resultOf = [&jobs, &attempts](size_t index) {
+            SegmentResult result;
+            result.index    = index;
+            result.job      = jobs[index];
+            result.attempts = attempts[index];
+            return result;
+        };
+        auto report = [&](SegmentResult&& result) {
+            --remaining;
+            on_done(std::move(result));
+        };
+
+        while (remaining > 0) {
+            // Retries that are due go before the rest of their rendition
+            while (!retries.empty() && retries.top().first <= Clock::now()) {
+                size_t index = retries.top().second;
+                retries.pop();
+                pending[jobs[index].rendition].push_front(index);
+            }
+
+            for (size_t r = 0; r < renditions; ++r) {
+                while (in_flight[r] < options_.max_in_flight && !pending[r].empty()) {
+                    size_t index = pending[r].front();
+                    pending[r].pop_front();
+                    ++attempts[index];
+                    std::string error;
+                    if (start(index, jobs[index], error)) {
+                        ++in_flight[r];
+                    } else {
+                        SegmentResult result = resultOf(index);
+                        result.error = std::move(error);
+                        report(std::move(result));
+                    }
+                }
+            }
+
+            int running = 0;
+            curl_multi_perform(multi_, &running);
+
+            int queued = 0;
+            while (CURLMsg* msg = curl_multi_info_read(multi_, &queued)) {
+                if (msg->msg != CURLMSG_DONE) continue;
+                std::unique_ptr<Transfer> transfer = finish(msg->easy_handle);
+                size_t index = transfer->index;
+                --in_flight[jobs[index].rendition];
+
+                SegmentResult result = resultOf(index);
+                result.bytes    = transfer->written;
+                result.transfer = TransferMetrics::collect(transfer->easy);
+                idle_.push_back(transfer->easy);
+                bool retry = evaluate(*transfer, msg->data.result, result);
+
+                if (retry && attempts[index] < options_.max_attempts) {
+                    retries.emplace(Clock::now() + backoff(attempts[index]), index);
+                } else {
+                    report(std::move(result));
+                }
+            }
+
+            if (remaining > 0) {
+                int timeout_ms = 1000;
+                if (!retries.empty()) {
+                    auto until = std::chrono::duration_cast<std::chrono::milliseconds>(retries.top().first - Clock::now());
+                    timeout_ms = static_cast<int>(std::clamp<int64_t>(until.count(), 0, timeout_ms));
+                }
+                curl_multi_poll(multi_, nullptr, 0, timeout_ms, nullptr);
+            }
+        }
+    }
+
+    // Convenience overload collecting all results, in the order of jobs.
+    std::vector<SegmentResult> download(const std::vector<SegmentJob>& jobs) {
+        std::vector<SegmentResult> results(jobs.size());
+        download(jobs, [&results](SegmentResult&& result) {
+            size_t index = result.index;
+            results[index] = std::move(result);
+        });
+        return results;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Per-attempt state, reachable from the easy handle through CURLOPT_PRIVATE
+    struct Transfer {
+        CURL*       easy = nullptr;
+        size_t      index = 0;
+        int         fd = -1;
+        uint64_t    file_offset = 0;     // where the next received byte goes
+        uint64_t    skip = 0;            // leading bytes to drop (200 answer to a range request)
+        uint64_t    wanted = 0;          // bytes to keep, 0 = all
+        uint64_t    written = 0;
+        bool        ranged = false;
+        bool        checked = false;     // status code inspected
+        bool        accepted = false;    // 200/206: body is written
+        int         write_errno = 0;
+    };
+
+    Options options_;
+    CURLM*  multi_ = nullptr;
+    std::vector<std::unique_ptr<Transfer>> active_;
+    std::vector<CURL*>                     idle_;      // reset and reused
+    std::minstd_rand                       jitter_{std::random_device{}()};
+
+    static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+        auto* transfer = static_cast<Transfer*>(userp);
+        size_t total = size * nmemb;
+        if (!transfer->checked) {
+            long code = 0;
+            curl_easy_getinfo(transfer->easy, CURLINFO_RESPONSE_CODE, &code);
+            transfer->checked  = true;
+            transfer->accepted = code == 206 || code == 200;
+            // A server ignoring Range sends the whole resource; keep only the requested part
+            if (code == 200 && transfer->ranged) transfer->skip = transfer->file_offset;
+        }
+        if (!transfer->accepted) return total;      // drain error bodies
+
+        const char* data = static_cast<const char*>(contents);
+        size_t available = total;
+        size_t skipped = static_cast<size_t>(std::min<uint64_t>(transfer->skip, available));
+        transfer->skip -= skipped;
+        data      += skipped;
+        available -= skipped;
+        if (transfer->wanted) {
+            available = static_cast<size_t>(std::min<uint64_t>(available, transfer->wanted - transfer->written));
+        }
+
+        while (available > 0) {
+            ssize_t n = ::pwrite(transfer->fd, data, available, static_cast<off_t>(transfer->file_offset));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                transfer->write_errno = errno;
+                return 0;                           // aborts the transfer with CURLE_WRITE_ERROR
+            }
+            data                  += n;
+            available             -= static_cast<size_t>(n);
+            transfer->file_offset += static_cast<uint64_t>(n);
+            transfer->written     += static_cast<uint64_t>(n);
+        }
+        return total;
+    }
+
+    // Opens the job's file and adds a transfer for it; false with error if the file cannot be opened.
+    bool start(size_t index, const SegmentJob& job, std::string& error) {
+        std::error_code ignored;
+        std::filesystem::create_directories(job.path.parent_path(), ignored);
+        int fd = ::open(job.path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            error = "Could not open " + job.path.string() + ": " + std::strerror(errno);
+            return false;
+        }
+
+        CURL* easy;
+        if (idle_.empty()) {
+            easy = curl_easy_init();
+            if (!easy) {
+                ::close(fd);
+                error = "Failed to initialize CURL";
+                return false;
+            }
+        } else {
+            easy = idle_.back();
+            idle_.pop_back();
+            curl_easy_reset(easy);
+        }
+
+        auto transfer = std::make_unique<Transfer>();
+        transfer->easy        = easy;
+        transfer->index       = index;
+        transfer->fd          = fd;
+        transfer->file_offset = job.byterange_offset;
+        transfer->wanted      = job.byterange_length;
+        transfer->ranged      = job.byterange_length > 0;
+
+        curl_easy_setopt(easy, CURLOPT_URL, job.url.c_str());
+        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, WriteCallback);
+        curl_easy_setopt(easy, CURLOPT_WRITEDATA, transfer.get());
+        curl_easy_setopt(easy, CURLOPT_PROTOCOLS_STR, "http,https");         // no file://, ftp://, ...
+        curl_easy_setopt(easy, CURLOPT_REDIR_PROTOCOLS_STR, "http,https");
+        curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(easy, CURLOPT_TIMEOUT, options_.timeout_seconds);
+        if (transfer->ranged) {
+            std::string range = std::to_string(job.byterange_offset) + "-" +
+                                std::to_string(job.byterange_offset + job.byterange_length - 1);
+            curl_easy_setopt(easy, CURLOPT_RANGE, range.c_str());       // copied by curl
+        }
+        if (options_.http2) {
+            curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+            curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+        }
+        curl_easy_setopt(easy, CURLOPT_PRIVATE, transfer.get());
+
+        curl_multi_add_handle(multi_, easy);
+        active_.emplace_back(std::move(transfer));
+        return true;
+    }
+
+    // Detaches a finished transfer from the multi handle and closes its file.
+    std::unique_ptr<Transfer> finish(CURL* easy) {
+        Transfer* raw = nullptr;
+        curl_easy_getinfo(easy, CURLINFO_PRIVATE, &raw);
+        auto it = std::find_if(active_.begin(), active_.end(),
+                               [raw](const auto& transfer) { return transfer.get() == raw; });
+        std::unique_ptr<Transfer> transfer = std::move(*it);
+        active_.erase(it);
+        curl_multi_remove_handle(multi_, easy);
+
+        if (!transfer->checked) {       // no body, so the write callback never ran
+            long code = 0;
+            curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &code);
+            transfer->accepted = code == 206 || code == 200;
+        }
+        // A whole resource may replace a longer file from an earlier run
+        if (!transfer->ranged && transfer->accepted) {
+            ::ftruncate(transfer->fd, static_cast<off_t>(transfer->written));
+        }
+        ::close(transfer->fd);
+        return transfer;
+    }
+
+    // Fills in ok/error of result; returns true if a failed attempt is worth retrying.
+    static bool evaluate(const Transfer& transfer, CURLcode code, SegmentResult& result) {
+        long http_code = result.transfer.http_code;
+        if (code != CURLE_OK) {
+            result.error = transfer.write_errno ? std::string("Write failed: ") + std::strerror(transfer.write_errno)
+                                                : std::string(curl_easy_strerror(code));
+            switch (code) {
+                case CURLE_COULDNT_RESOLVE_HOST:
+                case CURLE_COULDNT_CONNECT:
+                case CURLE_OPERATION_TIMEDOUT:
+                case CURLE_SEND_ERROR:
+                case CURLE_RECV_ERROR:
+                case CURLE_PARTIAL_FILE:
+                case CURLE_GOT_NOTHING:
+                case CURLE_HTTP2:
+                case CURLE_HTTP2_STREAM:
+                case CURLE_SSL_CONNECT_ERROR:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+        if (!transfer.accepted) {
+            result.error = "HTTP status " + std::to_string(http_code);
+            return http_code == 408 || http_code == 429 || http_code >= 500;
+        }
+        if (transfer.wanted && transfer.written < transfer.wanted) {
+            result.error = "Short byte range: " + std::to_string(transfer.written) + " of " +
+                           std::to_string(transfer.wanted) + " bytes";
+            return true;
+        }
+        result.ok = true;
+        return false;
+    }
+
+    // Delay before the given retry: initial_backoff doubled per attempt, capped, 50-100% jitter.
+    std::chrono::milliseconds backoff(unsigned attempt) {
+        auto delay = options_.initial_backoff * (int64_t{1} << std::min(attempt - 1, 20u));
+        delay = std::min(delay, options_.max_backoff);
+        std::uniform_real_distribution<double> factor(0.5, 1.0);
+        return std::chrono::milliseconds(static_cast<int64_t>(static_cast<double>(delay.count()) * factor(jitter_)));
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_SEGMENTDOWNLOADER_H
@@ -0,0 +1,99 @@
+//
+// Textual sort specifications, e.g. for batch jobs given on the command line
+//
+
+#ifndef HLS_FETCH_AND_SORT_SORTSPEC_H
+#define HLS_FETCH_AND_SORT_SORTSPEC_H
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "M3U8Parser.h"
+
+/**
+ * @brief Sort keys per tag group of a master playlist.
+ *
+ * The textual form lists groups separated by ';', each with comma-separated attributes;
+ * a leading '-' sorts that key in descending order. Attribute names are those of
+ * HLSTagParser::SortAttribute, with '-' accepted for '_' (AVERAGE-BANDWIDTH).
+ *
+ *     stream=RESOLUTION,-BANDWIDTH;audio=LANGUAGE,ID;iframe=CODECS
+ *
+ * Groups that are not mentioned are left in playlist order.
+ */
+struct SortSpec {
+    std::vector<HLSTagParser::SortKey> stream;
+    std::vector<HLSTagParser::SortKey> audio;
+    std::vector<HLSTagParser::SortKey> iframe;
+
+    // The order main() has always produced.
+    static constexpr std::string_view kDefault = "stream=RESOLUTION,BANDWIDTH;audio=ID;iframe=CODECS";
+
+    // @throws std::invalid_argument on unknown groups or attributes.
+    static SortSpec parse(std::string_view text) {
+        SortSpec spec;
+        while (!text.empty()) {
+            size_t end = text.find(';');
+            std::string_view group = text.substr(0, end);
+            text = (end == std::string_view::npos) ? std::string_view() : text.substr(end + 1);
+            if (group.empty()) continue;
+
+            size_t eq = group.find('=');
+            if (eq == std::string_view::npos) {
+                throw std::invalid_argument("Sort spec group without '=': " + std::string(group));
+            }
+            std::string_view name = group.substr(0, eq);
+            std::vector<HLSTagParser::SortKey>* keys =
+                    name == "stream" ? &spec.stream :
+                    name == "audio"  ? &spec.audio  :
+                    name == "iframe" ? &spec.iframe : nullptr;
+            if (!keys) throw std::invalid_argument("Unknown sort spec group: " + std::string(name));
+
+            *keys = parseKeys(group.substr(eq + 1));
+        }
+        return spec;
+    }
+
+    // Parses the comma-separated keys of one group, e.g. "RESOLUTION,-BANDWIDTH".
+    // @throws std::invalid_argument on unknown attributes.
+    static std::vector<HLSTagParser::SortKey> parseKeys(std::string_view list) {
+        std::vector<HLSTagParser::SortKey> keys;
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            keys.push_back(parseKey(list.substr(0, comma)));
+            list = (comma == std::string_view::npos) ? std::string_view() : list.substr(comma + 1);
+        }
+        return keys;
+    }
+
+    // Sorts every group of parser that has keys.
+    // @throws std::invalid_argument if a group cannot be sorted by one of its keys.
+    template<typename String>
+    void apply(BasicM3U8Parser<String>& parser) const {
+        if (!stream.empty()) parser.template select<ParserType::STREAM>().sort(std::span(stream));
+        if (!audio.empty())  parser.template select<ParserType::AUDIO>().sort(std::span(audio));
+        if (!iframe.empty()) parser.template select<ParserType::IFRAME>().sort(std::span(iframe));
+    }
+
+private:
+    static HLSTagParser::SortKey parseKey(std::string_view text) {
+        auto order = HLSTagParser::SortOrder::ASCENDING;
+        if (!text.empty() && text.front() == '-') {
+            order = HLSTagParser::SortOrder::DESCENDING;
+            text.remove_prefix(1);
+        }
+        std::string name(text);
+        for (char& c : name) {
+            if (c == '-') c = '_';
+        }
+
+        for (size_t i = 0; i < HLSTagParser::kSortAttributeCount; ++i) {
+            auto attr = static_cast<HLSTagParser::SortAttribute>(i);
+            if (HLSTagParser::attributeName(attr) == name) return {attr, order};
+        }
+        throw std::invalid_argument("Unknown sort attribute: " + std::string(text));
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_SORTSPEC_H
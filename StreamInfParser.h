@@ -7,107 +7,115 @@
 
 #include "HLSTagParser.h"
 
-struct VideoStreamVariant {
+// Tag-specific line & data attributes. String is std::string for the owning model
+// or std::string_view for the zero-copy model backed by the playlist buffer. AttributeIds
+// name values in the parser's dictionary().
+template<typename String>
+struct BasicVideoStreamVariant {
     int         bandwidth;
     int         avg_bandwidth;
-    std::string codecs;
+    AttributeId codecs;
     int         resolution_height;
-    std::string frame_rate;
-    std::string video_range;
-    std::string audio;
-    std::string closed_captions;
-    std::string uri;
-    std::string manifest_line;
+    AttributeId frame_rate;
+    AttributeId video_range;
+    AttributeId audio;
+    AttributeId closed_captions;
+    String      uri;
+    String      manifest_line;
 };
 
+using VideoStreamVariant     = BasicVideoStreamVariant<std::string>;
+using VideoStreamVariantView = BasicVideoStreamVariant<std::string_view>;
+static_assert(std::is_trivially_copyable_v<VideoStreamVariantView>);
+
 // Concrete Video Variation sub-parser
-class StreamInfParser : public HLSTagParserSorter<StreamInfParser, VideoStreamVariant> {
+template<typename String>
+class BasicStreamInfParser : public HLSTagParserSorter<BasicStreamInfParser<String>, BasicVideoStreamVariant<String>> {
 public:
-    std::vector<VideoStreamVariant> variants_;
+    using Variant       = BasicVideoStreamVariant<String>;
+    using Dictionary    = BasicAttributeDictionary<String>;
+    using SortAttribute = HLSTagParser::SortAttribute;
 
-    void parse(const std::string& content) override {
-        std::istringstream ss(content);
-        std::string line;
+    std::pmr::vector<Variant> variants_;
 
-        VideoStreamVariant current_variant;
-        bool expecting_uri = false;
+    BasicStreamInfParser() = default;
 
-        while(getline(ss, line)){
+    // Elements are allocated from resource, which must outlive the parser.
+    explicit BasicStreamInfParser(std::pmr::memory_resource* resource) : variants_(resource), dictionary_(resource) {}
 
-            if (line.find("#EXT-X-STREAM-INF:") != std::string::npos) {
-                current_variant = VideoStreamVariant();
-                current_variant.manifest_line = line;
+    static constexpr std::string_view kTag = "#EXT-X-STREAM-INF";
 
-                current_variant.bandwidth        = stoi(extractAttribute(line, "BANDWIDTH"));
-                current_variant.avg_bandwidth    = stoi(extractAttribute(line, "AVERAGE-BANDWIDTH"));
-                current_variant.codecs           = extractAttribute(line, "CODECS");
-                std::string resolution           = extractAttribute(line, "RESOLUTION");
-                current_variant.frame_rate       = extractAttribute(line, "FRAME-RATE");
-                current_variant.video_range      = extractAttribute(line, "VIDEO-RANGE");
-                current_variant.audio            = extractAttribute(line, "AUDIO");
-                current_variant.closed_captions  = extractAttribute(line, "CLOSED-CAPTIONS");
-                current_variant.uri              = extractAttribute(line, "FRAME-RATE");
+    std::string_view tag() const override { return kTag; }
 
-                // Extract  height from resolution string
-                size_t x_pos = resolution.find('x');
-                if(x_pos == std::string::npos) current_variant.resolution_height = 0;
-                else  current_variant.resolution_height = stoi(resolution.substr(x_pos+1));
+    void parseLine(std::string_view line) override {
+        if (line[0] == '#') {
+            current_variant_ = Variant();
+            current_variant_.manifest_line = line;
 
-                expecting_uri =true;
-            }
-            else if (expecting_uri && line[0] != '#') {
-                current_variant.uri = line;
-                variants_.emplace_back(current_variant);
-                expecting_uri = false;
+            AttributeList attrs(line);
+            if (!attrs.has("BANDWIDTH")) {
+                throw std::runtime_error("Missing BANDWIDTH attribute in " + std::string(line));
             }
+            current_variant_.bandwidth         = attrs.getInt("BANDWIDTH");
+            current_variant_.avg_bandwidth     = attrs.getInt("AVERAGE-BANDWIDTH");
+            current_variant_.codecs            = dictionary_.intern(attrs.get("CODECS"));
+            current_variant_.resolution_height = attrs.getResolution("RESOLUTION").height;
+            current_variant_.frame_rate        = dictionary_.intern(attrs.get("FRAME-RATE"));
+            current_variant_.video_range       = dictionary_.intern(attrs.get("VIDEO-RANGE"));
+            current_variant_.audio             = dictionary_.intern(attrs.get("AUDIO"));
+            current_variant_.closed_captions   = dictionary_.intern(attrs.get("CLOSED-CAPTIONS"));
+
+            expecting_uri_ = true;
+        }
+        else if (expecting_uri_) {
+            current_variant_.uri = line;
+            variants_.emplace_back(std::move(current_variant_));
+            expecting_uri_ = false;
         }
+    }
 
+    void finish() override {
         if (variants_.empty()) {
             throw std::runtime_error("No stream variants found in master playlist");
         }
+        this->orderInterned(dictionary_);
     }
 
-    // provide access to the container
-    std::vector<VideoStreamVariant>& getContainer() { return variants_; }
+    // Values of the interned attributes
+    const Dictionary& dictionary() const { return dictionary_; }
 
-    /*  Map of comparison functions for each attribute */
-private:
-    using ComparisonFunc = std::function<bool(const VideoStreamVariant&, const VideoStreamVariant&)>;
-    // Mapping between attributes and their comparators
-    const std::unordered_map<SortAttribute, ComparisonFunc> comparisons_ = {
-            {SortAttribute::BANDWIDTH, [](const VideoStreamVariant& a, const VideoStreamVariant& b){
-                return a.bandwidth < b.bandwidth;
-            }},
-            {SortAttribute::AVERAGE_BANDWIDTH, [](const VideoStreamVariant& a, const VideoStreamVariant& b){
-                return a.avg_bandwidth < b.avg_bandwidth;
-            }},
-            {SortAttribute::CODECS, [](const VideoStreamVariant& a, const VideoStreamVariant& b){
-                return a.codecs < b.codecs;
-            }},
-            {SortAttribute::RESOLUTION, [](const VideoStreamVariant& a, const VideoStreamVariant& b){
-                return a.resolution_height < b.resolution_height;
-            }},
-            {SortAttribute::FRAME_RATE, [](const VideoStreamVariant& a, const VideoStreamVariant& b){
-                return a.frame_rate < b.frame_rate;
-            }},
-            {SortAttribute::VIDEO_RANGE, [](const VideoStreamVariant& a, const VideoStreamVariant& b){
-                return a.video_range < b.video_range;
-            }},
-            {SortAttribute::AUDIO, [](const VideoStreamVariant& a, const VideoStreamVariant& b){
-                return a.audio < b.audio;
-            }},
-            {SortAttribute::CLOSED_CAPTIONS, [](const VideoStreamVariant& a, const VideoStreamVariant& b){
-                return a.closed_captions < b.closed_captions;
-            }}
-    };
+    // Whether a tag line was parsed and its URI line is still to come
+    bool expectingUri() const { return expecting_uri_; }
 
-public:
-    // provide access to the comparisons map
-    const std::unordered_map<SortAttribute, ComparisonFunc>& getComparisons() const {
-        return comparisons_;
+    // Attributes queries filter on; the group is the AUDIO group
+    RenditionKeys queryKeys(const Variant& variant) const {
+        return {variant.bandwidth, variant.resolution_height, dictionary_.value(variant.codecs),
+                dictionary_.value(variant.video_range), dictionary_.value(variant.audio), {}};
     }
-};
 
+    // provide access to the container
+    std::pmr::vector<Variant>& getContainer() { return variants_; }
+
+    // Element member compared for each supported sort attribute
+    using SortProjections = std::tuple<
+            SortProjection<SortAttribute::BANDWIDTH, &Variant::bandwidth>,
+            SortProjection<SortAttribute::AVERAGE_BANDWIDTH, &Variant::avg_bandwidth>,
+            SortProjection<SortAttribute::CODECS, &Variant::codecs>,
+            SortProjection<SortAttribute::RESOLUTION, &Variant::resolution_height>,
+            SortProjection<SortAttribute::FRAME_RATE, &Variant::frame_rate>,
+            SortProjection<SortAttribute::VIDEO_RANGE, &Variant::video_range>,
+            SortProjection<SortAttribute::AUDIO, &Variant::audio>,
+            SortProjection<SortAttribute::CLOSED_CAPTIONS, &Variant::closed_captions>
+    >;
+
+private:
+    // Variant whose tag line was seen, waiting for its URI line
+    Variant current_variant_;
+    bool expecting_uri_ = false;
+    Dictionary dictionary_;
+};
 
+using StreamInfParser     = BasicStreamInfParser<std::string>;
+using StreamInfViewParser = BasicStreamInfParser<std::string_view>;
 
 #endif //HLS_FETCH_AND_SORT_STREAMINFPARSER_H
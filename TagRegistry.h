@@ -0,0 +1,92 @@
+//
+// Compile-time tag name -> handler tables with perfect-hash lookup
+//
+
+#ifndef HLS_FETCH_AND_SORT_TAGREGISTRY_H
+#define HLS_FETCH_AND_SORT_TAGREGISTRY_H
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// One registration: lines carrying tag are handled by handler.
+template<typename Handler>
+struct TagEntry {
+    std::string_view tag;
+    Handler          handler;
+};
+
+/**
+ * @brief Maps tag names to handlers through a perfect hash found at compile time.
+ *
+ * The constructor searches for a seed under which the seeded FNV-1a hashes of all tags land
+ * in distinct slots of a power-of-two table, so a lookup is one hash of the tag name, one
+ * slot and one string comparison, however many tags are registered. Build registries with
+ * makeTagRegistry() in a constexpr context: a registry for which no seed is found (or that
+ * names a tag twice) fails to compile.
+ *
+ * @tparam Handler  Value stored per tag, typically an enum naming who handles the line.
+ * @tparam N        Number of registered tags.
+ */
+template<typename Handler, size_t N>
+class TagRegistry {
+public:
+    static constexpr size_t kSlots = std::bit_ceil(N * 4);
+
+    constexpr explicit TagRegistry(const TagEntry<Handler> (&entries)[N]) {
+        for (uint32_t seed = 1; seed <= kMaxSeed; ++seed) {
+            if (place(entries, seed)) return;
+        }
+        throw "No perfect hash seed found for the tag registry";
+    }
+
+    // Handler registered for tag, nullptr for tags without one.
+    constexpr const Handler* find(std::string_view tag) const {
+        const Slot& slot = slots_[hash(tag, seed_) & (kSlots - 1)];
+        return slot.used && slot.tag == tag ? &slot.handler : nullptr;
+    }
+
+    constexpr size_t size() const { return N; }
+
+private:
+    static constexpr uint32_t kMaxSeed = 4096;
+
+    struct Slot {
+        std::string_view tag;
+        Handler          handler{};
+        bool             used = false;
+    };
+
+    std::array<Slot, kSlots> slots_{};
+    uint32_t                 seed_ = 0;
+
+    static constexpr uint32_t hash(std::string_view tag, uint32_t seed) {
+        uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+        for (char c : tag) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 16777619u;
+        }
+        return h ^ (h >> 15);
+    }
+
+    constexpr bool place(const TagEntry<Handler> (&entries)[N], uint32_t seed) {
+        slots_ = {};
+        for (const TagEntry<Handler>& entry : entries) {
+            Slot& slot = slots_[hash(entry.tag, seed) & (kSlots - 1)];
+            if (slot.used) return false;
+            slot = {entry.tag, entry.handler, true};
+        }
+        seed_ = seed;
+        return true;
+    }
+};
+
+// Builds a registry from a list of entries, e.g. makeTagRegistry<Handler>({{"#EXT-X-MEDIA", Handler::AUDIO}, ...}).
+template<typename Handler, size_t N>
+constexpr TagRegistry<Handler, N> makeTagRegistry(const TagEntry<Handler> (&entries)[N]) {
+    return TagRegistry<Handler, N>(entries);
+}
+
+#endif //HLS_FETCH_AND_SORT_TAGREGISTRY_H
@@ -0,0 +1,245 @@
+//
+// Coroutine tasks and the primitives scheduling them onto thread pools
+//
+
+#ifndef HLS_FETCH_AND_SORT_TASK_H
+#define HLS_FETCH_AND_SORT_TASK_H
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include "ThreadPool.h"
+
+template<typename T>
+class Task;
+
+namespace detail {
+
+// Result slot and continuation shared by the promises of Task<T> and Task<void>
+class TaskPromiseBase {
+public:
+    // Resumes whoever awaited the task once its body has finished (symmetric transfer, so
+    // long chains of tasks completing at once do not grow the stack).
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            std::coroutine_handle<> continuation = handle.promise().continuation_;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error_ = std::current_exception(); }
+
+    void setContinuation(std::coroutine_handle<> continuation) { continuation_ = continuation; }
+
+protected:
+    std::coroutine_handle<> continuation_;
+    std::exception_ptr      error_;
+
+    void rethrowIfFailed() const {
+        if (error_) std::rethrow_exception(error_);
+    }
+};
+
+template<typename T>
+class TaskPromise : public TaskPromiseBase {
+public:
+    Task<T> get_return_object();
+
+    template<typename Value>
+    void return_value(Value&& value) { value_.emplace(std::forward<Value>(value)); }
+
+    T result() {
+        rethrowIfFailed();
+        return std::move(*value_);
+    }
+
+private:
+    std::optional<T> value_;
+};
+
+template<>
+class TaskPromise<void> : public TaskPromiseBase {
+public:
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void result() { rethrowIfFailed(); }
+};
+
+} // namespace detail
+
+/**
+ * @brief Lazily started coroutine producing a T.
+ *
+ * The body starts when the task is first co_awaited and the awaiting coroutine resumes, on
+ * whatever thread the body finished on, with the result or the exception that escaped the
+ * body. A task is owned by exactly one Task object and awaited at most once.
+ *
+ * Example:
+ *
+ *     Task<size_t> countVariants(AsyncFetcher& fetcher, ThreadPool& cpu, std::string url) {
+ *         FetchResult result = co_await fetcher.fetch(url);
+ *         co_await schedule(cpu);                    // parse on the CPU pool, not the I/O loop
+ *         M3U8ViewParser parser;
+ *         parser.parse(std::move(result.body));
+ *         co_return parser.select<ParserType::STREAM>().elements().size();
+ *     }
+ */
+template<typename T = void>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task() = default;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) handle_.destroy();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    ~Task() {
+        if (handle_) handle_.destroy();
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() const noexcept { return !handle || handle.done(); }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().setContinuation(awaiting);
+                return handle;
+            }
+
+            T await_resume() { return handle.promise().result(); }
+        };
+        return Awaiter{handle_};
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+template<typename T>
+Task<T> detail::TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> detail::TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+/**
+ * @brief Awaitable moving the awaiting coroutine onto a worker of pool.
+ *
+ *     co_await schedule(cpu_pool);     // everything below runs on a worker of cpu_pool
+ */
+inline auto schedule(ThreadPool& pool) {
+    struct Awaiter {
+        ThreadPool& pool;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { pool.submit([handle] { handle.resume(); }); }
+        void await_resume() const noexcept {}
+    };
+    return Awaiter{pool};
+}
+
+/**
+ * @brief Runs detached tasks and waits for all of them from an ordinary thread.
+ *
+ * spawn() starts a task right away on the calling thread; it runs until its first
+ * suspension and continues wherever its awaits resume it. wait() blocks until every
+ * spawned task has finished and rethrows the first exception that escaped one of them.
+ * A spawned task costs its coroutine frames only, no thread.
+ */
+class TaskGroup {
+public:
+    TaskGroup() = default;
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    // Blocks until the spawned tasks are done, so none outlives the group.
+    ~TaskGroup() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        all_done_.wait(lock, [this] { return running_ == 0; });
+    }
+
+    void spawn(Task<void> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++running_;
+        }
+        run(this, std::move(task));
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        all_done_.wait(lock, [this] { return running_ == 0; });
+        if (error_) std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+
+private:
+    std::mutex              mutex_;
+    std::condition_variable all_done_;
+    size_t                  running_ = 0;
+    std::exception_ptr      error_;
+
+    // Eagerly started coroutine that destroys its own frame when it finishes
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() noexcept { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+    };
+
+    static Detached run(TaskGroup* group, Task<void> task) {
+        std::exception_ptr error;
+        {
+            // The task's frames are released before the group learns it is done, so state
+            // they reference may be torn down as soon as wait() returns.
+            Task<void> owned = std::move(task);
+            try {
+                co_await std::move(owned);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        group->finished(error);
+    }
+
+    void finished(std::exception_ptr error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (error && !error_) error_ = error;
+        if (--running_ == 0) all_done_.notify_all();
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_TASK_H
@@ -0,0 +1,207 @@
+//
+// Work-stealing thread pool for CPU and blocking I/O jobs
+//
+
+#ifndef HLS_FETCH_AND_SORT_THREADPOOL_H
+#define HLS_FETCH_AND_SORT_THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Fixed-size pool of workers, each with its own task deque.
+ *
+ * Tasks submitted from outside the pool are spread round-robin over the workers' deques;
+ * tasks submitted by a running task go to that worker's own deque. A worker takes its own
+ * newest task first (the data it just touched is still in cache) and, when its deque runs
+ * dry, steals the oldest task of another worker, so uneven jobs (a slow fetch next to a
+ * tiny local file) never leave cores idle while work is queued elsewhere.
+ *
+ * Example:
+ *
+ *     ThreadPool pool;                       // one worker per core
+ *     for (const auto& path : paths) pool.submit([&path] { process(path); });
+ *     pool.wait();
+ */
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    ThreadPool() : ThreadPool(std::max(1u, std::thread::hardware_concurrency())) {}
+
+    explicit ThreadPool(size_t threads) {
+        if (threads == 0) throw std::invalid_argument("ThreadPool requires at least one thread");
+        for (size_t i = 0; i < threads; ++i) {
+            queues_.emplace_back(std::make_unique<Queue>());
+        }
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    /**
+     * @brief Runs the tasks still queued, then joins the workers.
+     *
+     * Tasks the workers submit meanwhile are queued and run as well. Threads outside the pool
+     * (e.g. a worker of another pool resuming a coroutine here) must have finished submitting
+     * before destruction begins: a submit() already under way is waited for, a later one is
+     * rejected with std::logic_error.
+     */
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);      // pairs with the sleeping worker's predicate check
+            stopping_ = true;
+        }
+        // Submissions that passed the stopping_ check may still be queueing or notifying
+        while (submitting_ > 0) std::this_thread::yield();
+        work_available_.notify_all();
+        for (auto& worker : workers_) worker.join();
+
+        // Workers exit only with the deques empty; drain anyway so no queued task is ever dropped
+        for (Task task; take(0, task);) {
+            --queued_;
+            run(task);
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers_.size(); }
+
+    // @throws std::logic_error if called from outside the pool while it is being destroyed.
+    void submit(Task task) {
+        const bool own = current_pool_ == this;
+        // The destructor joins the workers, so only outside callers need the handshake.
+        // Announced before stopping_ is read, and stopping_ set before the destructor reads
+        // submitting_ (all sequentially consistent): either this call sees stopping_, or the
+        // destructor waits for it to return
+        if (!own) {
+            ++submitting_;
+            if (stopping_) {
+                --submitting_;
+                throw std::logic_error("ThreadPool::submit() from outside the pool during its destruction");
+            }
+        }
+        size_t index = own ? current_index_ : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+        ++pending_;
+        ++queued_;
+        {
+            std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+            queues_[index]->tasks.push_back(std::move(task));
+        }
+        // A worker about to sleep counted itself in sleeping_ before checking queued_, so if
+        // none is counted here, the new task cannot be missed and mutex_ stays untouched
+        if (sleeping_ > 0) {
+            { std::lock_guard<std::mutex> lock(mutex_); }
+            work_available_.notify_one();
+        }
+        if (!own) --submitting_;        // last access: the pool may be destroyed from here on
+    }
+
+    /**
+     * @brief Blocks until every submitted task has finished.
+     *
+     * Rethrows the first exception that escaped a task since the last wait(). Must not be
+     * called from inside a task.
+     */
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        all_done_.wait(lock, [this] { return pending_ == 0; });
+        if (error_) std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+
+private:
+    struct Queue {
+        std::mutex       mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread>            workers_;
+
+    std::mutex              mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable all_done_;
+    std::atomic<bool>       stopping_{false};
+    std::exception_ptr      error_;
+
+    std::atomic<size_t> pending_{0};       // submitted and not yet finished
+    std::atomic<size_t> queued_{0};        // submitted and not yet taken by a worker
+    std::atomic<size_t> next_queue_{0};
+    std::atomic<size_t> submitting_{0};    // submit() calls in progress
+    std::atomic<size_t> sleeping_{0};      // workers waiting for work, or about to
+
+    // Identifies the pool and deque of the calling worker thread
+    static inline thread_local ThreadPool* current_pool_  = nullptr;
+    static inline thread_local size_t      current_index_ = 0;
+
+    // Takes the newest task of the worker's own deque, or steals the oldest of another one.
+    bool take(size_t index, Task& task) {
+        {
+            Queue& own = *queues_[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < queues_.size(); ++offset) {
+            Queue& victim = *queues_[(index + offset) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Runs a taken task, keeping its exception for wait().
+    void run(Task& task) {
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_) error_ = std::current_exception();
+        }
+        if (--pending_ == 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            all_done_.notify_all();
+        }
+    }
+
+    void workerLoop(size_t index) {
+        current_pool_  = this;
+        current_index_ = index;
+
+        while (true) {
+            Task task;
+            if (take(index, task)) {
+                --queued_;
+                run(task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            ++sleeping_;
+            work_available_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+            --sleeping_;
+            if (stopping_ && queued_ == 0) return;
+        }
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_THREADPOOL_H
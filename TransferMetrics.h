@@ -0,0 +1,49 @@
+//
+// Timing and size of a single curl transfer
+//
+
+#ifndef HLS_FETCH_AND_SORT_TRANSFERMETRICS_H
+#define HLS_FETCH_AND_SORT_TRANSFERMETRICS_H
+
+#include <curl/curl.h>
+#include <cstdint>
+
+/**
+ * @brief Phase timings of a finished transfer, as reported by curl_easy_getinfo.
+ *
+ * All times are in seconds from the start of the transfer and cumulative, i.e.
+ * name_lookup <= connect <= tls <= first_byte <= total. tls equals connect for plain HTTP
+ * and all phases are 0 for a connection reused from the cache.
+ */
+struct TransferMetrics {
+    double   name_lookup = 0.0;     // DNS resolution done
+    double   connect     = 0.0;     // TCP connection established
+    double   tls         = 0.0;     // TLS handshake done
+    double   first_byte  = 0.0;     // first response byte received
+    double   total       = 0.0;
+    uint64_t bytes       = 0;       // body bytes on the wire, i.e. before Content-Encoding is undone
+    long     http_code   = 0;
+
+    static TransferMetrics collect(CURL* curl) {
+        TransferMetrics metrics;
+        auto seconds = [curl](CURLINFO info) {
+            curl_off_t micros = 0;
+            curl_easy_getinfo(curl, info, &micros);
+            return static_cast<double>(micros) / 1e6;
+        };
+        metrics.name_lookup = seconds(CURLINFO_NAMELOOKUP_TIME_T);
+        metrics.connect     = seconds(CURLINFO_CONNECT_TIME_T);
+        metrics.tls         = seconds(CURLINFO_APPCONNECT_TIME_T);
+        metrics.first_byte  = seconds(CURLINFO_STARTTRANSFER_TIME_T);
+        metrics.total       = seconds(CURLINFO_TOTAL_TIME_T);
+        if (metrics.tls < metrics.connect) metrics.tls = metrics.connect;    // 0 without TLS
+
+        curl_off_t bytes = 0;
+        curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+        metrics.bytes = static_cast<uint64_t>(bytes);
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &metrics.http_code);
+        return metrics;
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_TRANSFERMETRICS_H
@@ -0,0 +1,176 @@
+//
+// Deterministic synthetic playlists for the benchmarks
+//
+
+#ifndef HLS_FETCH_AND_SORT_PLAYLISTGENERATOR_H
+#define HLS_FETCH_AND_SORT_PLAYLISTGENERATOR_H
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Generates master and media playlists of configurable shape.
+ *
+ * Output depends only on the options (mt19937_64 is fully specified and raw engine output
+ * is used instead of the implementation-defined distributions), so benchmark results stay
+ * comparable across machines, standard libraries and versions.
+ */
+class PlaylistGenerator {
+public:
+    struct MasterOptions {
+        size_t   variants     = 32;
+        size_t   audio_tracks = 8;
+        size_t   iframes      = 8;
+        // Share of lines (0..1) carrying the optional attributes (AVERAGE-BANDWIDTH,
+        // FRAME-RATE, VIDEO-RANGE, CLOSED-CAPTIONS, LANGUAGE, CHANNELS, ...).
+        double   optional_attributes = 1.0;
+        size_t   uri_length   = 32;       // padded length of every URI
+        uint64_t seed         = 1;
+    };
+
+    struct MediaOptions {
+        size_t   segments          = 10000;
+        double   target_duration   = 6.0;
+        double   byterange_ratio   = 0.0;      // share of segments addressed by EXT-X-BYTERANGE
+        size_t   key_rotation      = 0;        // new EXT-X-KEY every N segments, 0 = unencrypted
+        size_t   discontinuity     = 0;        // EXT-X-DISCONTINUITY every N segments, 0 = none
+        bool     program_date_time = false;
+        size_t   uri_length        = 32;
+        uint64_t seed              = 1;
+    };
+
+    static std::string master(const MasterOptions& options) {
+        std::mt19937_64 rng(options.seed);
+        std::string out = "#EXTM3U\n#EXT-X-INDEPENDENT-SEGMENTS\n\n";
+
+        static constexpr std::array<std::string_view, 6> codecs = {
+            "avc1.640028,mp4a.40.2", "avc1.64001f,mp4a.40.2", "hvc1.2.4.L150.90,ec-3",
+            "hvc1.2.4.L90.90,mp4a.40.2", "dvh1.05.06,ec-3", "hvc1.2.4.L123.90,mp4a.40.2"
+        };
+        static constexpr std::array<int, 6> heights = {360, 540, 720, 1080, 1440, 2160};
+        static constexpr std::array<std::string_view, 3> ranges = {"SDR", "PQ", "HLG"};
+        static constexpr std::array<std::string_view, 3> rates = {"23.976", "25.000", "59.940"};
+        static constexpr std::array<std::string_view, 4> groups = {"aac-128k", "aac-64k", "atmos", "ac3"};
+        static constexpr std::array<std::string_view, 6> languages = {"en", "de", "fr", "es", "ja", "pt"};
+        static constexpr std::array<std::string_view, 4> channels = {"2", "6", "16/JOC", "1"};
+
+        for (size_t i = 0; i < options.variants; ++i) {
+            int height = heights[pick(rng, heights.size())];
+            uint64_t bandwidth = 200000 + rng() % 20000000;
+            out += "#EXT-X-STREAM-INF:BANDWIDTH=" + std::to_string(bandwidth);
+            if (optional(rng, options)) out += ",AVERAGE-BANDWIDTH=" + std::to_string(bandwidth * 7 / 10);
+            out += ",CODECS=\"" + std::string(codecs[pick(rng, codecs.size())]) + "\"";
+            out += ",RESOLUTION=" + std::to_string(height * 16 / 9) + "x" + std::to_string(height);
+            if (optional(rng, options)) out += ",FRAME-RATE=" + std::string(rates[pick(rng, rates.size())]);
+            if (optional(rng, options)) out += ",VIDEO-RANGE=" + std::string(ranges[pick(rng, ranges.size())]);
+            out += ",AUDIO=\"" + std::string(groups[pick(rng, groups.size())]) + "\"";
+            if (optional(rng, options)) out += ",CLOSED-CAPTIONS=NONE";
+            out += '\n';
+            out += uri("video/" + std::to_string(height) + "p/" + std::to_string(i), options.uri_length) + '\n';
+        }
+        out += '\n';
+
+        for (size_t i = 0; i < options.audio_tracks; ++i) {
+            std::string_view language = languages[pick(rng, languages.size())];
+            out += "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"" + std::string(groups[pick(rng, groups.size())]) + "\"";
+            out += ",NAME=\"Track " + std::to_string(i) + "\"";
+            if (optional(rng, options)) out += ",LANGUAGE=\"" + std::string(language) + "\"";
+            out += std::string(",DEFAULT=") + (i == 0 ? "YES" : "NO");
+            out += std::string(",AUTOSELECT=") + (rng() % 2 ? "YES" : "NO");
+            if (optional(rng, options)) out += ",CHANNELS=\"" + std::string(channels[pick(rng, channels.size())]) + "\"";
+            out += ",URI=\"" + uri("audio/" + std::string(language) + "/" + std::to_string(i), options.uri_length) + "\"\n";
+        }
+        out += '\n';
+
+        for (size_t i = 0; i < options.iframes; ++i) {
+            int height = heights[pick(rng, heights.size())];
+            out += "#EXT-X-I-FRAME-STREAM-INF:BANDWIDTH=" + std::to_string(20000 + rng() % 1000000);
+            out += ",CODECS=\"" + std::string(codecs[pick(rng, codecs.size())].substr(0, 11)) + "\"";
+            out += ",RESOLUTION=" + std::to_string(height * 16 / 9) + "x" + std::to_string(height);
+            if (optional(rng, options)) out += ",VIDEO-RANGE=" + std::string(ranges[pick(rng, ranges.size())]);
+            out += ",URI=\"" + uri("iframe/" + std::to_string(height) + "p/" + std::to_string(i), options.uri_length) + "\"\n";
+        }
+        return out;
+    }
+
+    static std::string media(const MediaOptions& options) {
+        std::mt19937_64 rng(options.seed);
+        std::string out = "#EXTM3U\n#EXT-X-VERSION:7\n#EXT-X-TARGETDURATION:" +
+                          std::to_string(static_cast<int>(options.target_duration + 0.5)) +
+                          "\n#EXT-X-MEDIA-SEQUENCE:0\n#EXT-X-PLAYLIST-TYPE:VOD\n";
+        out += "#EXT-X-MAP:URI=\"" + uri("init", options.uri_length, ".mp4") + "\"\n";
+
+        uint64_t offset = 0;
+        int64_t  timestamp = 1700000000;
+        for (size_t i = 0; i < options.segments; ++i) {
+            if (options.key_rotation && i % options.key_rotation == 0) {
+                out += "#EXT-X-KEY:METHOD=AES-128,URI=\"" + uri("key/" + std::to_string(i), options.uri_length, ".key") +
+                       "\",IV=0x" + std::to_string(1000000000000000ull + i) + "\n";
+            }
+            if (options.discontinuity && i > 0 && i % options.discontinuity == 0) {
+                out += "#EXT-X-DISCONTINUITY\n";
+            }
+            if (options.program_date_time) {
+                out += "#EXT-X-PROGRAM-DATE-TIME:" + dateTime(timestamp) + "\n";
+            }
+            // Durations within 90-100% of the target, in milliseconds
+            int millis = static_cast<int>(options.target_duration * 1000) * (90 + static_cast<int>(rng() % 11)) / 100;
+            out += "#EXTINF:" + std::to_string(millis / 1000) + "." + pad3(millis % 1000) + ",\n";
+            timestamp += millis / 1000;
+
+            if (static_cast<double>(rng() % 1000) < options.byterange_ratio * 1000) {
+                uint64_t length = 500000 + rng() % 1500000;
+                out += "#EXT-X-BYTERANGE:" + std::to_string(length) + "@" + std::to_string(offset) + "\n";
+                offset += length;
+                out += uri("media", options.uri_length, ".m4s") + "\n";
+            } else {
+                out += uri("segment" + std::to_string(i), options.uri_length, ".m4s") + "\n";
+            }
+        }
+        out += "#EXT-X-ENDLIST\n";
+        return out;
+    }
+
+private:
+    static size_t pick(std::mt19937_64& rng, size_t count) { return static_cast<size_t>(rng() % count); }
+
+    static bool optional(std::mt19937_64& rng, const MasterOptions& options) {
+        return static_cast<double>(rng() % 1000) < options.optional_attributes * 1000;
+    }
+
+    // stem padded with 'x' to length characters (never truncated), plus extension
+    static std::string uri(const std::string& stem, size_t length, std::string_view extension = ".m3u8") {
+        std::string result = stem;
+        if (result.size() < length) result.append(length - result.size(), 'x');
+        return result.append(extension);
+    }
+
+    static std::string pad3(int value) {
+        std::string digits = std::to_string(value);
+        return std::string(3 - digits.size(), '0') + digits;
+    }
+
+    // Seconds since the epoch as an ISO 8601 UTC date-time
+    static std::string dateTime(int64_t seconds) {
+        int64_t days = seconds / 86400, rem = seconds % 86400;
+        // Civil-from-days (Howard Hinnant's algorithm)
+        days += 719468;
+        int64_t era = days / 146097, doe = days - era * 146097;
+        int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100), mp = (5 * doy + 2) / 153;
+        int64_t day = doy - (153 * mp + 2) / 5 + 1, month = mp < 10 ? mp + 3 : mp - 9;
+        int64_t year = yoe + era * 400 + (month <= 2);
+        char buffer[64];
+        std::snprintf(buffer, sizeof(buffer), "%04lld-%02lld-%02lldT%02lld:%02lld:%02lld.000Z",
+                      static_cast<long long>(year), static_cast<long long>(month), static_cast<long long>(day),
+                      static_cast<long long>(rem / 3600), static_cast<long long>(rem % 3600 / 60),
+                      static_cast<long long>(rem % 60));
+        return buffer;
+    }
+};
+
+#endif //HLS_FETCH_AND_SORT_PLAYLISTGENERATOR_H
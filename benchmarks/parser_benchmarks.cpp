@@ -0,0 +1,505 @@
+/*
+ *   Microbenchmarks for parsing, sorting and writing playlists
+ *
+ *   Run with --benchmark_out=results.json --benchmark_out_format=json to record results,
+ *   or build the benchmark_json target which does exactly that.
+ */
+
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <bit>
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "AttributeList.h"
+#include "DelimiterScanner.h"
+#include "HLSWriter.h"
+#include "M3U8Parser.h"
+#include "MediaPlaylistParser.h"
+#include "PlaylistDiff.h"
+#include "PlaylistGenerator.h"
+#include "PlaylistSnapshot.h"
+#include "SortSpec.h"
+
+using SortAttribute = HLSTagParser::SortAttribute;
+
+namespace {
+
+// Master playlist with n variants, n audio tracks and n I-frame variants.
+const std::string& masterPlaylist(size_t n) {
+    static std::mutex mutex;                    // shared by multi-threaded benchmarks
+    std::lock_guard<std::mutex> lock(mutex);
+    static std::unordered_map<size_t, std::string> cache;
+    auto it = cache.find(n);
+    if (it == cache.end()) {
+        PlaylistGenerator::MasterOptions options;
+        options.variants = options.audio_tracks = options.iframes = n;
+        options.optional_attributes = 0.8;
+        it = cache.emplace(n, PlaylistGenerator::master(options)).first;
+    }
+    return it->second;
+}
+
+/*  Parsing */
+
+void BM_ParseOwning(benchmark::State& state) {
+    const std::string& playlist = masterPlaylist(state.range(0));
+    for (auto _ : state) {
+        M3U8Parser parser;
+        parser.parse(playlist);
+        benchmark::DoNotOptimize(parser);
+    }
+    state.SetBytesProcessed(state.iterations() * playlist.size());
+}
+BENCHMARK(BM_ParseOwning)->RangeMultiplier(8)->Range(8, 4096);
+
+void BM_ParseView(benchmark::State& state) {
+    const std::string& playlist = masterPlaylist(state.range(0));
+    for (auto _ : state) {
+        M3U8ViewParser parser;
+        parser.parse(std::string_view(playlist), nullptr);
+        benchmark::DoNotOptimize(parser);
+    }
+    state.SetBytesProcessed(state.iterations() * playlist.size());
+}
+BENCHMARK(BM_ParseView)->RangeMultiplier(8)->Range(8, 4096);
+
+// A parse session on a monotonic arena whose block is reused, as in the batch workers
+void BM_ParseViewArena(benchmark::State& state) {
+    const std::string& playlist = masterPlaylist(state.range(0));
+    std::vector<std::byte> block(4 * playlist.size() + 64 * 1024);
+    for (auto _ : state) {
+        std::pmr::monotonic_buffer_resource arena(block.data(), block.size());
+        M3U8ViewParser parser(&arena);
+        parser.parse(std::string_view(playlist), nullptr);
+        benchmark::DoNotOptimize(parser);
+    }
+    state.SetBytesProcessed(state.iterations() * playlist.size());
+}
+BENCHMARK(BM_ParseViewArena)->RangeMultiplier(8)->Range(8, 4096);
+
+// Parse and radix sort from several threads, where malloc contention shows
+template<bool UseArena>
+void BM_ParseAndSortThreaded(benchmark::State& state) {
+    const std::string& playlist = masterPlaylist(state.range(0));
+    std::vector<std::byte> block(4 * playlist.size() + 64 * 1024);
+    std::pmr::memory_resource* heap = std::pmr::new_delete_resource();
+    for (auto _ : state) {
+        std::pmr::monotonic_buffer_resource arena(block.data(), block.size());
+        M3U8ViewParser parser(UseArena ? static_cast<std::pmr::memory_resource*>(&arena) : heap);
+        parser.parse(std::string_view(playlist), nullptr);
+        parser.select<ParserType::STREAM>().sort(HLSTagParser::SortEngine::RADIX,
+                                                 SortAttribute::RESOLUTION, SortAttribute::BANDWIDTH);
+        benchmark::DoNotOptimize(parser);
+    }
+    state.SetBytesProcessed(state.iterations() * playlist.size());
+}
+BENCHMARK(BM_ParseAndSortThreaded<false>)->Name("BM_ParseAndSortThreaded/heap")->Arg(512)->ThreadRange(1, 8);
+BENCHMARK(BM_ParseAndSortThreaded<true>)->Name("BM_ParseAndSortThreaded/arena")->Arg(512)->ThreadRange(1, 8);
+
+// Parsing as fed from the network, in 16 KiB chunks
+void BM_ParseChunked(benchmark::State& state) {
+    const std::string& playlist = masterPlaylist(state.range(0));
+    constexpr size_t kChunk = 16 * 1024;
+    for (auto _ : state) {
+        M3U8ViewParser parser;
+        for (size_t pos = 0; pos < playlist.size(); pos += kChunk) {
+            parser.feed(std::string_view(playlist).substr(pos, kChunk));
+        }
+        parser.finish();
+        benchmark::DoNotOptimize(parser);
+    }
+    state.SetBytesProcessed(state.iterations() * playlist.size());
+}
+BENCHMARK(BM_ParseChunked)->RangeMultiplier(8)->Range(8, 4096);
+
+void BM_AttributeList(benchmark::State& state) {
+    const std::string line = "#EXT-X-STREAM-INF:BANDWIDTH=2483789,AVERAGE-BANDWIDTH=1762745,"
+                             "CODECS=\"mp4a.40.2,hvc1.2.4.L90.90\",RESOLUTION=960x540,FRAME-RATE=23.97,"
+                             "VIDEO-RANGE=PQ,AUDIO=\"aac-128k\",CLOSED-CAPTIONS=NONE";
+    for (auto _ : state) {
+        AttributeList attrs(line);
+        benchmark::DoNotOptimize(attrs.getInt("BANDWIDTH"));
+        benchmark::DoNotOptimize(attrs.get("CLOSED-CAPTIONS"));
+    }
+    state.SetBytesProcessed(state.iterations() * line.size());
+}
+BENCHMARK(BM_AttributeList);
+
+void BM_MediaPlaylistParse(benchmark::State& state) {
+    PlaylistGenerator::MediaOptions options;
+    options.segments          = state.range(0);
+    options.byterange_ratio   = 0.25;
+    options.key_rotation      = 100;
+    options.discontinuity     = 500;
+    options.program_date_time = true;
+    const std::string playlist = PlaylistGenerator::media(options);
+
+    for (auto _ : state) {
+        MediaPlaylistParser parser;
+        parser.parse(playlist);
+        benchmark::DoNotOptimize(parser.segments().size());
+    }
+    state.SetBytesProcessed(state.iterations() * playlist.size());
+    state.SetItemsProcessed(state.iterations() * options.segments);
+}
+BENCHMARK(BM_MediaPlaylistParse)->Arg(1000)->Arg(100000);
+
+void BM_MediaPlaylistScan(benchmark::State& state) {
+    PlaylistGenerator::MediaOptions options;
+    options.segments          = state.range(0);
+    options.program_date_time = true;
+    MediaPlaylistParser parser;
+    parser.parse(PlaylistGenerator::media(options));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parser.totalDuration());
+        benchmark::DoNotOptimize(parser.targetDurationViolations());
+        benchmark::DoNotOptimize(parser.programDateTimeGaps(0.5));
+    }
+    state.SetItemsProcessed(state.iterations() * options.segments);
+}
+BENCHMARK(BM_MediaPlaylistScan)->Arg(100000);
+
+/*  Delimiter scanning kernels, each checked against the scalar kernel before it is timed */
+
+// ~5 MB media playlist with byte ranges, keys and dates
+const std::string& scanPlaylist() {
+    static const std::string playlist = [] {
+        PlaylistGenerator::MediaOptions options;
+        options.segments          = 40000;
+        options.byterange_ratio   = 0.25;
+        options.key_rotation      = 100;
+        options.program_date_time = true;
+        return PlaylistGenerator::media(options);
+    }();
+    return playlist;
+}
+
+// Differential test: kernel and the scalar kernel agree on every block, at several block
+// alignments and for every length of a short final block.
+bool matchesScalar(const std::string& content, DelimiterScanner::Kernel kernel) {
+    using Kernel = DelimiterScanner::Kernel;
+    for (size_t offset : {0, 1, 7, 33, 63}) {
+        for (size_t pos = offset; pos < content.size(); pos += DelimiterScanner::kBlockSize) {
+            const size_t size = content.size() - pos;
+            if (DelimiterScanner::scan(content.data() + pos, size, kernel) !=
+                DelimiterScanner::scan(content.data() + pos, size, Kernel::SCALAR)) return false;
+        }
+    }
+    for (size_t pos = 0; pos < 256; ++pos) {
+        for (size_t size = 0; size <= DelimiterScanner::kBlockSize; ++size) {
+            if (DelimiterScanner::scan(content.data() + pos, size, kernel) !=
+                DelimiterScanner::scan(content.data() + pos, size, Kernel::SCALAR)) return false;
+        }
+    }
+    return true;
+}
+
+bool prepareScan(benchmark::State& state, DelimiterScanner::Kernel kernel) {
+    if (!DelimiterScanner::supported(kernel)) {
+        state.SkipWithError("Kernel not supported by this CPU");
+        return false;
+    }
+    if (!matchesScalar(scanPlaylist(), kernel)) {
+        state.SkipWithError("Masks differ from the scalar kernel");
+        return false;
+    }
+    return true;
+}
+
+// Raw kernel throughput: the masks of every 64-byte block, a window at a time
+void BM_DelimiterScan(benchmark::State& state, DelimiterScanner::Kernel kernel) {
+    if (!prepareScan(state, kernel)) return;
+    const std::string& content = scanPlaylist();
+    const DelimiterScanner::Function scan = DelimiterScanner::function(kernel);
+    DelimiterMasks masks[DelimiterScanner::kWindowBlocks];
+    for (auto _ : state) {
+        uint64_t delimiters = 0;
+        for (size_t pos = 0; pos < content.size();) {
+            const size_t blocks = scan(content.data() + pos, content.size() - pos, masks);
+            for (size_t i = 0; i < blocks; ++i) {
+                delimiters += std::popcount(masks[i].newline | masks[i].hash | masks[i].comma | masks[i].equals | masks[i].quote);
+            }
+            pos += blocks * DelimiterScanner::kBlockSize;
+        }
+        benchmark::DoNotOptimize(delimiters);
+    }
+    state.SetBytesProcessed(state.iterations() * content.size());
+}
+
+// Line splitting through M3U8Tokenizer with kernel active
+void BM_SplitLines(benchmark::State& state, DelimiterScanner::Kernel kernel) {
+    if (!prepareScan(state, kernel)) return;
+    const std::string& content = scanPlaylist();
+    DelimiterScanner::use(kernel);
+    for (auto _ : state) {
+        size_t lines = 0;
+        M3U8Tokenizer::forEachLine(content, [&lines](std::string_view) { ++lines; });
+        benchmark::DoNotOptimize(lines);
+    }
+    DelimiterScanner::use(DelimiterScanner::best());
+    state.SetBytesProcessed(state.iterations() * content.size());
+}
+
+const bool kScanBenchmarksRegistered = [] {
+    for (DelimiterScanner::Kernel kernel : DelimiterScanner::kKernels) {
+        const std::string name(DelimiterScanner::name(kernel));
+        benchmark::RegisterBenchmark(("BM_DelimiterScan/" + name).c_str(), BM_DelimiterScan, kernel);
+        benchmark::RegisterBenchmark(("BM_SplitLines/" + name).c_str(), BM_SplitLines, kernel);
+    }
+    return true;
+}();
+
+/*  Sorting: every attribute and every ordered pair of attributes of each sub-parser */
+
+template<ParserType T>
+void sortBenchmark(benchmark::State& state, std::vector<HLSTagParser::SortKey> keys, HLSTagParser::SortEngine engine) {
+    M3U8ViewParser parsed;
+    parsed.parse(std::string_view(masterPlaylist(state.range(0))), nullptr);
+    for (auto _ : state) {
+        state.PauseTiming();
+        M3U8ViewParser parser = parsed;         // restore playlist order
+        state.ResumeTiming();
+        parser.select<T>().sort(std::span<const HLSTagParser::SortKey>(keys), engine);
+        benchmark::DoNotOptimize(parser);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template<ParserType T>
+void registerSortBenchmarks(const char* group, std::initializer_list<SortAttribute> attributes) {
+    auto name = [group](std::initializer_list<SortAttribute> keys) {
+        std::string result = std::string("BM_Sort") + group + "/";
+        for (SortAttribute attr : keys) {
+            if (result.back() != '/') result += '+';
+            result += HLSTagParser::attributeName(attr);
+        }
+        return result;
+    };
+    auto add = [&name](std::initializer_list<SortAttribute> keys) {
+        std::vector<HLSTagParser::SortKey> list(keys.begin(), keys.end());
+        benchmark::RegisterBenchmark(name(keys).c_str(), sortBenchmark<T>, list, HLSTagParser::SortEngine::AUTO)
+                ->Arg(1024);
+    };
+    for (SortAttribute primary : attributes) {
+        add({primary});
+    }
+    for (SortAttribute primary : attributes) {
+        for (SortAttribute secondary : attributes) {
+            if (primary != secondary) add({primary, secondary});
+        }
+    }
+}
+
+const bool kSortBenchmarksRegistered = [] {
+    registerSortBenchmarks<ParserType::STREAM>("Stream", {
+        SortAttribute::BANDWIDTH, SortAttribute::AVERAGE_BANDWIDTH, SortAttribute::CODECS, SortAttribute::RESOLUTION,
+        SortAttribute::FRAME_RATE, SortAttribute::VIDEO_RANGE, SortAttribute::AUDIO, SortAttribute::CLOSED_CAPTIONS});
+    registerSortBenchmarks<ParserType::AUDIO>("Audio", {
+        SortAttribute::ID, SortAttribute::NAME, SortAttribute::LANGUAGE, SortAttribute::DEFAULT_,
+        SortAttribute::AUTOSELECT, SortAttribute::CHANNELS});
+    registerSortBenchmarks<ParserType::IFRAME>("IFrame", {
+        SortAttribute::BANDWIDTH, SortAttribute::CODECS, SortAttribute::RESOLUTION, SortAttribute::VIDEO_RANGE});
+
+    // Comparison vs. radix engine on the default ladder order, across sizes
+    const std::vector<HLSTagParser::SortKey> ladder = {SortAttribute::RESOLUTION, SortAttribute::BANDWIDTH};
+    for (auto [engine, name] : {std::pair{HLSTagParser::SortEngine::COMPARISON, "BM_SortEngine/COMPARISON"},
+                                std::pair{HLSTagParser::SortEngine::RADIX,      "BM_SortEngine/RADIX"}}) {
+        benchmark::RegisterBenchmark(name, sortBenchmark<ParserType::STREAM>, ladder, engine)
+                ->RangeMultiplier(8)->Range(64, 32768);
+    }
+    return true;
+}();
+
+/*  Queries: indexed rendition selection, per question once the index exists */
+
+void BM_QueryHighestVariant(benchmark::State& state) {
+    M3U8ViewParser parser;
+    parser.parse(std::string_view(masterPlaylist(state.range(0))), nullptr);
+    auto streams = parser.select<ParserType::STREAM>();
+    const RenditionQuery query{.max_bandwidth = 6'000'000, .codec_family = "hvc1,hev1", .video_range = "PQ"};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(streams.highest(query));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QueryHighestVariant)->RangeMultiplier(8)->Range(64, 32768);
+
+void BM_QueryAudioGroup(benchmark::State& state) {
+    M3U8ViewParser parser;
+    parser.parse(std::string_view(masterPlaylist(state.range(0))), nullptr);
+    auto audio = parser.select<ParserType::AUDIO>();
+    const RenditionQuery query{.group = "atmos", .language = "de"};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(audio.find(query));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QueryAudioGroup)->RangeMultiplier(8)->Range(64, 32768);
+
+/*  Serialization and writing */
+
+void BM_Stringify(benchmark::State& state) {
+    M3U8ViewParser parser;
+    parser.parse(std::string_view(masterPlaylist(state.range(0))), nullptr);
+    size_t size = parser.serializedSize();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parser.stringify());
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_Stringify)->RangeMultiplier(8)->Range(8, 4096);
+
+void BM_WriteFile(benchmark::State& state) {
+    M3U8ViewParser parser;
+    parser.parse(std::string_view(masterPlaylist(state.range(0))), nullptr);
+    char directory[] = "/tmp/hls_benchmark_XXXXXX";
+    if (!::mkdtemp(directory)) {
+        state.SkipWithError("Could not create a temporary directory");
+        return;
+    }
+    HLSWriter writer(std::string(directory) + "/playlist.m3u8");
+    for (auto _ : state) {
+        writer.write(parser);
+    }
+    state.SetBytesProcessed(state.iterations() * parser.serializedSize());
+    ::unlink(writer.getFileName().c_str());
+    ::rmdir(directory);
+}
+BENCHMARK(BM_WriteFile)->RangeMultiplier(8)->Range(8, 4096);
+
+// Streaming to a descriptor without building the output string
+void BM_WriteToDescriptor(benchmark::State& state) {
+    M3U8ViewParser parser;
+    parser.parse(std::string_view(masterPlaylist(state.range(0))), nullptr);
+    int fd = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+    for (auto _ : state) {
+        HLSWriter::writeTo(fd, parser);
+    }
+    ::close(fd);
+    state.SetBytesProcessed(state.iterations() * parser.serializedSize());
+}
+BENCHMARK(BM_WriteToDescriptor)->RangeMultiplier(8)->Range(8, 4096);
+
+// Pre-compressed copy at the default level; range(0) is the Encoding (0 gzip, 1 brotli)
+void BM_CompressToDescriptor(benchmark::State& state) {
+    auto encoding = static_cast<Encoding>(state.range(0));
+    if (!CompressionSink::available(encoding)) {
+        state.SkipWithError("Encoding not compiled in");
+        return;
+    }
+    M3U8ViewParser parser;
+    parser.parse(std::string_view(masterPlaylist(state.range(1))), nullptr);
+    int fd = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+    for (auto _ : state) {
+        CompressionSink out(fd, encoding);
+        parser.serialize(out);
+        out.finish();
+    }
+    ::close(fd);
+    state.SetBytesProcessed(state.iterations() * parser.serializedSize());
+}
+BENCHMARK(BM_CompressToDescriptor)->ArgNames({"encoding", "variants"})->ArgsProduct({{0, 1}, {8, 512, 4096}});
+
+/*  Snapshots */
+
+void BM_SnapshotBuild(benchmark::State& state) {
+    M3U8ViewParser parser;
+    parser.parse(std::string_view(masterPlaylist(state.range(0))), nullptr);
+    size_t size = 0;
+    for (auto _ : state) {
+        std::string bytes = SnapshotBuilder(parser).bytes();
+        size = bytes.size();
+        benchmark::DoNotOptimize(bytes);
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_SnapshotBuild)->RangeMultiplier(8)->Range(8, 4096);
+
+// Opening validates every record; compare with BM_ParseView for the startup cost saved.
+// Checks the round trip to the parser's output before it is timed.
+void BM_SnapshotOpen(benchmark::State& state) {
+    M3U8ViewParser parser;
+    parser.parse(std::string_view(masterPlaylist(state.range(0))), nullptr);
+    parser.select<ParserType::STREAM>().sort(SortAttribute::RESOLUTION, SortAttribute::BANDWIDTH);
+    std::string bytes = SnapshotBuilder(parser).bytes();
+    if (PlaylistSnapshot(bytes, nullptr).stringify() != parser.stringify()) {
+        state.SkipWithError("Snapshot does not reproduce the playlist");
+        return;
+    }
+    for (auto _ : state) {
+        PlaylistSnapshot snapshot(bytes, nullptr);
+        benchmark::DoNotOptimize(snapshot.variants().data());
+    }
+    state.SetBytesProcessed(state.iterations() * bytes.size());
+}
+BENCHMARK(BM_SnapshotOpen)->RangeMultiplier(8)->Range(8, 4096);
+
+/*  Republishing: diff against the previous sorted version */
+
+// masterPlaylist(n) with the BANDWIDTH of changes evenly spread variants raised.
+std::string republished(size_t n, size_t changes) {
+    const std::string& playlist = masterPlaylist(n);
+    std::string result;
+    result.reserve(playlist.size() + changes);
+    const size_t stride = changes ? n / changes : 0;
+    size_t variant = 0;
+    M3U8Tokenizer::forEachLine(playlist, [&](std::string_view line) {
+        if (line.starts_with("#EXT-X-STREAM-INF:")) {
+            const bool change = stride && variant % stride == 0 && variant / stride < changes;
+            ++variant;
+            size_t value = line.find(":BANDWIDTH=");
+            if (value == std::string_view::npos) value = line.find(",BANDWIDTH=");
+            if (change && value != std::string_view::npos) {
+                value += std::string_view(":BANDWIDTH=").size();
+                result.append(line.substr(0, value)).append("1").append(line.substr(value)).append("\n");
+                return;
+            }
+        }
+        result.append(line).append("\n");
+    });
+    return result;
+}
+
+// Diffs a new version of the playlist, sorted, against the previous sorted output, as
+// --incremental does when the bytes differ. Args: variants, changed variants. Checks the
+// change count, and that a changed spec is reported as a reorder, before it is timed.
+void BM_Diff(benchmark::State& state) {
+    const SortSpec spec = SortSpec::parse(SortSpec::kDefault);
+    M3U8ViewParser sorted;
+    sorted.parse(std::string_view(masterPlaylist(state.range(0))), nullptr);
+    spec.apply(sorted);
+    M3U8ViewParser previous;                    // as read back from the previous output
+    previous.parse(sorted.stringify());
+    M3U8ViewParser parser;
+    parser.parse(republished(state.range(0), state.range(1)));
+    M3U8ViewParser reversed = parser;
+    spec.apply(parser);
+    SortSpec::parse("stream=-RESOLUTION,-BANDWIDTH;audio=-ID;iframe=-CODECS").apply(reversed);
+
+    PlaylistDiff diff = PlaylistDiff::compare(previous, parser);
+    if (diff.changes.size() != static_cast<size_t>(state.range(1)) || diff.reordered) {
+        state.SkipWithError("Diff does not find the changed variants");
+        return;
+    }
+    if (!PlaylistDiff::compare(previous, reversed).reordered) {
+        state.SkipWithError("Diff does not find the reorder of a changed spec");
+        return;
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(PlaylistDiff::compare(previous, parser));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Diff)->ArgNames({"variants", "changed"})->ArgsProduct({{512, 4096}, {0, 16}});
+
+}   // namespace
+
+BENCHMARK_MAIN();
@@ -4,73 +4,85 @@
 #include "HLSTagParser.h"
 
 // Tag-specific line & data attributes
-struct IFrame{
+template<typename String>
+struct BasicIFrame{
     int         bandwidth;
-    std::string codecs;
+    AttributeId codecs;             // in the parser's dictionary()
     int         resolution_height;
-    std::string video_range;
-    std::string uri;
-    std::string manifest_line;
+    AttributeId video_range;
+    String      uri;
+    String      manifest_line;
 };
 
+using IFrame     = BasicIFrame<std::string>;
+using IFrameView = BasicIFrame<std::string_view>;
+static_assert(std::is_trivially_copyable_v<IFrameView>);
+
 // Concrete I-Frame sub-parser
-class iFrameParser : public HLSTagParserSorter<iFrameParser,IFrame> {
+template<typename String>
+class BasicIFrameParser : public HLSTagParserSorter<BasicIFrameParser<String>, BasicIFrame<String>> {
 public:
-    std::vector<IFrame> iframes_;
-
-    void parse(const std::string& content) override {
-        IFrame cur_frame;
-        std::istringstream iss(content);
-        std::string line;
-
-        while (std::getline(iss, line)) {
-            if (line.find("#EXT-X-I-FRAME-STREAM-INF") != std::string::npos) {
-                cur_frame = IFrame();
-                cur_frame.manifest_line = line;
-
-                cur_frame.bandwidth     = stoi(extractAttribute(line, "BANDWIDTH"));
-                cur_frame.uri           = extractAttribute(line, "URI");
-                cur_frame.video_range   = extractAttribute(line, "VIDEO_RANGE");
-                cur_frame.codecs        = extractAttribute(line, "CODECS");
-
-                // Extract height from resolution string
-                std::string resolution = extractAttribute(line, "RESOLUTION_HEIGHT");
-                size_t x_pos = resolution.find("x");
-                if (x_pos == std::string::npos) cur_frame.resolution_height = 0;
-                else cur_frame.resolution_height = stoi(resolution.substr(x_pos+1));
-
-                iframes_.emplace_back(cur_frame);
-            }
+    using Frame         = BasicIFrame<String>;
+    using Dictionary    = BasicAttributeDictionary<String>;
+    using SortAttribute = HLSTagParser::SortAttribute;
+
+    std::pmr::vector<Frame> iframes_;
+
+    BasicIFrameParser() = default;
+
+    // Elements are allocated from resource, which must outlive the parser.
+    explicit BasicIFrameParser(std::pmr::memory_resource* resource) : iframes_(resource), dictionary_(resource) {}
+
+    static constexpr std::string_view kTag = "#EXT-X-I-FRAME-STREAM-INF";
+
+    std::string_view tag() const override { return kTag; }
+
+    void parseLine(std::string_view line) override {
+        if (line[0] != '#') return;
+
+        Frame cur_frame;
+        cur_frame.manifest_line = line;
+
+        AttributeList attrs(line);
+        if (!attrs.has("BANDWIDTH")) {
+            throw std::runtime_error("Missing BANDWIDTH attribute in " + std::string(line));
         }
+        cur_frame.bandwidth         = attrs.getInt("BANDWIDTH");
+        cur_frame.uri               = attrs.get("URI");
+        cur_frame.video_range       = dictionary_.intern(attrs.get("VIDEO-RANGE"));
+        cur_frame.codecs            = dictionary_.intern(attrs.get("CODECS"));
+        cur_frame.resolution_height = attrs.getResolution("RESOLUTION").height;
+
+        iframes_.emplace_back(std::move(cur_frame));
     }
 
-    //provide access to the container
-    std::vector<IFrame>& getContainer() { return iframes_; }
+    void finish() override { this->orderInterned(dictionary_); }
 
-    /*  Map of comparison functions for each attribute */
-private:
-    using ComparisonFunc = std::function<bool(const IFrame&, const IFrame&)>;
-    // Mapping between attributes and their comparators
-    const std::unordered_map<SortAttribute, ComparisonFunc> comparisons_ = {
-            {SortAttribute::BANDWIDTH, [](const IFrame& a, const IFrame& b){
-                return a.bandwidth < b.bandwidth;
-            }},
-            {SortAttribute::CODECS, [](const IFrame& a, const IFrame& b){
-                return a.codecs < b.codecs;
-            }},
-            {SortAttribute::RESOLUTION, [](const IFrame& a, const IFrame& b){
-                return a.resolution_height < b.resolution_height;
-            }},
-            {SortAttribute::VIDEO_RANGE, [](const IFrame& a, const IFrame& b){
-                return a.video_range < b.video_range;
-            }},
-    };
+    // Values of the interned attributes
+    const Dictionary& dictionary() const { return dictionary_; }
 
-public:
-    // provide access to the comparisons map
-    const std::unordered_map<SortAttribute, ComparisonFunc>& getComparisons() const {
-        return comparisons_;
+    // Attributes queries filter on
+    RenditionKeys queryKeys(const Frame& frame) const {
+        return {frame.bandwidth, frame.resolution_height, dictionary_.value(frame.codecs),
+                dictionary_.value(frame.video_range), {}, {}};
     }
+
+    //provide access to the container
+    std::pmr::vector<Frame>& getContainer() { return iframes_; }
+
+    // Element member compared for each supported sort attribute
+    using SortProjections = std::tuple<
+            SortProjection<SortAttribute::BANDWIDTH, &Frame::bandwidth>,
+            SortProjection<SortAttribute::CODECS, &Frame::codecs>,
+            SortProjection<SortAttribute::RESOLUTION, &Frame::resolution_height>,
+            SortProjection<SortAttribute::VIDEO_RANGE, &Frame::video_range>
+    >;
+
+private:
+    Dictionary dictionary_;
 };
 
+using iFrameParser     = BasicIFrameParser<std::string>;
+using iFrameViewParser = BasicIFrameParser<std::string_view>;
+
 #endif //HLS_FETCH_AND_SORT_IFRAMEPARSER_H
@@ -2,40 +2,319 @@
  *
  */
 
+#include <csignal>
 #include <iostream>
+#include <mutex>
+#include "AsyncFetcher.h"
+#include "BatchRunner.h"
 #include "HLSFetcher.h"
+#include "HLSFetcherPool.h"
+#include "HLSUrl.h"
 #include "HLSWriter.h"
+#include "LivePlaylistRefresher.h"
 #include "M3U8Parser.h"
+#include "MediaPlaylistParser.h"
+#include "PipelineMetrics.h"
+#include "PlaylistServer.h"
+#include "PlaylistSnapshot.h"
+#include "SegmentDownloader.h"
+#include "Task.h"
+#include "ThreadPool.h"
 
-int main() {
+// Keeps live media playlists current until they end, reporting new segments as they appear.
+// With a metrics path, the file is rewritten after every reload.
+static void followLive(const std::vector<std::string>& urls, const std::string& metrics_path) {
+    PipelineMetrics metrics(PipelineMetrics::Options{.keep_records = false});
+
+    std::vector<std::unique_ptr<LivePlaylistRefresher>> channels;
+    for (const auto& url : urls) {
+        channels.emplace_back(std::make_unique<LivePlaylistRefresher>(url));
+    }
+
+    LivePlaylistRefresher::run(channels, [&](const LivePlaylistRefresher& channel, size_t new_segments) {
+        const auto& segments = channel.playlist().segments();
+        std::cout << channel.url() << ": "
+                  << (channel.changed() ? std::to_string(new_segments) + " new segments" : "not modified");
+        if (!segments.empty()) {
+            std::cout << ", window " << segments.sequence_numbers.front() << "-" << segments.sequence_numbers.back();
+        }
+        std::cout << std::endl;
+
+        if (!metrics_path.empty()) {
+            PipelineMetrics::Record record;
+            record.source   = channel.url();
+            record.transfer = channel.lastTransfer();
+            record.parse_ns = channel.lastUpdateNanos();
+            record.segments = new_segments;
+            record.bytes_in = channel.lastBodyBytes();
+            metrics.record(std::move(record));
+            metrics.writeFile(metrics_path);
+        }
+        return true;
+    });
+}
+
+// Fetches one media playlist and prints a summary. Parsing moves to cpu, so the fetch
+// loop keeps the other transfers going meanwhile.
+static Task<> summarizeMedia(AsyncFetcher& fetcher, ThreadPool& cpu, std::string url,
+                             PipelineMetrics& metrics, std::mutex& output) {
+    FetchResult result = co_await fetcher.fetch(std::move(url));
+    PipelineMetrics::Record record;
+    record.source   = result.url;
+    record.transfer = result.transfer;
+    record.bytes_in = result.body.size();
+    if (!result.ok()) {
+        {
+            std::lock_guard<std::mutex> lock(output);
+            std::cerr << "Failed to fetch " << result.url << ": " << result.error() << std::endl;
+        }
+        record.ok    = false;
+        record.error = result.error();
+        metrics.record(std::move(record));
+        co_return;
+    }
+
+    co_await schedule(cpu);
+    PipelineMetrics::Stopwatch stopwatch;
+    MediaPlaylistParser media;
+    media.parse(result.body);
+    record.parse_ns = stopwatch.elapsedNanos();
+    record.segments = media.segments().size();
+    metrics.record(std::move(record));
+    std::lock_guard<std::mutex> lock(output);
+    std::cout << result.url << ": " << media.segments().size() << " segments, "
+              << media.totalDuration() << " s" << std::endl;
+}
+
+// Parses a comma-separated list of output encodings, e.g. "gz,br".
+static std::vector<Encoding> parseEncodings(const std::string& list) {
+    std::vector<Encoding> encodings;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = std::min(list.find(',', start), list.size());
+        std::string name = list.substr(start, end - start);
+        if (name == "gz" || name == "gzip")        encodings.push_back(Encoding::GZIP);
+        else if (name == "br" || name == "brotli") encodings.push_back(Encoding::BROTLI);
+        else throw std::invalid_argument("Unknown encoding " + name + " (expected gz or br)");
+        if (!CompressionSink::available(encodings.back())) {
+            throw std::invalid_argument("This build cannot write " + name + " files");
+        }
+        start = end + 1;
+    }
+    return encodings;
+}
+
+// Re-sorts every playlist of a manifest list and reports the throughput.
+static int runBatch(const std::vector<std::string>& args, const std::string& metrics_path) {
+    PipelineMetrics metrics;
+    BatchRunner::Options options;
+    if (!metrics_path.empty()) options.metrics = &metrics;
+    std::string manifest;
+    for (size_t i = 0; i < args.size(); ++i) {
+        bool has_value = i + 1 < args.size();
+        if (args[i] == "--sort" && has_value)             options.spec = SortSpec::parse(args[++i]);
+        else if (args[i] == "--out" && has_value)         options.output_directory = args[++i];
+        else if (args[i] == "--threads" && has_value)     options.threads = std::stoul(args[++i]);
+        else if (args[i] == "--fetches" && has_value)     options.max_fetches = std::stoul(args[++i]);
+        else if (args[i] == "--precompress" && has_value) options.writer.precompressed = parseEncodings(args[++i]);
+        else if (args[i] == "--snapshot")                 options.snapshot = true;
+        else if (args[i] == "--incremental")              options.incremental = true;
+        else if (manifest.empty())                        manifest = args[i];
+        else throw std::invalid_argument("Unexpected argument " + args[i]);
+    }
+    if (manifest.empty()) throw std::invalid_argument("--batch requires a manifest list");
+
+    BatchRunner runner(options);
+    BatchReport report = runner.run(BatchRunner::readManifest(manifest));
+
+    for (const auto& [input, error] : report.failures) {
+        std::cerr << "Failed " << input << ": " << error << std::endl;
+    }
+    for (const auto& [input, diff] : report.changes) {
+        std::cout << "Changed " << input << ": " << diff.summary() << "\n" << diff.describe();
+    }
+    std::cout << "Sorted " << report.succeeded << " playlists (" << report.failed << " failed";
+    if (options.incremental) std::cout << ", " << report.unchanged << " unchanged";
+    std::cout << ") in "
+              << report.seconds << " s: " << report.filesPerSecond() << " files/s, "
+              << report.megabytesPerSecond() << " MB/s" << std::endl;
+    if (!metrics_path.empty()) metrics.writeFile(metrics_path);
+    return report.failed == 0 ? 0 : 1;
+}
+
+// Downloads every segment of the given media playlists, one rendition per playlist.
+static int downloadSegments(const std::vector<std::string>& args) {
+    SegmentDownloader::Options options;
+    std::filesystem::path output_directory = "segments";
+    std::vector<std::string> urls;
+    for (size_t i = 0; i < args.size(); ++i) {
+        bool has_value = i + 1 < args.size();
+        if (args[i] == "--out" && has_value)           output_directory = args[++i];
+        else if (args[i] == "--parallel" && has_value) options.max_in_flight = std::stoul(args[++i]);
+        else                                           urls.push_back(args[i]);
+    }
+
+    std::vector<SegmentJob> jobs;
+    HLSFetcherPool pool;
+    for (FetchResult& result : pool.fetchAll(urls)) {
+        if (!result.ok()) {
+            std::cerr << "Failed to fetch " << result.url << ": " << result.error() << std::endl;
+            continue;
+        }
+        MediaPlaylistParser media;
+        media.parse(result.body);
+        auto rendition = SegmentDownloader::plan(media, result.url, output_directory, result.index);
+        jobs.insert(jobs.end(), rendition.begin(), rendition.end());
+    }
+
+    size_t failed = 0;
+    uint64_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    SegmentDownloader downloader(options);
+    downloader.download(jobs, [&](SegmentResult&& result) {
+        if (!result.ok) {
+            ++failed;
+            std::cerr << "Failed " << result.job.url << " after " << result.attempts << " attempts: "
+                      << result.error << std::endl;
+            return;
+        }
+        bytes += result.bytes;
+        std::cout << result.job.path.string() << ": " << result.bytes << " bytes, "
+                  << result.megabitsPerSecond() << " Mbit/s" << std::endl;
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Downloaded " << jobs.size() - failed << " segments (" << failed << " failed), " << bytes
+              << " bytes in " << seconds << " s: " << (seconds > 0 ? bytes * 8.0 / 1e6 / seconds : 0.0)
+              << " Mbit/s" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+static PlaylistServer* running_server = nullptr;
+
+// Serves sorted playlists over HTTP until SIGINT or SIGTERM.
+static int runServer(const std::vector<std::string>& args) {
+    PlaylistServer::Options options;
+    for (size_t i = 0; i < args.size(); ++i) {
+        bool has_value = i + 1 < args.size();
+        if (args[i] == "--address" && has_value)        options.address = args[++i];
+        else if (args[i] == "--threads" && has_value)   options.threads = std::stoul(args[++i]);
+        else if (args[i] == "--max-age" && has_value)   options.cache.default_max_age = std::chrono::seconds(std::stol(args[++i]));
+        else if (args[i] == "--cache-dir" && has_value) options.cache.disk_directory = args[++i];
+        else if (i == 0)                                options.port = static_cast<uint16_t>(std::stoul(args[i]));
+        else throw std::invalid_argument("Unexpected argument " + args[i]);
+    }
+
+    PlaylistServer server(options);
+    running_server = &server;
+    auto stop = [](int) { running_server->stop(); };
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+
+    std::cout << "Serving sorted playlists on http://" << options.address << ":" << server.port()
+              << "/sort?url=..." << std::endl;
+    server.run();
+    running_server = nullptr;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
     try {
+        // --metrics <path> applies to every mode: a JSON report, or Prometheus text for *.prom
+        std::vector<std::string> args;
+        std::string metrics_path;
+        for (int i = 1; i < argc; ++i) {
+            if (std::string(argv[i]) == "--metrics" && i + 1 < argc) metrics_path = argv[++i];
+            else args.emplace_back(argv[i]);
+        }
+
+        if (args.size() > 1 && args[0] == "--live") {
+            followLive(std::vector<std::string>(args.begin() + 1, args.end()), metrics_path);
+            return 0;
+        }
+        if (args.size() > 1 && args[0] == "--batch") {
+            return runBatch(std::vector<std::string>(args.begin() + 1, args.end()), metrics_path);
+        }
+        if (args.size() > 1 && args[0] == "--segments") {
+            return downloadSegments(std::vector<std::string>(args.begin() + 1, args.end()));
+        }
+        if (args.size() == 2 && args[0] == "--print-snapshot") {
+            // The playlist a snapshot was taken of, straight from the mapping
+            HLSWriter::writeTo(STDOUT_FILENO, PlaylistSnapshot::open(args[1]));
+            return 0;
+        }
+        if (args.size() > 1 && args[0] == "--serve") {
+            return runServer(std::vector<std::string>(args.begin() + 1, args.end()));
+        }
+
         // Create HLS fetcher and get the playlist
         const std::string url = "https://lw.bamgrid.com/2.0/hls/vod/bam/ms02/hls/dplus/bao/master_unenc_hdr10_all.m3u8";
         HLSFetcher fetcher(url);
+        PipelineMetrics metrics;
+        PipelineMetrics::Record master;
+        master.source = url;
 
-        if (fetcher.fetch()) {
-            std::cout << "Successfully fetched playlist:\n";
+        // The zero-copy parser keeps views into the body it is fed. Chunks are parsed
+        // while the transfer is still in progress.
+        M3U8ViewParser parser;
+        parser.collectTimings(!metrics_path.empty());
 
-            // Create and use the parser to group by tag
-            M3U8Parser parser;
-            parser.parse(fetcher.getResponse());
+        bool fetched = fetcher.fetch([&parser, &master](std::string_view chunk) {
+            PipelineMetrics::Stopwatch stopwatch;
+            parser.feed(chunk);
+            master.parse_ns += stopwatch.elapsedNanos();
+            master.bytes_in += chunk.size();        // decoded; the transfer counts wire bytes
+        });
+        master.transfer = fetcher.getTransferMetrics();
+        if (fetched) {
+            PipelineMetrics::Stopwatch stopwatch;
+            parser.finish();
+            master.parse_ns     += stopwatch.elapsedNanos();
+            master.parse_timings = parser.timings();
+            master.elements      = {parser.select<ParserType::STREAM>().elements().size(),
+                                    parser.select<ParserType::AUDIO>().elements().size(),
+                                    parser.select<ParserType::IFRAME>().elements().size()};
+            std::cout << "Successfully fetched playlist:\n";
 
             // Sort each tag group by attribute
+            stopwatch.restart();
             parser.select<ParserType::STREAM>().sort(HLSTagParser::SortAttribute::RESOLUTION,
                                                    HLSTagParser::SortAttribute::BANDWIDTH);
             parser.select<ParserType::AUDIO>().sort(HLSTagParser::SortAttribute::ID);
             parser.select<ParserType::IFRAME>().sort(HLSTagParser::SortAttribute::CODECS);
+            master.sort_ns = stopwatch.elapsedNanos();
+
+            // Follow the variant URIs and summarize their media playlists; the transfers
+            // run while the sorted master is written below
+            ThreadPool   cpu;
+            AsyncFetcher media_fetcher;
+            std::mutex   output;
+            TaskGroup    media;
+            for (const auto& variant : parser.select<ParserType::STREAM>().elements()) {
+                media.spawn(summarizeMedia(media_fetcher, cpu, HLSUrl::resolve(url, variant.uri), metrics, output));
+            }
 
             // Create HLSWriter and write the (sorted) playlist to a file.
             HLSWriter writer("sorted_master_unenc_hdr10_maybe");
-            writer.write(parser.stringify());
-            std::cout << "Sorted playlist written to " << writer.getFileName() << std::endl;
+            stopwatch.restart();
+            writer.write(parser);
+            master.write_ns  = stopwatch.elapsedNanos();
+            master.bytes_out = parser.serializedSize();
+            metrics.record(std::move(master));
+            {
+                std::lock_guard<std::mutex> lock(output);
+                std::cout << "Sorted playlist written to " << writer.getFileName() << std::endl;
+            }
+            media.wait();
         } else {
             std::cerr << "Failed to fetch playlist" << std::endl;
+            master.ok    = false;
+            master.error = "HTTP status " + std::to_string(fetcher.getStatusCode());
+            metrics.record(std::move(master));
         }
+        if (!metrics_path.empty()) metrics.writeFile(metrics_path);
 
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
     }
     return 0;
-}
\ No newline at end of file
+}
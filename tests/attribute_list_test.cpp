@@ -0,0 +1,84 @@
+/*
+ *   Tests of the AttributeList lexer
+ *
+ *   Quoted strings with commas, the typed value helpers and the kMaxAttributes bound,
+ *   including lines the lexer has to give up on part way.
+ */
+
+#include <cstdio>
+#include <string>
+#include "AttributeList.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    std::printf("%s %s\n", condition ? "ok     " : "FAILED ", what.c_str());
+    if (!condition) ++failures;
+}
+
+void quotedStrings() {
+    AttributeList attrs(R"(#EXT-X-STREAM-INF:BANDWIDTH=2483789,CODECS="mp4a.40.2,hvc1.2.4.L90.90",AUDIO="aud,1",AVERAGE-BANDWIDTH=2000000)");
+    check(attrs.size() == 4, "commas inside quoted strings do not split attributes");
+    check(attrs.get("CODECS") == "mp4a.40.2,hvc1.2.4.L90.90", "quoted value without its quotes");
+    check(attrs.get("AUDIO") == "aud,1", "quoted value ending in a comma-separated part");
+    check(attrs.getInt("BANDWIDTH") == 2483789, "BANDWIDTH does not match AVERAGE-BANDWIDTH");
+    check(attrs.getInt("AVERAGE-BANDWIDTH") == 2000000, "attribute after the quoted strings");
+    check(attrs.find("CODECS")->quoted && !attrs.find("BANDWIDTH")->quoted, "quoted flag");
+
+    AttributeList empty(R"(#EXT-X-MEDIA:NAME="",TYPE=AUDIO)");
+    check(empty.has("NAME") && empty.get("NAME").empty() && empty.get("TYPE") == "AUDIO", "empty quoted string");
+
+    AttributeList unterminated(R"(#EXT-X-MEDIA:TYPE=AUDIO,NAME="English,LANGUAGE=en)");
+    check(unterminated.size() == 1 && !unterminated.has("LANGUAGE"), "lexing stops at an unterminated quoted string");
+
+    check(AttributeList("#EXT-X-ENDLIST").size() == 0, "line without ':' has no attributes");
+    check(!attrs.has("RESOLUTION") && attrs.getInt("RESOLUTION", -1) == -1, "missing attribute falls back");
+}
+
+void typedValues() {
+    AttributeList attrs("#EXT-X-KEY:METHOD=AES-128,IV=0x1F2e3d4C5b6A7980,RESOLUTION=1920x1080,FRAME-RATE=29.970");
+    check(AttributeList::hexadecimal(attrs.get("IV")) == 0x1F2E3D4C5B6A7980ull, "mixed-case hexadecimal-sequence");
+    check(AttributeList::hexadecimal("0X0a") == 10, "0X prefix");
+    check(AttributeList::hexadecimal("0x", 7) == 7, "prefix without digits falls back");
+    check(AttributeList::hexadecimal("0x12g4", 7) == 7, "trailing garbage falls back");
+    check(AttributeList::hexadecimal("1234", 7) == 7, "missing prefix falls back");
+    check(AttributeList::hexadecimal("0x10000000000000000", 7) == 7, "wider than 64 bits falls back");
+
+    AttributeList::Resolution resolution = attrs.getResolution("RESOLUTION");
+    check(resolution.width == 1920 && resolution.height == 1080, "decimal-resolution");
+    resolution = AttributeList::decimalResolution("1920");
+    check(resolution.width == 0 && resolution.height == 0, "resolution without 'x' is 0x0");
+    resolution = AttributeList::decimalResolution("x720");
+    check(resolution.width == 0 && resolution.height == 720, "resolution without width");
+
+    check(AttributeList::decimalFloat(attrs.get("FRAME-RATE")) == 29.970, "decimal-floating-point");
+    check(AttributeList::decimalInteger("abc", -1) == -1, "non-numeric integer falls back");
+}
+
+void attributeLimit() {
+    std::string line = "#EXT-X-SESSION-DATA:";
+    for (size_t i = 0; i < AttributeList::kMaxAttributes + 8; ++i) {
+        if (i > 0) line += ',';
+        line += "X-" + std::to_string(i) + "=\"" + std::to_string(i) + ",\"";
+    }
+    AttributeList attrs(line);
+    check(attrs.size() == AttributeList::kMaxAttributes, "at most kMaxAttributes attributes are kept");
+    const std::string last = "X-" + std::to_string(AttributeList::kMaxAttributes - 1);
+    check(attrs.get(last) == std::to_string(AttributeList::kMaxAttributes - 1) + ",", "last kept attribute is intact");
+    check(!attrs.has("X-" + std::to_string(AttributeList::kMaxAttributes)), "attributes past the limit are ignored");
+
+    size_t listed = 0;
+    for (const AttributeList::Attribute& attribute : attrs) listed += !attribute.name.empty();
+    check(listed == AttributeList::kMaxAttributes, "iteration covers the kept attributes");
+}
+
+} // namespace
+
+int main() {
+    quotedStrings();
+    typedValues();
+    attributeLimit();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+/*
+ *   Differential test of the DelimiterScanner kernels
+ *
+ *   Every kernel this CPU supports must produce the same masks and block counts as the
+ *   scalar kernel, at every block alignment and for every length of a short final block.
+ *   Exits non-zero on the first kernel that disagrees.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <string_view>
+#include "DelimiterScanner.h"
+#include "PlaylistGenerator.h"
+
+namespace {
+
+using Kernel = DelimiterScanner::Kernel;
+
+// Media playlist with byte ranges, keys and dates: realistic delimiter density
+std::string playlistInput() {
+    PlaylistGenerator::MediaOptions options;
+    options.segments          = 2000;
+    options.byterange_ratio   = 0.25;
+    options.key_rotation      = 100;
+    options.program_date_time = true;
+    return PlaylistGenerator::media(options);
+}
+
+// Arbitrary bytes, half of them delimiters, including bytes with the high bit set
+std::string randomInput() {
+    static constexpr std::string_view delimiters = "\n#,=\"";
+    std::mt19937_64 rng(1);
+    std::string out(64 * 1024, '\0');
+    for (char& c : out) {
+        const uint64_t r = rng();
+        c = (r & 1) ? delimiters[(r >> 1) % delimiters.size()] : static_cast<char>(r >> 8);
+    }
+    return out;
+}
+
+// Window of kernel and of the scalar kernel over data[0, size)
+bool windowMatches(const char* data, size_t size, Kernel kernel) {
+    DelimiterMasks expected[DelimiterScanner::kWindowBlocks];
+    DelimiterMasks actual[DelimiterScanner::kWindowBlocks];
+    const size_t blocks = DelimiterScanner::function(Kernel::SCALAR)(data, size, expected);
+    if (DelimiterScanner::function(kernel)(data, size, actual) != blocks) return false;
+    for (size_t i = 0; i < blocks; ++i) {
+        if (actual[i] != expected[i]) return false;
+    }
+    return true;
+}
+
+// Number of (position, size) pairs at which kernel and the scalar kernel disagree
+size_t mismatches(const std::string& content, Kernel kernel) {
+    size_t failed = 0;
+    // whole windows, walking the input from several block alignments
+    for (size_t offset = 0; offset < DelimiterScanner::kBlockSize; ++offset) {
+        for (size_t pos = offset; pos < content.size(); pos += DelimiterScanner::kBlockSize) {
+            if (!windowMatches(content.data() + pos, content.size() - pos, kernel)) ++failed;
+        }
+    }
+    // every length of a final block, up to a full window, at every alignment
+    for (size_t pos = 0; pos < 2 * DelimiterScanner::kBlockSize; ++pos) {
+        for (size_t size = 0; size <= DelimiterScanner::kWindowBlocks * DelimiterScanner::kBlockSize; ++size) {
+            if (!windowMatches(content.data() + pos, size, kernel)) ++failed;
+            if (DelimiterScanner::scan(content.data() + pos, size, kernel) !=
+                DelimiterScanner::scan(content.data() + pos, size, Kernel::SCALAR)) ++failed;
+        }
+    }
+    return failed;
+}
+
+} // namespace
+
+int main() {
+    const std::string inputs[] = {playlistInput(), randomInput()};
+    int status = 0;
+    for (Kernel kernel : DelimiterScanner::kKernels) {
+        const std::string_view name = DelimiterScanner::name(kernel);
+        if (!DelimiterScanner::supported(kernel)) {
+            std::printf("%-8.*s skipped, not supported by this CPU\n", int(name.size()), name.data());
+            continue;
+        }
+        size_t failed = 0;
+        for (const std::string& input : inputs) failed += mismatches(input, kernel);
+        std::printf("%-8.*s %s", int(name.size()), name.data(), failed ? "FAILED" : "ok");
+        if (failed) std::printf(", %zu mismatches", failed);
+        std::printf("\n");
+        if (failed) status = 1;
+    }
+    return status;
+}
@@ -0,0 +1,153 @@
+/*
+ *   Tests of M3U8Parser's incremental parsing and lossless round trip
+ *
+ *   Feeding a playlist in chunks must leave the same model as parsing it at once, wherever
+ *   the chunk boundaries fall: inside a tag, inside a URI line or between the '\r' and '\n'
+ *   of a CRLF line ending. Tags without a handler and comments must be written back where
+ *   they were, including between a variant's tag line and its URI line.
+ *
+ *   usage: m3u8_parser_test <fixtures directory>
+ */
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include "M3U8Parser.h"
+#include "PlaylistSnapshot.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    std::printf("%s %s\n", condition ? "ok     " : "FAILED ", what.c_str());
+    if (!condition) ++failures;
+}
+
+std::string readFile(const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream out;
+    out << in.rdbuf();
+    return out.str();
+}
+
+std::string withCrlf(const std::string& content) {
+    std::string out;
+    for (char c : content) {
+        if (c == '\n') out += '\r';
+        out += c;
+    }
+    return out;
+}
+
+template<typename Parser>
+std::string parsedAtOnce(const std::string& content) {
+    Parser parser;
+    parser.parse(std::string(content));
+    return parser.stringify();
+}
+
+// Feeds content in two chunks split at every byte position; false on the first mismatch.
+template<typename Parser>
+bool everySplitMatches(const std::string& content, const std::string& expected) {
+    for (size_t split = 0; split <= content.size(); ++split) {
+        Parser parser;
+        parser.feed(std::string_view(content).substr(0, split));
+        parser.feed(std::string_view(content).substr(split));
+        parser.finish();
+        if (parser.stringify() != expected) {
+            std::printf("        split at byte %zu differs\n", split);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Feeds content one byte at a time, so several chunks in a row extend the same line.
+template<typename Parser>
+std::string bytewise(const std::string& content) {
+    Parser parser;
+    for (char c : content) parser.feed(std::string_view(&c, 1));
+    parser.finish();
+    return parser.stringify();
+}
+
+template<typename Parser>
+void chunkBoundaries(const std::string& content, const char* model) {
+    const std::string expected = parsedAtOnce<Parser>(content);
+    const std::string crlf     = withCrlf(content);
+    std::string unterminated   = content;
+    while (unterminated.back() == '\n') unterminated.pop_back();
+
+    const std::string name = model;
+    check(everySplitMatches<Parser>(content, expected), name + ": two chunks split anywhere");
+    check(everySplitMatches<Parser>(crlf, expected), name + ": CRLF, two chunks split anywhere");
+    check(bytewise<Parser>(crlf) == expected, name + ": CRLF, one byte per chunk");
+    check(everySplitMatches<Parser>(unterminated, expected), name + ": last line without newline");
+}
+
+// In the layout serialize() writes, so an unsorted round trip reproduces it byte for byte
+constexpr std::string_view kPassthrough =
+        "#EXTM3U\n"
+        "# generated by a packager\n"
+        "#EXT-X-VERSION:6\n"
+        "\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=1000,RESOLUTION=640x360\n"
+        "#EXT-X-VENDOR-HINT:LOW\n"
+        "# low\n"
+        "low.m3u8\n"
+        "#EXT-X-VENDOR-MARK:AFTER-LOW\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=3000,RESOLUTION=1280x720\n"
+        "high.m3u8\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=2000,RESOLUTION=960x540\n"
+        "#EXT-X-VENDOR-HINT:MID\n"
+        "mid.m3u8\n"
+        "\n"
+        "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"aac\",LANGUAGE=\"en\",NAME=\"English\",URI=\"en.m3u8\"\n"
+        "# audio comment\n"
+        "\n"
+        "#EXT-X-I-FRAME-STREAM-INF:BANDWIDTH=100,URI=\"iframe.m3u8\"\n"
+        "\n";
+
+template<typename Parser>
+void passthroughRoundTrip(const char* model) {
+    const std::string name = model;
+    Parser parser;
+    parser.parse(std::string(kPassthrough));
+    check(parser.stringify() == kPassthrough, name + ": tags and comments written back in place");
+
+    // Lines within a variant stay between the tag line and URI line of the variant in their slot
+    parser.template select<ParserType::STREAM>().sort(HLSTagParser::descending(HLSTagParser::SortAttribute::BANDWIDTH));
+    const std::string sorted = parser.stringify();
+    check(sorted.find("#EXT-X-STREAM-INF:BANDWIDTH=3000,RESOLUTION=1280x720\n"
+                      "#EXT-X-VENDOR-HINT:LOW\n"
+                      "# low\n"
+                      "high.m3u8\n"
+                      "#EXT-X-VENDOR-MARK:AFTER-LOW\n") != std::string::npos &&
+          sorted.find("#EXT-X-STREAM-INF:BANDWIDTH=1000,RESOLUTION=640x360\n"
+                      "#EXT-X-VENDOR-HINT:MID\n"
+                      "low.m3u8\n") != std::string::npos, name + ": sorted variants keep every URI after its tag line");
+
+    std::string bytes = SnapshotBuilder(parser).bytes();
+    check(PlaylistSnapshot(bytes, nullptr).stringify() == sorted, name + ": snapshot writes them back the same way");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::fprintf(stderr, "usage: %s <fixtures directory>\n", argv[0]);
+        return 2;
+    }
+    const std::string master = readFile(std::filesystem::path(argv[1]) / "master.m3u8");
+    check(!master.empty(), "fixture master.m3u8 read");
+
+    chunkBoundaries<M3U8Parser>(master, "M3U8Parser");
+    chunkBoundaries<M3U8ViewParser>(master, "M3U8ViewParser");
+    passthroughRoundTrip<M3U8Parser>("M3U8Parser");
+    passthroughRoundTrip<M3U8ViewParser>("M3U8ViewParser");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+/*
+ *   Tests of MediaPlaylistParser::update() on live playlists
+ *
+ *   A delta update (#EXT-X-SKIP) must leave the same model as reloading the full playlist,
+ *   and the key and map tables must stay bounded while the window slides.
+ */
+
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include "MediaPlaylistParser.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    std::printf("%s %s\n", condition ? "ok     " : "FAILED ", what.c_str());
+    if (!condition) ++failures;
+}
+
+constexpr double   kStartTime = 1700000000.0;
+constexpr uint64_t kKeyEvery  = 4;
+
+double   duration(uint64_t i)  { return 2.0 + static_cast<double>(i % 3) * 0.5; }
+uint64_t byteLength(uint64_t i) { return 1000 + i; }
+
+// ISO 8601 UTC date-time of seconds since the epoch, with milliseconds
+std::string dateTime(double seconds) {
+    auto whole = static_cast<time_t>(seconds);
+    std::tm utc{};
+    gmtime_r(&whole, &utc);
+    char out[64];
+    std::snprintf(out, sizeof(out), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", utc.tm_year + 1900, utc.tm_mon + 1,
+                  utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec, static_cast<int>((seconds - whole) * 1000 + 0.5));
+    return out;
+}
+
+/**
+ * @brief Live playlist with the segments first..last of one byte-range resource.
+ *
+ * The key rotates every kKeyEvery segments; only the first listed segment carries a date
+ * and an explicit byte range offset, later ones continue from their predecessor. With
+ * skip > 0 the first skip segments are replaced by #EXT-X-SKIP, as in a delta update.
+ */
+std::string livePlaylist(uint64_t first, uint64_t last, uint64_t skip = 0) {
+    double   start  = kStartTime;
+    uint64_t offset = 0;
+    for (uint64_t i = 0; i < first; ++i) {
+        start  += duration(i);
+        offset += byteLength(i);
+    }
+
+    std::string out = "#EXTM3U\n#EXT-X-VERSION:9\n#EXT-X-TARGETDURATION:3\n"
+                      "#EXT-X-SERVER-CONTROL:CAN-SKIP-UNTIL=18.0\n"
+                      "#EXT-X-MEDIA-SEQUENCE:" + std::to_string(first) + "\n"
+                      "#EXT-X-MAP:URI=\"init.mp4\"\n";
+    if (skip > 0) out += "#EXT-X-SKIP:SKIPPED-SEGMENTS=" + std::to_string(skip) + "\n";
+    for (uint64_t i = first + skip; i <= last; ++i) {
+        const bool listed_first = i == first;
+        if (listed_first || i % kKeyEvery == 0) {
+            out += "#EXT-X-KEY:METHOD=AES-128,URI=\"key" + std::to_string(i / kKeyEvery) + ".bin\"\n";
+        }
+        if (listed_first) out += "#EXT-X-PROGRAM-DATE-TIME:" + dateTime(start) + "\n";
+        char extinf[32];
+        std::snprintf(extinf, sizeof(extinf), "#EXTINF:%.1f,\n", duration(i));
+        out += extinf;
+        out += "#EXT-X-BYTERANGE:";
+        out += std::to_string(byteLength(i));
+        if (listed_first) {
+            out += '@';
+            out += std::to_string(offset);
+        }
+        out += "\nmedia.mp4\n";
+    }
+    return out;
+}
+
+// Same segments with the same resolved keys and maps
+bool sameModel(const MediaPlaylistParser& a, const MediaPlaylistParser& b) {
+    const SegmentStore& x = a.segments();
+    const SegmentStore& y = b.segments();
+    if (x.size() != y.size()) return false;
+    for (size_t i = 0; i < x.size(); ++i) {
+        if (x.durations[i] != y.durations[i] || x.sequence_numbers[i] != y.sequence_numbers[i] ||
+            x.uri(i) != y.uri(i) || x.byterange_lengths[i] != y.byterange_lengths[i] ||
+            x.byterange_offsets[i] != y.byterange_offsets[i] || x.flags[i] != y.flags[i] ||
+            x.program_date_times[i] != y.program_date_times[i]) return false;
+
+        if ((x.key_indices[i] < 0) != (y.key_indices[i] < 0)) return false;
+        if (x.key_indices[i] >= 0 && a.keys()[x.key_indices[i]].uri != b.keys()[y.key_indices[i]].uri) return false;
+        if ((x.map_indices[i] < 0) != (y.map_indices[i] < 0)) return false;
+        if (x.map_indices[i] >= 0 && a.maps()[x.map_indices[i]].uri != b.maps()[y.map_indices[i]].uri) return false;
+    }
+    return a.mediaSequence() == b.mediaSequence();
+}
+
+void deltaUpdateMatchesFullReload() {
+    MediaPlaylistParser full;
+    full.parse(livePlaylist(3, 14));
+
+    MediaPlaylistParser delta;
+    delta.parse(livePlaylist(0, 9));
+    size_t appended = delta.update(livePlaylist(3, 14, 5));     // segments 3..7 skipped
+
+    check(delta.skippedSegments() == 5, "delta update skips 5 segments");
+    check(appended == 5, "delta update appends segments 10..14");
+    check(sameModel(delta, full), "delta update leaves the model of a full reload");
+
+    MediaPlaylistParser reload;
+    reload.parse(livePlaylist(0, 9));
+    reload.update(livePlaylist(3, 14));
+    check(sameModel(reload, full), "full update leaves the model of a full reload");
+}
+
+void tablesFollowTheWindow() {
+    MediaPlaylistParser live;
+    live.parse(livePlaylist(0, 11));
+    for (uint64_t first = 2; first < 2000; first += 2) {
+        live.update(livePlaylist(first, first + 11));
+    }
+    MediaPlaylistParser full;
+    full.parse(livePlaylist(1998, 2009));
+
+    check(live.keys().size() <= 12 / kKeyEvery + 1, "keys of expired segments are dropped (" +
+          std::to_string(live.keys().size()) + " left)");
+    check(live.maps().size() == 1, "one map");
+    check(sameModel(live, full), "model after 1000 reloads matches a full load");
+}
+
+} // namespace
+
+int main() {
+    deltaUpdateMatchesFullReload();
+    tablesFollowTheWindow();
+    return failures == 0 ? 0 : 1;
+}
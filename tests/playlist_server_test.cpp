@@ -0,0 +1,182 @@
+/*
+ *   End-to-end test of PlaylistServer
+ *
+ *   Serves tests/fixtures from a minimal HTTP origin on the loopback interface, starts the
+ *   server on a free port and has it sort those playlists over real HTTP requests.
+ *
+ *   usage: playlist_server_test <fixtures directory>
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "HLSFetcher.h"
+#include "PlaylistServer.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    std::printf("%s %s\n", condition ? "ok     " : "FAILED ", what.c_str());
+    if (!condition) ++failures;
+}
+
+std::string readFile(const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream out;
+    out << in.rdbuf();
+    return out.str();
+}
+
+/**
+ * @brief Static file origin on 127.0.0.1: GET /<name> answers with <directory>/<name>.
+ *
+ * One request per connection, no Cache-Control, 404 for anything that is not a regular
+ * file of the directory. /redirect-to-file redirects to the file:// URL of master.m3u8.
+ */
+class FixtureOrigin {
+public:
+    explicit FixtureOrigin(std::filesystem::path directory) : directory_(std::move(directory)) {
+        listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_in addr{};
+        addr.sin_family      = AF_INET;
+        addr.sin_port        = 0;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(addr);
+        if (listen_fd_ < 0 || ::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(listen_fd_, 16) != 0 ||
+            ::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &length) != 0) {
+            throw std::runtime_error("Could not start the fixture origin");
+        }
+        port_   = ntohs(addr.sin_port);
+        thread_ = std::thread([this] { serve(); });
+    }
+
+    ~FixtureOrigin() {
+        stopping_ = true;
+        thread_.join();
+        ::close(listen_fd_);
+    }
+
+    std::string url(const std::string& name) const {
+        return "http://127.0.0.1:" + std::to_string(port_) + "/" + name;
+    }
+
+private:
+    std::filesystem::path directory_;
+    int                   listen_fd_ = -1;
+    uint16_t              port_ = 0;
+    std::atomic<bool>     stopping_{false};
+    std::thread           thread_;
+
+    void serve() {
+        while (!stopping_) {
+            pollfd listener{listen_fd_, POLLIN, 0};
+            if (::poll(&listener, 1, 50) <= 0) continue;
+            int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) continue;
+            respond(fd);
+            ::close(fd);
+        }
+    }
+
+    void respond(int fd) {
+        std::string request;
+        char buffer[4096];
+        while (request.find("\r\n\r\n") == std::string::npos) {
+            ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) return;
+            request.append(buffer, static_cast<size_t>(n));
+        }
+        // "GET /<name> HTTP/1.1"
+        size_t start = request.find(' ') + 2;
+        std::string name = request.substr(start, request.find(' ', start) - start);
+        std::filesystem::path path = directory_ / name;
+
+        std::string head;
+        std::string body;
+        if (name == "redirect-to-file") {
+            head = "HTTP/1.1 302 Found\r\nLocation: file://" + (directory_ / "master.m3u8").string() + "\r\n";
+        } else if (name.find('/') == std::string::npos && std::filesystem::is_regular_file(path)) {
+            body = readFile(path);
+            head = "HTTP/1.1 200 OK\r\n";
+        } else {
+            head = "HTTP/1.1 404 Not Found\r\n";
+        }
+        head += "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+        std::string response = head + body;
+        for (size_t sent = 0; sent < response.size();) {
+            ssize_t n = ::send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return;
+            sent += static_cast<size_t>(n);
+        }
+    }
+};
+
+// GET http://127.0.0.1:<port><target>, returns the HTTP status and fills body
+long get(uint16_t port, const std::string& target, std::string& body) {
+    HLSFetcher fetcher("http://127.0.0.1:" + std::to_string(port) + target);
+    fetcher.fetch();
+    body = fetcher.takeResponse();
+    return fetcher.getStatusCode();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::fprintf(stderr, "usage: %s <fixtures directory>\n", argv[0]);
+        return 2;
+    }
+    const std::filesystem::path fixtures = std::filesystem::absolute(argv[1]);
+    FixtureOrigin origin(fixtures);
+    const std::string master = origin.url("master.m3u8");
+
+    PlaylistServer::Options options;
+    options.port    = 0;
+    options.threads = 4;
+    options.cache.default_max_age = std::chrono::seconds(60);     // the origin sends no Cache-Control
+    PlaylistServer server(options);
+    std::thread runner([&server] { server.run(); });
+
+    std::string body;
+    long status = get(server.port(), "/sort?url=" + master + "&stream=-BANDWIDTH&audio=LANGUAGE&iframe=BANDWIDTH", body);
+    check(status == 200, "sorts a playlist of the origin (HTTP " + std::to_string(status) + ")");
+    check(body == readFile(fixtures / "master_sorted.m3u8"), "sorted by the requested keys");
+
+    status = get(server.port(), "/sort?url=" + master + "&stream=-BANDWIDTH&audio=LANGUAGE&iframe=BANDWIDTH", body);
+    check(status == 200 && body == readFile(fixtures / "master_sorted.m3u8"), "same result on a repeated request");
+    PlaylistCache::Stats stats = server.cache().stats();
+    check(stats.misses == 1 && stats.memory_hits == 1, "repeated request served from the cache");
+
+    status = get(server.port(), "/sort?url=" + master + "&stream=FOO", body);
+    check(status == 400, "unknown sort attribute is a bad request (HTTP " + std::to_string(status) + ")");
+
+    status = get(server.port(), "/sort?url=" + origin.url("missing.m3u8"), body);
+    check(status == 502, "missing playlist is a bad gateway (HTTP " + std::to_string(status) + ")");
+
+    status = get(server.port(), "/sort?url=file://" + (fixtures / "master.m3u8").string(), body);
+    check(status == 400, "file:// URL is rejected (HTTP " + std::to_string(status) + ")");
+    status = get(server.port(), "/sort?url=ftp://127.0.0.1/master.m3u8", body);
+    check(status == 400, "ftp:// URL is rejected (HTTP " + std::to_string(status) + ")");
+    status = get(server.port(), "/sort?url=" + origin.url("redirect-to-file"), body);
+    check(status == 502, "redirect to file:// is not followed (HTTP " + std::to_string(status) + ")");
+
+    status = get(server.port(), "/metrics", body);
+    check(status == 200 && !body.empty(), "serves metrics");
+
+    server.stop();
+    runner.join();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+/*
+ *   Round trip of a parsed playlist through a PlaylistSnapshot file
+ *
+ *   Writes the snapshot of a sorted playlist with HLSWriter, maps it back and checks that it
+ *   serializes to the parser's output and answers queries without the parser. Damaged files
+ *   must be rejected when opened, not when read.
+ *
+ *   usage: playlist_snapshot_test <fixtures directory>
+ */
+
+#include <unistd.h>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "HLSWriter.h"
+#include "M3U8Parser.h"
+#include "PlaylistSnapshot.h"
+
+namespace {
+
+using SortAttribute = HLSTagParser::SortAttribute;
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    std::printf("%s %s\n", condition ? "ok     " : "FAILED ", what.c_str());
+    if (!condition) ++failures;
+}
+
+std::string readFile(const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream out;
+    out << in.rdbuf();
+    return out.str();
+}
+
+void writeBytes(const std::filesystem::path& path, const std::string& bytes) {
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes;
+}
+
+bool rejected(const std::filesystem::path& path) {
+    try {
+        PlaylistSnapshot::open(path.string());
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+template<typename Parser>
+void roundTrip(const std::string& content, const std::filesystem::path& path, const char* model) {
+    Parser parser;
+    parser.parse(std::string(content));
+    parser.template select<ParserType::STREAM>().sort(HLSTagParser::descending(SortAttribute::BANDWIDTH));
+    parser.template select<ParserType::AUDIO>().sort(SortAttribute::LANGUAGE);
+    HLSWriter::writeFile(path.string(), SnapshotBuilder(parser));
+
+    const std::string name = model;
+    PlaylistSnapshot snapshot = PlaylistSnapshot::open(path.string());
+    check(snapshot.size() == std::filesystem::file_size(path), name + ": size matches the file");
+    check(snapshot.stringify() == parser.stringify(), name + ": mapped snapshot serializes like the parser");
+    check(snapshot.serializedSize() == parser.stringify().size(), name + ": serialized size");
+
+    check(snapshot.variants().size() == 5 && snapshot.audioTracks().size() == 2 && snapshot.iframes().size() == 2,
+          name + ": element counts");
+    const SnapshotVariant& top = snapshot.variants().front();
+    check(top.bandwidth == 8001098 && snapshot.string(top.uri) == "v9/prog_index.m3u8", name + ": sorted order kept");
+    check(snapshot.value(ParserType::STREAM, top.codecs) == "avc1.64002a,mp4a.40.2", name + ": interned value");
+    auto codecs = snapshot.id(ParserType::STREAM, "avc1.640015,mp4a.40.2");
+    check(codecs && snapshot.variants().back().codecs == *codecs, name + ": value lookup");
+    check(!snapshot.id(ParserType::STREAM, "hvc1.2.4.L150.90"), name + ": missing value");
+    check(snapshot.string(snapshot.audioTracks().front().name) == "English", name + ": string within a tag line");
+
+    const auto passthrough = snapshot.passthrough(ParserType::AUDIO);
+    check(passthrough.size() == 1 && snapshot.string(passthrough[0].line) == "#EXT-X-UNKNOWN-TAG:VALUE=1" &&
+          passthrough[0].slot == 1, name + ": passthrough tag and slot");
+}
+
+void damagedFiles(const std::filesystem::path& path) {
+    const std::string bytes = readFile(path);
+    const std::filesystem::path damaged = path.string() + ".damaged";
+
+    writeBytes(damaged, bytes.substr(0, bytes.size() - 1));
+    check(rejected(damaged), "truncated snapshot is rejected");
+
+    std::string wrong_magic = bytes;
+    wrong_magic[0] = 'X';
+    writeBytes(damaged, wrong_magic);
+    check(rejected(damaged), "wrong magic is rejected");
+
+    std::string wrong_version = bytes;
+    ++wrong_version[offsetof(PlaylistSnapshot::Header, version)];
+    writeBytes(damaged, wrong_version);
+    check(rejected(damaged), "other version is rejected");
+
+    // Point the string pool past the end of the file
+    std::string bad_section = bytes;
+    const size_t pool = offsetof(PlaylistSnapshot::Header, sections) +
+                        PlaylistSnapshot::STRINGS * sizeof(PlaylistSnapshot::SectionEntry);
+    uint64_t offset = bytes.size();
+    bad_section.replace(pool, sizeof(offset), reinterpret_cast<const char*>(&offset), sizeof(offset));
+    writeBytes(damaged, bad_section);
+    check(rejected(damaged), "section outside the file is rejected");
+
+    std::filesystem::remove(damaged);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::fprintf(stderr, "usage: %s <fixtures directory>\n", argv[0]);
+        return 2;
+    }
+    // An unknown tag after the first audio rendition, kept as passthrough
+    std::string master = readFile(std::filesystem::path(argv[1]) / "master.m3u8");
+    size_t second_media = master.find("#EXT-X-MEDIA:", master.find("#EXT-X-MEDIA:") + 1);
+    master.insert(second_media, "#EXT-X-UNKNOWN-TAG:VALUE=1\n");
+
+    const std::filesystem::path path = std::filesystem::temp_directory_path() /
+                                       ("playlist_snapshot_test." + std::to_string(::getpid()) + ".snap");
+    roundTrip<M3U8Parser>(master, path, "M3U8Parser");
+    roundTrip<M3U8ViewParser>(master, path, "M3U8ViewParser");
+    damagedFiles(path);
+    std::filesystem::remove(path);
+    return failures == 0 ? 0 : 1;
+}
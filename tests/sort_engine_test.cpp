@@ -0,0 +1,98 @@
+/*
+ *   The comparison and radix sort engines must produce the same order
+ *
+ *   Sorts generated master playlists, below and above kRadixSortThreshold, by every single
+ *   attribute and every pair of attributes each sub-parser supports, ascending and
+ *   descending, with each engine. Low-cardinality attributes (CODECS, VIDEO-RANGE, AUDIO,
+ *   ...) and missing optional attributes make for many elements that tie on every key.
+ */
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "M3U8Parser.h"
+#include "PlaylistGenerator.h"
+
+namespace {
+
+using SortAttribute = HLSTagParser::SortAttribute;
+using SortEngine    = HLSTagParser::SortEngine;
+using SortKey       = HLSTagParser::SortKey;
+
+int failures = 0;
+int checks   = 0;
+
+std::string describe(const std::vector<SortKey>& keys) {
+    std::string text;
+    for (const SortKey& key : keys) {
+        if (!text.empty()) text += ',';
+        if (key.order == HLSTagParser::SortOrder::DESCENDING) text += '-';
+        text += HLSTagParser::attributeName(key.attribute);
+    }
+    return text;
+}
+
+template<ParserType T>
+std::string sorted(const M3U8Parser& parsed, const std::vector<SortKey>& keys, SortEngine engine) {
+    M3U8Parser parser = parsed;
+    parser.select<T>().sort(std::span<const SortKey>(keys), engine);
+    return parser.stringify();
+}
+
+// Every engine sorts parsed by keys into the same playlist; false if T cannot sort by keys.
+template<ParserType T>
+bool checkKeys(const M3U8Parser& parsed, const std::vector<SortKey>& keys, const char* group) {
+    std::string comparison;
+    try {
+        comparison = sorted<T>(parsed, keys, SortEngine::COMPARISON);
+    } catch (const std::invalid_argument&) {
+        return false;
+    }
+    ++checks;
+    if (sorted<T>(parsed, keys, SortEngine::RADIX) != comparison ||
+        sorted<T>(parsed, keys, SortEngine::AUTO) != comparison) {
+        std::printf("FAILED  %s sorted by %s: engines disagree\n", group, describe(keys).c_str());
+        ++failures;
+    }
+    return true;
+}
+
+template<ParserType T>
+void checkSection(const M3U8Parser& parsed, const char* group) {
+    std::vector<SortAttribute> supported;
+    for (size_t a = 0; a < HLSTagParser::kSortAttributeCount; ++a) {
+        const auto attribute = static_cast<SortAttribute>(a);
+        if (checkKeys<T>(parsed, {attribute}, group)) {
+            supported.push_back(attribute);
+            checkKeys<T>(parsed, {HLSTagParser::descending(attribute)}, group);
+        }
+    }
+    for (SortAttribute primary : supported) {
+        for (SortAttribute secondary : supported) {
+            if (primary == secondary) continue;
+            checkKeys<T>(parsed, {primary, secondary}, group);
+            checkKeys<T>(parsed, {HLSTagParser::descending(primary), secondary}, group);
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    for (size_t size : {size_t(100), HLSTagParser::kRadixSortThreshold + 100}) {
+        PlaylistGenerator::MasterOptions options;
+        options.variants            = size;
+        options.audio_tracks        = size;
+        options.iframes             = size;
+        options.optional_attributes = 0.5;
+        M3U8Parser parsed;
+        parsed.parse(PlaylistGenerator::master(options));
+
+        checkSection<ParserType::STREAM>(parsed, "variants");
+        checkSection<ParserType::AUDIO>(parsed, "renditions");
+        checkSection<ParserType::IFRAME>(parsed, "I-frame streams");
+    }
+    std::printf("%d sorts compared, %d with differing engines\n", checks, failures);
+    return failures == 0 && checks > 0 ? 0 : 1;
+}
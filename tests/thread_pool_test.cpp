@@ -0,0 +1,101 @@
+/*
+ *   Tests of ThreadPool: task accounting, stealing and destruction
+ *
+ *   Best run under -fsanitize=thread or address, where a task touching a destroyed pool
+ *   shows up as a report rather than as a rare crash.
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "ThreadPool.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    std::printf("%s %s\n", condition ? "ok     " : "FAILED ", what.c_str());
+    if (!condition) ++failures;
+}
+
+// Tasks fanning out into more tasks on the same pool all run before wait() returns.
+void nestedSubmissions() {
+    std::atomic<int> ran{0};
+    ThreadPool pool(4);
+    for (int i = 0; i < 100; ++i) {
+        pool.submit([&pool, &ran] {
+            for (int j = 0; j < 10; ++j) pool.submit([&ran] { ++ran; });
+            ++ran;
+        });
+    }
+    pool.wait();
+    check(ran == 1100, "nested submissions all run before wait() returns");
+}
+
+// wait() rethrows the first exception of a task, once.
+void taskExceptions() {
+    ThreadPool pool(2);
+    pool.submit([] { throw std::runtime_error("task failed"); });
+    bool thrown = false;
+    try {
+        pool.wait();
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    pool.submit([] {});
+    bool rethrown = false;
+    try {
+        pool.wait();
+    } catch (const std::runtime_error&) {
+        rethrown = true;
+    }
+    check(thrown && !rethrown, "wait() rethrows a task's exception once");
+}
+
+// Tasks still queued at destruction run, including those their siblings submit meanwhile.
+void destructionRunsQueuedTasks() {
+    std::atomic<int> ran{0};
+    {
+        ThreadPool pool(2);
+        for (int i = 0; i < 1000; ++i) {
+            pool.submit([&pool, &ran] {
+                ++ran;
+                pool.submit([&ran] { ++ran; });
+            });
+        }
+    }
+    check(ran == 2000, "destruction runs every queued task");
+}
+
+// Workers of one pool resume work on another, which is destroyed as soon as that work is
+// done, while the submitting threads may still be returning from submit().
+void crossPoolResumption() {
+    ThreadPool source(4);
+    int done = 0;
+    for (int round = 0; round < 2000; ++round) {
+        std::atomic<int> finished{0};
+        {
+            ThreadPool target(2);
+            for (int i = 0; i < 4; ++i) {
+                source.submit([&target, &finished] { target.submit([&finished] { ++finished; }); });
+            }
+            while (finished < 4) std::this_thread::yield();
+        }
+        done += finished;
+    }
+    source.wait();
+    check(done == 8000, "pool destroyed right after cross-pool submissions completed");
+}
+
+} // namespace
+
+int main() {
+    nestedSubmissions();
+    taskExceptions();
+    destructionRunsQueuedTasks();
+    crossPoolResumption();
+    return failures == 0 ? 0 : 1;
+}